@@ -0,0 +1,1127 @@
+/* cshell_bench: micro/macro benchmarks for the shell core.
+ *
+ *   cshell_bench [--quick] [--only NAME]...
+ *
+ * NAME is one of tokenize, parse, long_line, glob, spawn, pipeline, vfs,
+ * vfs_grep, vfs_path, vfs_snapshot, vfs_threads, footprint, server, rc,
+ * subst, prewarm, pipe_meter, deadline, capture, coproc, shard, redirect.
+ * Results are written to stdout as a single JSON object; progress and errors go
+ * to stderr. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <glob.h>
+#include <pthread.h>
+#include <linux/fs.h>
+#include <linux/fiemap.h>
+
+#include "shell.h"
+
+static int quick = 0;
+static int nresults = 0;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void result_begin(const char *name) {
+    printf("%s\n    {\"name\": \"%s\"", nresults++ ? "," : "", name);
+}
+static void result_num(const char *key, double v) { printf(", \"%s\": %.3f", key, v); }
+static void result_int(const char *key, long v) { printf(", \"%s\": %ld", key, v); }
+static void result_str(const char *key, const char *v) { printf(", \"%s\": \"%s\"", key, v); }
+static void result_end(void) { printf("}"); fflush(stdout); }
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* Silence builtins that report on stdout while they are being timed. */
+static int mute_stdout(void) {
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int devnull = open("/dev/null", O_WRONLY);
+    dup2(devnull, STDOUT_FILENO);
+    close(devnull);
+    return saved;
+}
+static void unmute_stdout(int saved) {
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+}
+
+static const char *sample_lines[] = {
+    "ls -la /usr/local/bin",
+    "grep -n \"static int\" src/exec.c src/parse.c | sort -u > out.txt",
+    "cat access.log | grep ' 500 ' | cut -d' ' -f1 | sort | uniq -c | sort -rn | head",
+    "ll $HOME",
+    "find . -name '*.c' -newer Makefile >> changed.txt",
+    "vfs write notes.txt remember to rotate the logs tonight",
+};
+#define NSAMPLES (int)(sizeof(sample_lines) / sizeof(sample_lines[0]))
+
+static void bench_tokenize(void) {
+    long iters = quick ? 200000 : 2000000;
+    size_t bytes = 0;
+    double t0 = now_sec();
+    for (long i = 0; i < iters; ++i) {
+        const char *src = sample_lines[i % NSAMPLES];
+        int n = 0;
+        char **toks = tokenize_line(src, &n);
+        free_tokens(toks);
+        bytes += strlen(src);
+    }
+    double dt = now_sec() - t0;
+    result_begin("tokenize");
+    result_num("lines_per_sec", iters / dt);
+    result_num("mb_per_sec", bytes / dt / 1e6);
+    result_end();
+}
+
+static void bench_parse(void) {
+    long iters = quick ? 100000 : 1000000;
+    add_alias("ll", "ls -l --color=never");
+    double t0 = now_sec();
+    for (long i = 0; i < iters; ++i) {
+        Command *cmd = parse_input(sample_lines[i % NSAMPLES]);
+        free_command(cmd);
+    }
+    double dt = now_sec() - t0;
+    result_begin("parse");
+    result_num("lines_per_sec", iters / dt);
+    result_num("ns_per_line", dt / iters * 1e9);
+    result_end();
+}
+
+/* A find(1)-style file list: "rm ./logs/d017/app-000123.log ..." of at least
+ * min_bytes, the shape that used to overflow the old 128-argument limit. */
+static char *make_long_line(size_t min_bytes, int *nargs) {
+    char *line = malloc(min_bytes + 64);
+    if (!line) return NULL;
+    size_t off = (size_t)sprintf(line, "rm");
+    int n = 1;
+    while (off < min_bytes) off += (size_t)sprintf(line + off, " ./logs/d%03d/app-%06d.log", n % 997, n), ++n;
+    if (nargs) *nargs = n;
+    return line;
+}
+
+static void bench_long_lines(void) {
+    size_t sizes[] = { 1 << 20, 8 << 20 };
+    int reps = quick ? 3 : 10;
+    for (size_t k = 0; k < sizeof(sizes) / sizeof(sizes[0]); ++k) {
+        int nargs = 0;
+        char *line = make_long_line(sizes[k], &nargs);
+        if (!line) return;
+        size_t len = strlen(line);
+
+        double t0 = now_sec();
+        for (int r = 0; r < reps; ++r) {
+            int n = 0;
+            free_tokens(tokenize_line(line, &n));
+        }
+        double tok_dt = (now_sec() - t0) / reps;
+
+        t0 = now_sec();
+        int argc = 0;
+        for (int r = 0; r < reps; ++r) {
+            Command *cmd = parse_input(line);
+            argc = cmd ? cmd->argc : 0;
+            free_command(cmd);
+        }
+        double parse_dt = (now_sec() - t0) / reps;
+
+        result_begin("long_line");
+        result_int("bytes", (long)len);
+        result_int("args", argc);
+        result_num("tokenize_mb_per_sec", len / tok_dt / 1e6);
+        result_num("parse_mb_per_sec", len / parse_dt / 1e6);
+        result_num("parse_ms", parse_dt * 1e3);
+        result_end();
+        free(line);
+    }
+}
+
+/* Expand patterns over a log directory of many files, next to glob(3) as a
+ * reference point. */
+static void bench_glob(void) {
+    int nfiles = quick ? 20000 : 200000;
+    const char *tmpdir = getenv("TMPDIR");
+    char dir[PATH_BUF], path[PATH_BUF + 64];
+    snprintf(dir, sizeof(dir), "%s/cshell_glob.XXXXXX", tmpdir ? tmpdir : "/tmp");
+    if (!mkdtemp(dir)) { perror("bench: mkdtemp"); return; }
+    for (int i = 0; i < nfiles; ++i) {
+        snprintf(path, sizeof(path), "%s/app-%06d.%s", dir, (i * 7919) % nfiles, i % 10 ? "log" : "gz");
+        int fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+        if (fd >= 0) close(fd);
+    }
+    const char *patterns[] = { "*.log", "app-01*.log", "app-[0-4]?????.gz", "app-{000001,000002,000003}.log" };
+    char cwd[PATH_BUF];
+    if (!getcwd(cwd, sizeof(cwd)) || chdir(dir) != 0) return;
+    for (size_t k = 0; k < sizeof(patterns) / sizeof(patterns[0]); ++k) {
+        int n = 0;
+        double t0 = now_sec();
+        char **words = expand_word(patterns[k], &n);
+        double dt = now_sec() - t0;
+        free_tokens(words);
+
+        glob_t gl;
+        t0 = now_sec();
+        int rc = glob(patterns[k], GLOB_BRACE, NULL, &gl);
+        double libc_dt = now_sec() - t0;
+        result_begin("glob");
+        result_str("pattern", patterns[k]);
+        result_int("dir_entries", nfiles);
+        result_int("matches", n);
+        result_num("ms", dt * 1e3);
+        result_num("libc_glob_ms", libc_dt * 1e3);
+        result_end();
+        if (rc == 0) globfree(&gl);
+    }
+    if (chdir(cwd) != 0) perror("bench: chdir");
+    for (int i = 0; i < nfiles; ++i) {
+        snprintf(path, sizeof(path), "%s/app-%06d.%s", dir, (i * 7919) % nfiles, i % 10 ? "log" : "gz");
+        unlink(path);
+    }
+    rmdir(dir);
+}
+
+static void bench_spawn(void) {
+    int iters = quick ? 200 : 2000;
+    double *lat = malloc(sizeof(double) * iters);
+    Command *cmd = parse_input("true");
+    if (!lat || !cmd) { free(lat); free_command(cmd); return; }
+    for (int l = LAUNCH_FORK; l <= LAUNCH_SPAWN; ++l) {
+        int ok = 0;
+        double t0 = now_sec();
+        for (int i = 0; i < iters; ++i) {
+            double s = now_sec();
+            pid_t pid = launch_command(cmd, 0, -1, -1, (Launcher)l, NULL);
+            if (pid < 0) break;
+            int status;
+            waitpid(pid, &status, 0);
+            lat[ok++] = now_sec() - s;
+        }
+        double dt = now_sec() - t0;
+        if (ok == 0) continue;
+        qsort(lat, ok, sizeof(double), cmp_double);
+        double sum = 0;
+        for (int i = 0; i < ok; ++i) sum += lat[i];
+        result_begin("spawn");
+        result_str("launcher", launcher_name((Launcher)l));
+        result_num("spawns_per_sec", ok / dt);
+        result_num("mean_us", sum / ok * 1e6);
+        result_num("p50_us", lat[ok / 2] * 1e6);
+        result_num("p99_us", lat[(ok * 99) / 100] * 1e6);
+        result_end();
+    }
+    free_command(cmd);
+    free(lat);
+}
+
+/* Launch every stage of cmd_list the way execute_pipeline() does, sending the
+ * final stage to out_fd, and wait for all of them. With pinned set, stages are
+ * placed on cores as "pin" would. */
+static int run_pipeline(Command *cmd_list, int out_fd, int pinned) {
+    pid_t pids[16];
+    cpu_set_t sets[16];
+    int npids = 0, prev_fd = -1, pipefd[2], n = 0;
+    for (Command *c = cmd_list; c && n < 16; c = c->next) ++n;
+    if (pinned && affinity_plan(n, NULL, sets, NULL) != 0) pinned = 0;
+    for (Command *c = cmd_list; c && npids < 16; c = c->next) {
+        LaunchOpts lo = { -1, pinned ? &sets[npids] : NULL, -1, -1, 0 };
+        if (c->next) { if (pipe2(pipefd, O_CLOEXEC) < 0) return -1; }
+        else { pipefd[0] = -1; pipefd[1] = out_fd; }
+        pid_t pid = launch_command(c, npids ? pids[0] : 0, prev_fd, pipefd[1], shell_launcher, &lo);
+        if (pid > 0) pids[npids++] = pid;
+        if (c->next) close(pipefd[1]);
+        if (prev_fd != -1) close(prev_fd);
+        prev_fd = pipefd[0];
+    }
+    for (int i = 0; i < npids; ++i) waitpid(pids[i], NULL, 0);
+    return npids;
+}
+
+static void bench_pipeline(void) {
+    size_t mb = quick ? 16 : 256;
+    const char *tmpdir = getenv("TMPDIR");
+    char path[PATH_BUF];
+    snprintf(path, sizeof(path), "%s/cshell_bench.XXXXXX", tmpdir ? tmpdir : "/tmp");
+    int fd = mkstemp(path);
+    if (fd < 0) { perror("bench: mkstemp"); return; }
+    char *chunk = malloc(1 << 20);
+    if (!chunk) { close(fd); unlink(path); return; }
+    for (int i = 0; i < (1 << 20); ++i) chunk[i] = (i % 64 == 63) ? '\n' : 'a' + i % 26;
+    for (size_t i = 0; i < mb; ++i) {
+        if (write(fd, chunk, 1 << 20) != (1 << 20)) { perror("bench: write"); break; }
+    }
+    free(chunk);
+    close(fd);
+
+    int devnull = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    for (int run = 0; run < 8; ++run) {
+        int stages = run / 2 + 1, pinned = run % 2;
+        if (stages == 1 && pinned) continue;
+        char line[MAX_LINE];
+        int off = snprintf(line, sizeof(line), "cat < %s", path);
+        for (int s = 1; s < stages; ++s) off += snprintf(line + off, sizeof(line) - off, " | cat");
+        Command *cmd = parse_input(line);
+        if (!cmd) continue;
+        double t0 = now_sec();
+        run_pipeline(cmd, devnull, pinned);
+        double dt = now_sec() - t0;
+        free_command(cmd);
+        result_begin("pipeline");
+        result_int("stages", stages);
+        result_str("pinned", pinned ? "yes" : "no");
+        result_int("mb", (long)mb);
+        result_num("mb_per_sec", mb / dt);
+        result_end();
+    }
+    close(devnull);
+    unlink(path);
+}
+
+static void bench_vfs(void) {
+    long rounds = quick ? 2000 : 20000;
+    const int files = 16;
+    char name[32];
+    int saved = mute_stdout();
+    double t0 = now_sec();
+    for (long r = 0; r < rounds; ++r) {
+        for (int i = 0; i < files; ++i) { snprintf(name, sizeof(name), "f%d", i); vfs_create(name); }
+        for (int i = 0; i < files; ++i) { snprintf(name, sizeof(name), "f%d", i); vfs_write(name, "payload data for the benchmark"); }
+        for (int i = 0; i < files; ++i) { snprintf(name, sizeof(name), "f%d", i); vfs_cat(name); }
+        for (int i = files - 1; i >= 0; --i) { snprintf(name, sizeof(name), "f%d", i); vfs_rm(name); }
+    }
+    double dt = now_sec() - t0;
+    unmute_stdout(saved);
+    result_begin("vfs");
+    result_num("ops_per_sec", rounds * files * 4 / dt);
+    result_int("files", files);
+    result_end();
+}
+
+/* vfs grep over a few thousand files of generated text: a rare word, a common
+ * one, and a string no file has, each with the trigram index and by scanning
+ * every file. */
+static void bench_vfs_grep(void) {
+    int files = quick ? 1000 : 4000, iters = quick ? 200 : 1000;
+    char name[32], data[400], word[16][12];
+    unsigned seed = 12345;
+    for (int w = 0; w < 16; ++w) {
+        for (int c = 0; c < 7; ++c) word[w][c] = (char)('a' + (seed = seed * 1103515245 + 12345) % 26);
+        word[w][7] = '\0';
+    }
+    int saved = mute_stdout();
+    for (int i = 0; i < files; ++i) {
+        snprintf(name, sizeof(name), "g%d", i);
+        vfs_create(name);
+        int off = 0;
+        for (int k = 0; k < 40; ++k) {
+            seed = seed * 1103515245 + 12345;
+            off += snprintf(data + off, sizeof(data) - off, "%s%u ", word[(seed >> 16) % 16], (seed >> 8) % 1000);
+            if (off >= (int)sizeof(data) - 24) break;
+        }
+        vfs_write(name, data);
+    }
+    snprintf(data, sizeof(data), "%s%u", word[3], 417u);
+    const char *queries[][2] = { { "rare", data }, { "common", word[5] }, { "absent", "qqqzzz" } };
+    double results[3][2];
+    int hits[3];
+    for (int q = 0; q < 3; ++q) {
+        for (int scan = 0; scan < 2; ++scan) {
+            double t0 = now_sec();
+            for (int i = 0; i < iters; ++i) hits[q] = vfs_grep(queries[q][1], VFS_GREP_LIST | (scan ? VFS_GREP_SCAN : 0));
+            results[q][scan] = (now_sec() - t0) / iters * 1e6;
+        }
+    }
+    for (int i = files - 1; i >= 0; --i) { snprintf(name, sizeof(name), "g%d", i); vfs_rm(name); }
+    unmute_stdout(saved);
+    for (int q = 0; q < 3; ++q) {
+        result_begin("vfs_grep");
+        result_str("query", queries[q][0]);
+        result_int("files", files);
+        result_int("matching_files", hits[q]);
+        result_num("indexed_us", results[q][0]);
+        result_num("scan_us", results[q][1]);
+        result_end();
+    }
+}
+
+/* Resolving a 16-deep path in a tree of a few thousand entries, through the
+ * dentry cache and by scanning each directory level, for a path that exists
+ * and one whose last component doesn't. */
+static void bench_vfs_path(void) {
+    const int depth = 16, per_dir = quick ? 60 : 250;
+    long iters = quick ? 20000 : 200000;
+    char path[PATH_BUF] = "", name[PATH_BUF + 16];
+    int saved = mute_stdout();
+    for (int d = 0; d < depth; ++d) {
+        size_t len = strlen(path);
+        snprintf(path + len, sizeof(path) - len, "/d%d", d);
+        vfs_mkdir(path);
+        for (int i = 0; i < per_dir; ++i) { snprintf(name, sizeof(name), "%s/f%d", path, i); vfs_create(name); }
+    }
+    snprintf(name, sizeof(name), "%s/f7", path);
+    char missing[PATH_BUF + 16];
+    snprintf(missing, sizeof(missing), "%s/nope", path);
+    const char *queries[][2] = { { "hit", name }, { "miss", missing } };
+    double results[2][2];
+    int found[2];
+    for (int q = 0; q < 2; ++q) {
+        for (int scan = 0; scan < 2; ++scan) {
+            long n = scan ? iters / 100 : iters;
+            double t0 = now_sec();
+            for (long i = 0; i < n; ++i) found[q] = vfs_lookup(queries[q][1], scan ? VFS_LOOKUP_NOCACHE : 0) >= 0;
+            results[q][scan] = (now_sec() - t0) / n * 1e9;
+        }
+    }
+    for (int d = depth - 1; d >= 0; --d) {
+        char *slash = strrchr(path, '/');
+        for (int i = 0; i < per_dir; ++i) { snprintf(name, sizeof(name), "%s/f%d", path, i); vfs_rm(name); }
+        vfs_rm(path);
+        *slash = '\0';
+    }
+    unmute_stdout(saved);
+    for (int q = 0; q < 2; ++q) {
+        result_begin("vfs_path");
+        result_str("query", queries[q][0]);
+        result_int("depth", depth);
+        result_int("files", depth * (per_dir + 1));
+        result_int("found", found[q]);
+        result_num("cached_ns", results[q][0]);
+        result_num("scan_ns", results[q][1]);
+        result_end();
+    }
+}
+
+/* Copy-on-write snapshots of a few thousand files: taking one, the first write
+ * after it (which copies the pointer table), later writes, and restoring it
+ * after those two writes. */
+static void bench_vfs_snapshot(void) {
+    int files = quick ? 1000 : 4000, iters = quick ? 200 : 1000;
+    char name[32], other[32];
+    int saved = mute_stdout();
+    for (int i = 0; i < files; ++i) {
+        snprintf(name, sizeof(name), "s%d", i);
+        vfs_create(name);
+        vfs_write(name, "snapshot payload");
+    }
+    double take = 0, first = 0, later = 0, restore = 0, plain = 0, t0;
+    for (int r = 0; r < iters; ++r) {
+        snprintf(name, sizeof(name), "s%d", r % files);
+        snprintf(other, sizeof(other), "s%d", (r + 1) % files);
+        t0 = now_sec(); vfs_write(name, "no snapshot"); plain += now_sec() - t0;
+        t0 = now_sec(); vfs_snapshot("bench"); take += now_sec() - t0;
+        t0 = now_sec(); vfs_write(name, "after snapshot"); first += now_sec() - t0;
+        t0 = now_sec(); vfs_write(other, "after snapshot"); later += now_sec() - t0;
+        t0 = now_sec(); vfs_restore("bench"); restore += now_sec() - t0;
+        vfs_snapshot_drop("bench");
+    }
+    for (int i = files - 1; i >= 0; --i) { snprintf(name, sizeof(name), "s%d", i); vfs_rm(name); }
+    unmute_stdout(saved);
+    result_begin("vfs_snapshot");
+    result_int("files", files);
+    result_num("write_us", plain / iters * 1e6);
+    result_num("snapshot_us", take / iters * 1e6);
+    result_num("first_write_us", first / iters * 1e6);
+    result_num("next_write_us", later / iters * 1e6);
+    result_num("restore_us", restore / iters * 1e6);
+    result_end();
+}
+
+typedef struct VfsReader {
+    int files;
+    long reads;
+    unsigned seed;
+} VfsReader;
+
+static volatile int vfs_stop;
+
+static void *vfs_reader(void *arg) {
+    VfsReader *r = arg;
+    char name[32], buf[64];
+    while (!vfs_stop) {
+        r->seed = r->seed * 1103515245 + 12345;
+        snprintf(name, sizeof(name), "/t%u/f%u", (r->seed >> 16) % 16, (r->seed >> 8) % (r->files / 16));
+        if (vfs_read(name, buf, sizeof(buf)) >= 0) ++r->reads;
+    }
+    return NULL;
+}
+
+/* Reader threads calling vfs_read on random files for a fixed time while the
+ * main thread keeps rewriting files; reads/sec in total, and the writer's
+ * rate alongside them. */
+static void bench_vfs_threads(void) {
+    int files = quick ? 1024 : 4096;
+    double secs = quick ? 0.1 : 0.5;
+    char name[32];
+    int saved = mute_stdout();
+    for (int d = 0; d < 16; ++d) {
+        snprintf(name, sizeof(name), "/t%d", d);
+        vfs_mkdir(name);
+        for (int i = 0; i < files / 16; ++i) {
+            snprintf(name, sizeof(name), "/t%d/f%d", d, i);
+            vfs_create(name);
+            vfs_write(name, "threaded payload");
+        }
+    }
+    unmute_stdout(saved);
+    for (int nthreads = 1; nthreads <= 4; nthreads *= 2) {
+        VfsReader readers[4];
+        pthread_t tid[4];
+        vfs_stop = 0;
+        for (int t = 0; t < nthreads; ++t) {
+            readers[t] = (VfsReader){ files, 0, 77u + t };
+            pthread_create(&tid[t], NULL, vfs_reader, &readers[t]);
+        }
+        saved = mute_stdout();
+        long writes = 0;
+        double t0 = now_sec(), dt;
+        while ((dt = now_sec() - t0) < secs) {
+            snprintf(name, sizeof(name), "/t%ld/f%ld", writes % 16, writes % (files / 16));
+            vfs_write(name, writes & 1 ? "threaded payload" : "rewritten payload");
+            ++writes;
+        }
+        vfs_stop = 1;
+        long reads = 0;
+        for (int t = 0; t < nthreads; ++t) { pthread_join(tid[t], NULL); reads += readers[t].reads; }
+        unmute_stdout(saved);
+        result_begin("vfs_threads");
+        result_int("readers", nthreads);
+        result_int("files", files);
+        result_int("cpus", sysconf(_SC_NPROCESSORS_ONLN));
+        result_num("reads_per_sec", reads / dt);
+        result_num("writes_per_sec", writes / dt);
+        result_end();
+    }
+    saved = mute_stdout();
+    for (int d = 0; d < 16; ++d) {
+        for (int i = 0; i < files / 16; ++i) { snprintf(name, sizeof(name), "/t%d/f%d", d, i); vfs_rm(name); }
+        snprintf(name, sizeof(name), "/t%d", d);
+        vfs_rm(name);
+    }
+    unmute_stdout(saved);
+}
+
+/* Round trips to a pre-forked "cshell --server" compared with starting a
+ * fresh shell per command, plus throughput with several clients at once. */
+static void bench_server(void) {
+    char sock[PATH_BUF], exe[PATH_BUF], shell[PATH_BUF + 16];
+    const char *tmpdir = getenv("TMPDIR");
+    snprintf(sock, sizeof(sock), "%s/cshell_bench.%d.sock", tmpdir ? tmpdir : "/tmp", (int)getpid());
+    int devnull = open("/dev/null", O_RDWR | O_CLOEXEC);
+    int fds[3] = { devnull, devnull, devnull };
+    int workers = 4;
+
+    fflush(stdout);                     /* workers must not inherit pending output */
+    pid_t server = fork();
+    if (server == 0) {
+        dup2(devnull, STDERR_FILENO);
+        _exit(server_main(sock, workers));
+    }
+    int up = 0;
+    for (int i = 0; i < 200 && !up; ++i) {
+        up = server_request(sock, "", fds) == 0;
+        if (!up) usleep(10000);
+    }
+    if (!up) { fprintf(stderr, "bench: server did not start\n"); kill(server, SIGTERM); waitpid(server, NULL, 0); close(devnull); return; }
+
+    static const struct { const char *mode, *script; } warm[] = {
+        { "warm_builtin", "set CSHELL_BENCH=1" },
+        { "warm_exec", "true" },
+    };
+    int iters = quick ? 200 : 2000;
+    for (int m = 0; m < 2; ++m) {
+        double t0 = now_sec();
+        for (int i = 0; i < iters; ++i) server_request(sock, warm[m].script, fds);
+        double dt = now_sec() - t0;
+        result_begin("server");
+        result_str("mode", warm[m].mode);
+        result_num("us_per_req", dt / iters * 1e6);
+        result_end();
+    }
+
+    /* A cold shell per command: what a client pays without the server. */
+    ssize_t len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    char *slash = len > 0 ? (exe[len] = '\0', strrchr(exe, '/')) : NULL;
+    if (slash) {
+        *slash = '\0';
+        snprintf(shell, sizeof(shell), "%s/cshell", exe);
+    }
+    if (slash && access(shell, X_OK) == 0) {
+        int cold_iters = iters / 4;
+        double t0 = now_sec();
+        for (int i = 0; i < cold_iters; ++i) {
+            int p[2];
+            if (pipe2(p, O_CLOEXEC) < 0) break;
+            pid_t pid = fork();
+            if (pid == 0) {
+                dup2(p[0], STDIN_FILENO);
+                dup2(devnull, STDOUT_FILENO);
+                dup2(devnull, STDERR_FILENO);
+                execl(shell, shell, (char *)NULL);
+                _exit(127);
+            }
+            close(p[0]);
+            if (write(p[1], "true\n", 5) != 5) { }
+            close(p[1]);
+            waitpid(pid, NULL, 0);
+        }
+        double dt = now_sec() - t0;
+        result_begin("server");
+        result_str("mode", "cold_start");
+        result_num("us_per_req", dt / cold_iters * 1e6);
+        result_end();
+    }
+
+    int clients = 8, per_client = iters / 4;
+    double t0 = now_sec();
+    for (int c = 0; c < clients; ++c) {
+        if (fork() == 0) {
+            for (int i = 0; i < per_client; ++i) server_request(sock, "true", fds);
+            _exit(0);
+        }
+    }
+    for (int c = 0; c < clients; ++c) wait(NULL);
+    double dt = now_sec() - t0;
+    result_begin("server");
+    result_str("mode", "concurrent");
+    result_int("clients", clients);
+    result_int("workers", workers);
+    result_num("req_per_sec", clients * per_client / dt);
+    result_end();
+
+    kill(server, SIGTERM);
+    waitpid(server, NULL, 0);
+    close(devnull);
+}
+
+/* rc_load() in a fresh child: how long it took, and the mean check_alias()
+ * cost afterwards over the nalias rc-defined names. */
+static int rc_child(int nalias, double *load_us, double *lookup_ns) {
+    int p[2];
+    double res[2] = { -1, -1 };
+    if (pipe(p) < 0) return -1;
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(p[0]);
+        int saved = mute_stdout();
+        double t0 = now_sec();
+        rc_load();
+        res[0] = (now_sec() - t0) * 1e6;
+        char name[32];
+        int iters = 200000;
+        t0 = now_sec();
+        for (int i = 0; i < iters; ++i) {
+            snprintf(name, sizeof(name), "a%d", (i * 7919) % nalias);
+            if (!check_alias(name)) break;
+        }
+        res[1] = (now_sec() - t0) / iters * 1e9;
+        unmute_stdout(saved);
+        if (write(p[1], res, sizeof(res)) != (ssize_t)sizeof(res)) { }
+        _exit(0);
+    }
+    close(p[1]);
+    ssize_t n = read(p[0], res, sizeof(res));
+    close(p[0]);
+    waitpid(pid, NULL, 0);
+    if (n != (ssize_t)sizeof(res)) return -1;
+    *load_us = res[0];
+    *lookup_ns = res[1];
+    return 0;
+}
+
+/* Startup with an rc file of thousands of aliases and variables: running it
+ * line by line, running it and writing the snapshot, and mapping the snapshot. */
+static void bench_rc(void) {
+    char dir[PATH_BUF], rc[PATH_BUF + 16], snapfile[PATH_BUF + 16];
+    const char *tmpdir = getenv("TMPDIR");
+    snprintf(dir, sizeof(dir), "%s/cshell_bench_rc.%d", tmpdir ? tmpdir : "/tmp", (int)getpid());
+    snprintf(rc, sizeof(rc), "%s/rc", dir);
+    snprintf(snapfile, sizeof(snapfile), "%s/rc.snap", dir);
+    if (mkdir(dir, 0700) != 0) { perror("bench: mkdir"); return; }
+    int ndefs = quick ? 1000 : 4000;
+    FILE *f = fopen(rc, "w");
+    if (!f) { rmdir(dir); return; }
+    for (int i = 0; i < ndefs; ++i) {
+        fprintf(f, "alias a%d=\"ls -l --color=never /var/log/app%d\"\n", i, i);
+        fprintf(f, "set CSHELL_BENCH_V%d=/opt/app%d/bin\n", i, i);
+    }
+    fclose(f);
+    setenv("CSHELL_RC", rc, 1);
+
+    static const char *modes[] = { "run", "rebuild", "snapshot" };
+    int reps = quick ? 5 : 20;
+    for (int m = 0; m < 3; ++m) {
+        setenv("CSHELL_RC_SNAPSHOT", m == 0 ? "" : snapfile, 1);
+        double loads[64], lookup = 0, load_us, lookup_ns;
+        int n = 0;
+        for (int r = 0; r < reps; ++r) {
+            if (m == 1) unlink(snapfile);
+            if (rc_child(ndefs, &load_us, &lookup_ns) != 0) break;
+            loads[n++] = load_us;
+            lookup += lookup_ns;
+        }
+        if (n == 0) continue;
+        qsort(loads, n, sizeof(double), cmp_double);
+        result_begin("rc");
+        result_str("mode", modes[m]);
+        result_int("aliases", ndefs);
+        result_int("vars", ndefs);
+        result_num("load_us_median", loads[n / 2]);
+        result_num("alias_lookup_ns", lookup / n);
+        result_end();
+    }
+
+    unsetenv("CSHELL_RC");
+    unsetenv("CSHELL_RC_SNAPSHOT");
+    unlink(snapfile);
+    unlink(rc);
+    rmdir(dir);
+}
+
+/* $(pwd) as a builtin run in-process, $(/bin/pwd) through a subshell and pipe,
+ * and the temp-file workaround it replaces ("/bin/pwd > f", then read f). */
+static void bench_subst(void) {
+    char tmp[PATH_BUF], line[PATH_BUF + 32], buf[PATH_BUF];
+    const char *tmpdir = getenv("TMPDIR");
+    snprintf(tmp, sizeof(tmp), "%s/cshell_bench_subst.%d", tmpdir ? tmpdir : "/tmp", (int)getpid());
+    static const char *modes[] = { "builtin", "external", "tempfile" };
+    int iters[] = { quick ? 20000 : 200000, quick ? 200 : 2000, quick ? 200 : 2000 };
+    for (int m = 0; m < 3; ++m) {
+        int ok = 1;
+        double t0 = now_sec();
+        for (int i = 0; i < iters[m]; ++i) {
+            if (m < 2) {
+                Command *cmd = parse_input(m == 0 ? "echo $(pwd)" : "echo $(/bin/pwd)");
+                ok = cmd && cmd->argc == 2 && cmd->args[1][0] == '/';
+                free_command(cmd);
+            } else {
+                snprintf(line, sizeof(line), "/bin/pwd > %s", tmp);
+                execute_line(line);
+                int fd = open(tmp, O_RDONLY | O_CLOEXEC);
+                ssize_t n = fd >= 0 ? read(fd, buf, sizeof(buf)) : -1;
+                if (fd >= 0) close(fd);
+                ok = n > 0 && buf[0] == '/';
+            }
+            if (!ok) break;
+        }
+        double dt = now_sec() - t0;
+        if (!ok) { fprintf(stderr, "bench: subst %s gave no output\n", modes[m]); continue; }
+        result_begin("subst");
+        result_str("mode", modes[m]);
+        result_num("us_per_subst", dt / iters[m] * 1e6);
+        result_end();
+    }
+    unlink(tmp);
+}
+
+/* First run of a command whose binary and libraries are not in the page
+ * cache (evicted with POSIX_FADV_DONTNEED) against one that was prewarmed
+ * beforehand: the median of several fork/exec/wait round trips of each. */
+static void bench_prewarm(void) {
+    static const char *const cmds[] = { "git", "python3", "ls" };
+    int rounds = quick ? 5 : 15;
+    for (size_t c = 0; c < sizeof(cmds) / sizeof(cmds[0]); ++c) {
+        char *full = find_command_in_path(cmds[c]), line[PATH_BUF + 32];
+        if (!full) continue;
+        snprintf(line, sizeof(line), "%s --version > /dev/null", full);
+        double cold[32], warm[32];
+        int files = 0;
+        for (int r = 0; r < rounds; ++r) {
+            for (int warmed = 0; warmed < 2; ++warmed) {
+                files = prewarm_binary(full, POSIX_FADV_DONTNEED, 0);
+                if (warmed) prewarm_binary(full, POSIX_FADV_WILLNEED, 0);
+                usleep(100000);             /* the warm-up runs well ahead of the command */
+                double t0 = now_sec();
+                execute_line(line);
+                (warmed ? warm : cold)[r] = (now_sec() - t0) * 1e3;
+            }
+        }
+        qsort(cold, rounds, sizeof(double), cmp_double);
+        qsort(warm, rounds, sizeof(double), cmp_double);
+        result_begin("prewarm");
+        result_str("command", cmds[c]);
+        result_int("files", files);
+        result_num("cold_ms", cold[rounds / 2]);
+        result_num("warm_ms", warm[rounds / 2]);
+        result_end();
+        free(full);
+    }
+}
+
+extern char etext, edata, end;     /* linker-provided segment boundaries */
+
+static long rss_kb(void) {
+    long pages = 0, resident = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (!f) return -1;
+    if (fscanf(f, "%ld %ld", &pages, &resident) != 2) resident = -1;
+    fclose(f);
+    return resident < 0 ? -1 : resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/* Fill the job and alias tables the way a long-lived interactive shell would,
+ * then report resident size, static data size and the cost of fork()ing it. */
+static void bench_footprint(void) {
+    char name[32], line[256];
+    for (int i = 0; i < 128; ++i) {
+        snprintf(name, sizeof(name), "a%d", i);
+        snprintf(line, sizeof(line), "ls -l --color=never /var/log/app%d", i);
+        add_alias(name, line);
+    }
+    for (int i = 0; i < 200; ++i) {
+        snprintf(line, sizeof(line), "sleep %d | grep -v x > /tmp/out%d", i % 7, i % 7);
+        add_job(100000 + i, line, STOPPED);
+    }
+    Command *cmds[256];
+    for (int i = 0; i < 256; ++i) cmds[i] = parse_input(sample_lines[i % NSAMPLES]);
+
+    int iters = quick ? 200 : 2000;
+    double t0 = now_sec();
+    for (int i = 0; i < iters; ++i) {
+        pid_t pid = fork();
+        if (pid == 0) _exit(0);
+        if (pid < 0) break;
+        waitpid(pid, NULL, 0);
+    }
+    double dt = now_sec() - t0;
+
+    result_begin("footprint");
+    result_int("rss_kb", rss_kb());
+    result_int("static_data_kb", (long)(&end - &etext) / 1024);
+    result_int("sizeof_command", (long)sizeof(Command));
+    result_int("sizeof_job", (long)sizeof(Job));
+    result_num("fork_us", dt / iters * 1e6);
+    result_end();
+
+    for (int i = 0; i < 256; ++i) free_command(cmds[i]);
+    for (int i = 0; i < 200; ++i) remove_job(100000 + i);
+}
+
+/* A producer into a fast consumer and into a slow one, plain and with
+ * CSHELL_PIPE_METER=1: the sampling cost, and what growing the pipe of a
+ * stalled writer buys. */
+static void bench_pipe_meter(void) {
+    static const char *const consumers[] = { "cat", "gzip -1" };
+    int rounds = quick ? 3 : 7;
+    long mb = quick ? 64 : 512;
+    for (size_t c = 0; c < sizeof(consumers) / sizeof(consumers[0]); ++c) {
+        char line[128];
+        double t[2][16];
+        for (int r = 0; r < rounds; ++r) {
+            for (int metered = 0; metered < 2; ++metered) {
+                if (metered) setenv("CSHELL_PIPE_METER", "1", 1); else unsetenv("CSHELL_PIPE_METER");
+                snprintf(line, sizeof(line), "head -c %ldM /dev/zero | %s > /dev/null", mb, consumers[c]);
+                double t0 = now_sec();
+                execute_line(line);
+                t[metered][r] = now_sec() - t0;
+            }
+        }
+        unsetenv("CSHELL_PIPE_METER");
+        qsort(t[0], rounds, sizeof(double), cmp_double);
+        qsort(t[1], rounds, sizeof(double), cmp_double);
+        result_begin("pipe_meter");
+        result_str("consumer", consumers[c]);
+        result_int("mb", mb);
+        result_num("plain_mb_per_sec", mb / t[0][rounds / 2]);
+        result_num("metered_mb_per_sec", mb / t[1][rounds / 2]);
+        result_end();
+    }
+}
+
+/* What a deadline costs per command, enforced by the shell or by timeout(1),
+ * and how far past it a hung command is killed. */
+static void bench_deadline(void) {
+    static const char *const lines[][2] = {
+        { "none", "/usr/bin/true" },
+        { "shell", "timeout 10s /usr/bin/true" },
+        { "timeout(1)", "/usr/bin/timeout 10 /usr/bin/true" },
+    };
+    int iters = quick ? 100 : 1000, hung = quick ? 10 : 40;
+    double *lat = malloc(sizeof(double) * (iters > hung ? iters : hung));
+    if (!lat) return;
+    double p50[3] = { 0 }, p99[3] = { 0 };
+    int saved = mute_stdout();
+    for (size_t c = 0; c < 3; ++c) {
+        if (c == 2 && access("/usr/bin/timeout", X_OK) != 0) continue;
+        char line[64];
+        for (int i = 0; i < iters; ++i) {
+            snprintf(line, sizeof(line), "%s", lines[c][1]);
+            double t0 = now_sec();
+            execute_line(line);
+            lat[i] = now_sec() - t0;
+        }
+        qsort(lat, iters, sizeof(double), cmp_double);
+        p50[c] = lat[iters / 2];
+        p99[c] = lat[(iters * 99) / 100];
+    }
+    for (int i = 0; i < hung; ++i) {
+        char line[] = "timeout 20ms sleep 5";
+        double t0 = now_sec();
+        execute_line(line);
+        lat[i] = now_sec() - t0 - 0.020;
+    }
+    unmute_stdout(saved);
+    for (int c = 0; c < 3; ++c) {
+        if (!p50[c]) continue;
+        result_begin("deadline");
+        result_str("enforced_by", lines[c][0]);
+        result_num("p50_us", p50[c] * 1e6);
+        result_num("p99_us", p99[c] * 1e6);
+        result_end();
+    }
+    qsort(lat, hung, sizeof(double), cmp_double);
+    result_begin("deadline");
+    result_str("enforced_by", "shell, hung command");
+    result_num("overshoot_p50_us", lat[hung / 2] * 1e6);
+    result_num("overshoot_max_us", lat[hung - 1] * 1e6);
+    result_end();
+    free(lat);
+}
+
+/* A chatty background job writing straight to /dev/null, and into a capture
+ * ring the shell drains while it waits: what draining costs the job. */
+static void bench_capture(void) {
+    long mb = quick ? 64 : 512;
+    struct sigaction sa, old;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sigchld_handler;
+    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigaction(SIGCHLD, &sa, &old);
+    for (int captured = 0; captured < 2; ++captured) {
+        if (captured) setenv("CSHELL_CAPTURE_BG", "1", 1); else unsetenv("CSHELL_CAPTURE_BG");
+        char line[64], wait_line[] = "wait";
+        snprintf(line, sizeof(line), "head -c %ldM /dev/zero &", mb);
+        int saved = mute_stdout();
+        double t0 = now_sec();
+        execute_line(line);
+        execute_line(wait_line);
+        double dt = now_sec() - t0;
+        unmute_stdout(saved);
+        reap_done_jobs();
+        result_begin("capture");
+        result_str("output", captured ? "captured" : "/dev/null");
+        result_int("mb", mb);
+        result_num("mb_per_sec", mb / dt);
+        result_end();
+    }
+    unsetenv("CSHELL_CAPTURE_BG");
+    sigaction(SIGCHLD, &old, NULL);
+}
+
+/* A request/response round trip through a running coproc against starting
+ * the command for each request. */
+static void bench_coproc(void) {
+    int iters = quick ? 200 : 2000;
+    double *lat = malloc(sizeof(double) * iters);
+    if (!lat) return;
+    static const char *const lines[][2] = {
+        { "spawn", "/bin/echo hello" },
+        { "coproc call", "coproc call bc hello" },
+        { "coproc call -L", "coproc call bc -L hello" },
+    };
+    double p50[3], p99[3];
+    char start[] = "coproc bc /bin/cat", stop[] = "coproc close bc", wait_line[] = "wait";
+    int saved = mute_stdout();
+    execute_line(start);
+    for (int c = 0; c < 3; ++c) {
+        char line[64];
+        for (int i = 0; i < iters; ++i) {
+            snprintf(line, sizeof(line), "%s", lines[c][1]);
+            double t0 = now_sec();
+            execute_line(line);
+            lat[i] = now_sec() - t0;
+        }
+        qsort(lat, iters, sizeof(double), cmp_double);
+        p50[c] = lat[iters / 2];
+        p99[c] = lat[(iters * 99) / 100];
+    }
+    struct sigaction sa, old;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sigchld_handler;
+    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigaction(SIGCHLD, &sa, &old);
+    execute_line(stop);
+    execute_line(wait_line);
+    unmute_stdout(saved);
+    reap_done_jobs();
+    sigaction(SIGCHLD, &old, NULL);
+    for (int c = 0; c < 3; ++c) {
+        result_begin("coproc");
+        result_str("mode", lines[c][0]);
+        result_num("p50_us", p50[c] * 1e6);
+        result_num("p99_us", p99[c] * 1e6);
+        result_end();
+    }
+    free(lat);
+}
+
+/* A cpu-bound line filter as one process and sharded across the cpus, in
+ * order and not. */
+static void bench_shard(void) {
+    long mb = quick ? 16 : 64;
+    int rounds = quick ? 3 : 5;
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    int n = ncpu > 2 ? (int)(ncpu < SHARD_MAX ? ncpu : SHARD_MAX) : 2;
+    char path[] = "/tmp/cshell_bench_shard_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) { perror("mkstemp"); return; }
+    FILE *f = fdopen(fd, "w");
+    for (long i = 0; f && ftell(f) < mb << 20; ++i) fprintf(f, "%ld the quick brown fox jumps over the lazy dog %ld\n", i, i * 7919);
+    if (f) fclose(f);
+    const char *pipes[3] = { "|", NULL, NULL };
+    char ordered[8], unordered[8];
+    snprintf(ordered, sizeof(ordered), "|%d>", n);
+    snprintf(unordered, sizeof(unordered), "|%du>", n);
+    pipes[1] = ordered;
+    pipes[2] = unordered;
+    for (int c = 0; c < 3; ++c) {
+        double t[8];
+        for (int r = 0; r < rounds; ++r) {
+            char line[256];
+            snprintf(line, sizeof(line), "/bin/cat %s %s sed -E s/[aeiou]+/#/g > /dev/null", path, pipes[c]);
+            double t0 = now_sec();
+            execute_line(line);
+            t[r] = now_sec() - t0;
+        }
+        qsort(t, rounds, sizeof(double), cmp_double);
+        result_begin("shard");
+        result_str("pipe", pipes[c]);
+        result_int("cpus", ncpu);
+        result_int("mb", mb);
+        result_num("mb_per_sec", mb / t[rounds / 2]);
+        result_end();
+    }
+    unlink(path);
+}
+
+static long extent_count(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct fiemap fm;
+    memset(&fm, 0, sizeof(fm));
+    fm.fm_length = FIEMAP_MAX_OFFSET;
+    long n = fd >= 0 && ioctl(fd, FS_IOC_FIEMAP, &fm) == 0 ? (long)fm.fm_mapped_extents : -1;
+    if (fd >= 0) close(fd);
+    return n;
+}
+
+/* Flush path to disk and drop it from the page cache; returns the seconds the
+ * flush took. */
+static double flush_file(const char *path) {
+    double t0 = now_sec();
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return 0;
+    fdatasync(fd);
+    double dt = now_sec() - t0;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+    return dt;
+}
+
+/* Multi-GB output redirects, plain, preallocated and atomically replaced
+ * (timed to the data being on disk), then a cold-cache '<' read with and
+ * without the readahead hints. */
+static void bench_redirect(void) {
+    long mb = quick ? 256 : 2048;
+    char path[PATH_BUF];
+    const char *tmpdir = getenv("TMPDIR");
+    snprintf(path, sizeof(path), "%s/cshell_bench_redirect", tmpdir && *tmpdir ? tmpdir : "/tmp");
+    static const char *const writes[][2] = {
+        { ">", "%s head -c %ldM /dev/zero > %s" },
+        { "prealloc >", "prealloc %ldM head -c %ldM /dev/zero > %s" },
+        { ">!", "%s head -c %ldM /dev/zero >! %s" },
+    };
+    for (int w = 0; w < 3; ++w) {
+        char line[PATH_BUF + 128];
+        unlink(path);
+        if (w == 1) snprintf(line, sizeof(line), writes[w][1], mb, mb, path);
+        else snprintf(line, sizeof(line), writes[w][1], "", mb, path);
+        double t0 = now_sec();
+        execute_line(line);
+        double dt = now_sec() - t0;
+        dt += flush_file(path);
+        result_begin("redirect");
+        result_str("write", writes[w][0]);
+        result_int("mb", mb);
+        result_num("mb_per_sec", mb / dt);
+        result_int("extents", extent_count(path));
+        result_end();
+    }
+    for (int hints = 0; hints < 2; ++hints) {
+        char line[PATH_BUF + 64];
+        if (hints) unsetenv("CSHELL_READAHEAD_KB"); else setenv("CSHELL_READAHEAD_KB", "0", 1);
+        flush_file(path);
+        snprintf(line, sizeof(line), "cat < %s > /dev/null", path);
+        double t0 = now_sec();
+        execute_line(line);
+        double dt = now_sec() - t0;
+        result_begin("redirect");
+        result_str("read", hints ? "< with hints" : "< plain");
+        result_int("mb", mb);
+        result_num("mb_per_sec", mb / dt);
+        result_end();
+    }
+    unsetenv("CSHELL_READAHEAD_KB");
+    unlink(path);
+}
+
+static const struct { const char *name; void (*fn)(void); } benches[] = {
+    { "tokenize", bench_tokenize },
+    { "parse", bench_parse },
+    { "long_line", bench_long_lines },
+    { "glob", bench_glob },
+    { "spawn", bench_spawn },
+    { "pipeline", bench_pipeline },
+    { "vfs", bench_vfs },
+    { "vfs_grep", bench_vfs_grep },
+    { "vfs_path", bench_vfs_path },
+    { "vfs_snapshot", bench_vfs_snapshot },
+    { "vfs_threads", bench_vfs_threads },
+    { "footprint", bench_footprint },
+    { "server", bench_server },
+    { "rc", bench_rc },
+    { "subst", bench_subst },
+    { "prewarm", bench_prewarm },
+    { "pipe_meter", bench_pipe_meter },
+    { "deadline", bench_deadline },
+    { "capture", bench_capture },
+    { "coproc", bench_coproc },
+    { "shard", bench_shard },
+    { "redirect", bench_redirect },
+};
+#define NBENCHES (int)(sizeof(benches) / sizeof(benches[0]))
+
+int main(int argc, char **argv) {
+    const char *only[NBENCHES];
+    int nonly = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--quick") == 0) quick = 1;
+        else if (strcmp(argv[i], "--only") == 0 && i + 1 < argc && nonly < NBENCHES) only[nonly++] = argv[++i];
+        else { fprintf(stderr, "usage: %s [--quick] [--only NAME]...\n", argv[0]); return 2; }
+    }
+
+    printf("{\"bench\": \"cshell\", \"quick\": %s, \"results\": [", quick ? "true" : "false");
+    for (int b = 0; b < NBENCHES; ++b) {
+        int run = (nonly == 0);
+        for (int i = 0; i < nonly; ++i) if (strcmp(only[i], benches[b].name) == 0) run = 1;
+        if (!run) continue;
+        fprintf(stderr, "bench: %s\n", benches[b].name);
+        benches[b].fn();
+    }
+    printf("\n]}\n");
+    return 0;
+}
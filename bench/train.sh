@@ -0,0 +1,19 @@
+alias ll="ls -l"
+set CSHELL_TRAIN=1
+pwd
+ll /
+echo $CSHELL_TRAIN
+ls /usr/bin | grep -c a
+cat /etc/passwd | cut -d: -f1 | sort | head -n 3
+echo training > /dev/null
+echo more >> /dev/null
+sort < /etc/passwd | uniq | wc -l
+vfs create notes.txt
+vfs write notes.txt train the vfs paths too
+vfs cat notes.txt
+vfs ls
+vfs rm notes.txt
+history
+jobs
+alias
+exit
@@ -0,0 +1,295 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sched.h>
+
+#include "shell.h"
+
+/* CPU topology from /sys/devices/system/cpu and stage placement.
+ *
+ * A pipeline with placement on gets one physical core per stage (all of that
+ * core's hyperthreads), picked from the tightest domain that still has enough
+ * cores: a shared L2 first, then a shared LLC, then one NUMA node, and only
+ * then the whole machine. Adjacent stages hand data through a pipe, so keeping
+ * them under one cache keeps the pipe buffers hot. */
+
+typedef struct CpuTopo {
+    int online;
+    int core;       /* package << 16 | core_id */
+    int l2;         /* lowest cpu sharing the L2, -1 if unknown */
+    int llc;        /* lowest cpu sharing the last-level cache */
+    int node;
+} CpuTopo;
+
+static CpuTopo *topo = NULL;
+static int topo_ncpu = 0;
+static int topo_state = 0;      /* 0 = not loaded, 1 = loaded, -1 = unavailable */
+
+static int read_line(const char *path, char *buf, size_t len) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    ssize_t n = read(fd, buf, len - 1);
+    close(fd);
+    if (n <= 0) return -1;
+    buf[n] = '\0';
+    buf[strcspn(buf, "\n")] = '\0';
+    return 0;
+}
+
+static int read_int(const char *path, int def) {
+    char buf[32];
+    return read_line(path, buf, sizeof(buf)) == 0 ? atoi(buf) : def;
+}
+
+/* "0-3,8,10-11" -> set. Returns the number of cpus, or -1 on a syntax error. */
+int parse_cpulist(const char *s, cpu_set_t *set) {
+    CPU_ZERO(set);
+    int count = 0;
+    while (*s && *s != '\n') {
+        if (!isdigit((unsigned char)*s)) return -1;
+        char *end;
+        long lo = strtol(s, &end, 10), hi = lo;
+        if (*end == '-') {
+            if (!isdigit((unsigned char)end[1])) return -1;
+            hi = strtol(end + 1, &end, 10);
+        }
+        if (hi < lo || hi >= CPU_SETSIZE) return -1;
+        for (long c = lo; c <= hi; ++c) if (!CPU_ISSET(c, set)) { CPU_SET(c, set); ++count; }
+        s = end;
+        if (*s == ',') ++s;
+        else if (*s && *s != '\n') return -1;
+    }
+    return count;
+}
+
+static void format_cpulist(const cpu_set_t *set, char *buf, size_t len) {
+    size_t off = 0;
+    buf[0] = '\0';
+    for (int c = 0; c < CPU_SETSIZE && off < len; ++c) {
+        if (!CPU_ISSET(c, set)) continue;
+        int e = c;
+        while (e + 1 < CPU_SETSIZE && CPU_ISSET(e + 1, set)) ++e;
+        off += snprintf(buf + off, len - off, e > c ? "%s%d-%d" : "%s%d", off ? "," : "", c, e);
+        c = e;
+    }
+}
+
+/* Group id of a cache: the lowest cpu in its shared_cpu_list. */
+static int cache_group(const char *list) {
+    cpu_set_t set;
+    if (parse_cpulist(list, &set) <= 0) return -1;
+    for (int c = 0; c < CPU_SETSIZE; ++c) if (CPU_ISSET(c, &set)) return c;
+    return -1;
+}
+
+static int topology_load(void) {
+    if (topo_state) return topo_state > 0;
+    topo_state = -1;
+    char buf[PATH_BUF], path[128];
+    cpu_set_t online;
+    if (read_line("/sys/devices/system/cpu/online", buf, sizeof(buf)) != 0 || parse_cpulist(buf, &online) <= 0)
+        return 0;
+    for (int c = 0; c < CPU_SETSIZE; ++c) if (CPU_ISSET(c, &online)) topo_ncpu = c + 1;
+    topo = calloc(topo_ncpu, sizeof(CpuTopo));
+    if (!topo) return 0;
+
+    for (int c = 0; c < topo_ncpu; ++c) {
+        CpuTopo *t = &topo[c];
+        t->online = CPU_ISSET(c, &online);
+        t->l2 = t->llc = -1;
+        if (!t->online) continue;
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", c);
+        int pkg = read_int(path, 0);
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/core_id", c);
+        t->core = pkg << 16 | (read_int(path, c) & 0xffff);
+        int best_level = 0;
+        for (int i = 0; i < 16; ++i) {
+            snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index%d/type", c, i);
+            if (read_line(path, buf, sizeof(buf)) != 0) break;
+            if (strcmp(buf, "Instruction") == 0) continue;
+            snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index%d/level", c, i);
+            int level = read_int(path, 0);
+            snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index%d/shared_cpu_list", c, i);
+            if (read_line(path, buf, sizeof(buf)) != 0) continue;
+            int group = cache_group(buf);
+            if (level == 2) t->l2 = group;
+            if (level > best_level) { best_level = level; t->llc = group; }
+        }
+    }
+
+    DIR *d = opendir("/sys/devices/system/node");
+    if (d) {
+        struct dirent *e;
+        while ((e = readdir(d))) {
+            if (strncmp(e->d_name, "node", 4) != 0 || !isdigit((unsigned char)e->d_name[4])) continue;
+            cpu_set_t set;
+            snprintf(path, sizeof(path), "/sys/devices/system/node/%.16s/cpulist", e->d_name);
+            if (read_line(path, buf, sizeof(buf)) != 0 || parse_cpulist(buf, &set) < 0) continue;
+            for (int c = 0; c < topo_ncpu; ++c) if (CPU_ISSET(c, &set)) topo[c].node = atoi(e->d_name + 4);
+        }
+        closedir(d);
+    }
+    topo_state = 1;
+    return 1;
+}
+
+static int cmp_core(const void *a, const void *b) {
+    const CpuTopo *x = &topo[*(const int *)a], *y = &topo[*(const int *)b];
+    if (x->node != y->node) return x->node - y->node;
+    if (x->llc != y->llc) return x->llc - y->llc;
+    if (x->l2 != y->l2) return x->l2 - y->l2;
+    return x->core - y->core;
+}
+
+static int key_l2(int c) { return topo[c].l2; }
+static int key_llc(int c) { return topo[c].llc; }
+static int key_node(int c) { return topo[c].node; }
+
+/* Place n stages on distinct physical cores within allowed (NULL = the shell's
+ * own affinity). stage_sets[i] gets the chosen core's threads and, when
+ * stage_nodes is not NULL, stage_nodes[i] its NUMA node. With more stages than
+ * cores the cores are reused round-robin. Returns 0, -1 without topology, or
+ * -2 when allowed holds no online cpu. */
+int affinity_plan(int n, const cpu_set_t *allowed, cpu_set_t *stage_sets, int *stage_nodes) {
+    cpu_set_t mask;
+    if (!allowed) {
+        if (sched_getaffinity(0, sizeof(mask), &mask) != 0) return -1;
+        allowed = &mask;
+    }
+    if (n <= 0 || !topology_load()) return -1;
+
+    /* One representative (the lowest allowed thread) per physical core. */
+    int *cores = malloc(topo_ncpu * sizeof(int));
+    if (!cores) return -1;
+    int ncores = 0;
+    for (int c = 0; c < topo_ncpu; ++c) {
+        if (!topo[c].online || !CPU_ISSET(c, allowed)) continue;
+        int seen = 0;
+        for (int k = 0; k < ncores && !seen; ++k) seen = topo[cores[k]].core == topo[c].core;
+        if (!seen) cores[ncores++] = c;
+    }
+    if (!ncores) { free(cores); return -2; }
+    qsort(cores, ncores, sizeof(int), cmp_core);
+
+    /* Sorting by node, LLC, L2 makes every domain a contiguous run; take the
+     * first run of the tightest domain that fits all n stages. */
+    int start = 0;
+    if (n <= ncores) {
+        int (*keys[])(int) = { key_l2, key_llc, key_node };
+        int found = 0;
+        for (int k = 0; k < 3 && !found; ++k) {
+            for (int i = 0; i + n <= ncores && !found; ) {
+                int j = i;
+                while (j < ncores && keys[k](cores[j]) == keys[k](cores[i])) ++j;
+                if (keys[k](cores[i]) >= 0 && j - i >= n) { start = i; found = 1; }
+                i = j;
+            }
+        }
+    }
+
+    for (int s = 0; s < n; ++s) {
+        int rep = cores[(start + s) % ncores];
+        CPU_ZERO(&stage_sets[s]);
+        for (int c = 0; c < topo_ncpu; ++c) {
+            if (topo[c].online && topo[c].core == topo[rep].core && CPU_ISSET(c, allowed)) CPU_SET(c, &stage_sets[s]);
+        }
+        if (stage_nodes) stage_nodes[s] = topo[rep].node;
+    }
+    free(cores);
+    return 0;
+}
+
+/* Split a leading "pin [-m] [CPULIST]" off cmd. Returns 1 when a prefix was
+ * taken (cmd->args then starts at the real command), 0 when there is none and
+ * -1 on a usage error. */
+int pin_prefix(Command *cmd, JobOpts *jo) {
+    if (!cmd || !cmd->name || strcmp(cmd->name, "pin") != 0) return 0;
+    if (!cmd->args[1] || cmd->args[1][0] == '%') return 0;     /* the builtin forms */
+    int i = 1;
+    int bind = 0;
+    cpu_set_t allowed;
+    int have_list = 0;
+    if (strcmp(cmd->args[i], "-m") == 0) { bind = 1; ++i; }
+    if (cmd->args[i] && isdigit((unsigned char)cmd->args[i][0])) {
+        if (parse_cpulist(cmd->args[i], &allowed) <= 0) { printf("pin: bad cpu list '%s'\n", cmd->args[i]); return -1; }
+        have_list = 1;
+        ++i;
+    }
+    if (!cmd->args[i]) { printf("Usage: pin [-m] [CPULIST] command [| command ...]\n"); return -1; }
+    jo->place = 1;
+    jo->bind_mem = bind;
+    jo->have_cpus = have_list;
+    if (have_list) jo->cpus = allowed;
+    cmd->args += i;
+    cmd->argc -= i;
+    cmd->name = cmd->args[0];
+    return 1;
+}
+
+static void print_topology(void) {
+    if (!topology_load()) { printf("pin: cpu topology not available\n"); return; }
+    cpu_set_t mask;
+    char list[256];
+    if (sched_getaffinity(0, sizeof(mask), &mask) == 0) {
+        format_cpulist(&mask, list, sizeof(list));
+        printf("shell affinity: %s\n", list);
+    }
+    for (int c = 0; c < topo_ncpu; ++c) {
+        if (!topo[c].online) continue;
+        printf("cpu%-3d package %d core %d  l2 %d  llc %d  node %d\n", c,
+               topo[c].core >> 16, topo[c].core & 0xffff, topo[c].l2, topo[c].llc, topo[c].node);
+    }
+}
+
+/* Apply set to every thread of every process in the job's group. */
+static int pin_job(const Job *job, const cpu_set_t *set) {
+    pid_t *pids = NULL;
+    int n = pgrp_members(job->pgid, &pids), done = 0;
+    for (int i = 0; i < n; ++i) {
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/%d/task", (int)pids[i]);
+        DIR *d = opendir(path);
+        if (!d) continue;
+        struct dirent *e;
+        while ((e = readdir(d))) {
+            if (!isdigit((unsigned char)e->d_name[0])) continue;
+            if (sched_setaffinity((pid_t)atoi(e->d_name), sizeof(*set), set) == 0) ++done;
+        }
+        closedir(d);
+    }
+    free(pids);
+    return done;
+}
+
+static void show_job(const Job *job) {
+    pid_t *pids = NULL;
+    int n = pgrp_members(job->pgid, &pids);
+    for (int i = 0; i < n; ++i) {
+        cpu_set_t mask;
+        char list[256];
+        if (sched_getaffinity(pids[i], sizeof(mask), &mask) != 0) continue;
+        format_cpulist(&mask, list, sizeof(list));
+        printf("%d: %s\n", (int)pids[i], list);
+    }
+    free(pids);
+}
+
+/* pin                 print the cpu topology
+ * pin %N [CPULIST]    show or set the affinity of a running job
+ * (the "pin [-m] [CPULIST] pipeline" prefix is handled by execute_command) */
+int handle_pin(Command *cmd) {
+    if (!cmd || !cmd->name || strcmp(cmd->name, "pin") != 0) return 0;
+    if (!cmd->args[1]) { print_topology(); return 1; }
+    if (cmd->args[1][0] != '%') return 0;
+    Job *job = find_job(atoi(cmd->args[1] + 1));
+    if (!job) { printf("pin: no such job\n"); return 1; }
+    if (!cmd->args[2]) { show_job(job); return 1; }
+    cpu_set_t set;
+    if (parse_cpulist(cmd->args[2], &set) <= 0) { printf("pin: bad cpu list '%s'\n", cmd->args[2]); return 1; }
+    if (pin_job(job, &set) == 0) printf("pin: could not set affinity for job %d\n", job->job_id);
+    return 1;
+}
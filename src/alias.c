@@ -0,0 +1,39 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "shell.h"
+
+Alias *aliases = NULL;
+int alias_count = 0;
+static int alias_cap = 0;
+
+void add_alias(const char *name, const char *command) {
+    if (!name || !command) return;
+    for (int i = 0; i < alias_count; ++i) {
+        if (strcmp(aliases[i].name, name) == 0) {
+            char *copy = strdup(command);
+            if (!copy) return;
+            free(aliases[i].command);
+            aliases[i].command = copy;
+            return;
+        }
+    }
+    if (alias_count == alias_cap) {
+        int ncap = alias_cap ? alias_cap * 2 : 16;
+        Alias *tmp = realloc(aliases, ncap * sizeof(Alias));
+        if (!tmp) return;
+        aliases = tmp;
+        alias_cap = ncap;
+    }
+    char *n = strdup(name), *c = strdup(command);
+    if (!n || !c) { free(n); free(c); return; }
+    aliases[alias_count].name = n;
+    aliases[alias_count].command = c;
+    ++alias_count;
+}
+
+const char *check_alias(const char *name) {
+    if (!name) return NULL;
+    for (int i = 0; i < alias_count; ++i) if (strcmp(aliases[i].name, name) == 0) return aliases[i].command;
+    return rc_alias(name);
+}
@@ -0,0 +1,103 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <termios.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include "shell.h"
+
+int handle_builtin(Command *cmd) {
+    if (!cmd || !cmd->name) return 0;
+    if (handle_vfs(cmd)) return 1;
+    if (handle_schedule(cmd)) return 1;
+    if (handle_limit(cmd)) return 1;
+    if (handle_pin(cmd)) return 1;
+    if (handle_dag(cmd)) return 1;
+    if (handle_hash(cmd)) return 1;
+    if (handle_prewarm(cmd)) return 1;
+    if (handle_coproc(cmd)) return 1;
+
+    if (strcmp(cmd->name, "cd") == 0) {
+        char *dir = cmd->args[1] ? cmd->args[1] : getenv("HOME");
+        if (!dir) dir = "/";
+        if (chdir(dir) != 0) perror("cd");
+        return 1;
+    }
+    if (strcmp(cmd->name, "exit") == 0) exit(0);
+    if (strcmp(cmd->name, "pwd") == 0) {
+        char cwd[PATH_BUF];
+        if (getcwd(cwd, sizeof(cwd))) printf("%s\n", cwd); else perror("pwd");
+        return 1;
+    }
+    if (strcmp(cmd->name, "history") == 0) { print_history(); return 1; }
+    if (strcmp(cmd->name, "jobs") == 0) {
+        if (cmd->args[1] && strcmp(cmd->args[1], "output") == 0) return capture_show(cmd);
+        if (cmd->args[1] && strcmp(cmd->args[1], "-l") == 0) list_jobs_long();
+        else if (cmd->args[1] && strcmp(cmd->args[1], "-v") == 0) list_jobs_verbose();
+        else list_jobs();
+        return 1;
+    }
+    if (strcmp(cmd->name, "alias") == 0) {
+        if (cmd->args[1]) {
+            char *eq = strchr(cmd->args[1], '=');
+            if (eq) {
+                *eq = '\0';
+                char *val = eq + 1, *joined = NULL;
+                /* name="a b" arrives split at the blanks, since quotes only open a token at its start */
+                size_t vlen = strlen(val);
+                if (val[0] == '"' && (vlen < 2 || val[vlen-1] != '"') && cmd->args[2]) {
+                    size_t len = vlen;
+                    for (int i = 2; cmd->args[i]; ++i) len += strlen(cmd->args[i]) + 1;
+                    if ((joined = malloc(len + 1))) {
+                        strcpy(joined, val);
+                        for (int i = 2; cmd->args[i]; ++i) { strcat(joined, " "); strcat(joined, cmd->args[i]); }
+                        val = joined;
+                    }
+                }
+                if (val[0] == '"' && strlen(val) > 1 && val[strlen(val)-1] == '"') { val[strlen(val)-1] = '\0'; ++val; }
+                add_alias(cmd->args[1], val);
+                free(joined);
+            } else { printf("alias: bad format. Use alias name=\"command\"\n"); }
+        } else {
+            for (int i = 0; i < alias_count; ++i) printf("alias %s=\"%s\"\n", aliases[i].name, aliases[i].command);
+            rc_list_aliases();
+        }
+        return 1;
+    }
+    if (strncmp(cmd->name, "set", 3) == 0 && cmd->args[1]) {
+        char *eq = strchr(cmd->args[1], '=');
+        if (eq) { *eq = '\0'; setenv(cmd->args[1], eq+1, 1); }
+        return 1;
+    }
+    if (strcmp(cmd->name, "fg") == 0 || strcmp(cmd->name, "bg") == 0) {
+        if (!cmd->args[1]) { printf("%s: job id required (e.g. %%1)\n", cmd->name); return 1; }
+        int jid = atoi(cmd->args[1] + 1);
+        Job *job = find_job(jid);
+        if (!job) { printf("%s: no such job\n", cmd->name); return 1; }
+        int fg = strcmp(cmd->name, "fg") == 0;
+        sigset_t old;
+        if (fg) block_sigchld(&old);
+        kill(-job->pgid, SIGCONT);
+        job->state = RUNNING;
+        if (fg) {
+            if (job_control) tcsetpgrp(STDIN_FILENO, job->pgid);
+            int status = 0, st, done = 0;
+            pid_t w;
+            struct rusage ru;
+            while ((w = loop_wait_fg(job->pgid, &st, &ru, NULL)) > 0) {
+                if (WIFSTOPPED(st)) { job->state = STOPPED; break; }
+                job->cpu_us += rusage_cpu_us(&ru);
+                if (w == job->pid) { status = st; done = 1; }
+            }
+            if (job_control) tcsetpgrp(STDIN_FILENO, getpid());
+            if (done && job->state != STOPPED) { job->status = status; job->end_us = trace_now_us(); job->state = DONE; }
+            restore_sigmask(&old);
+            reap_done_jobs();
+        }
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,228 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+
+#include "shell.h"
+
+/* Output capture for background jobs (CSHELL_CAPTURE_BG=1). A job's stdout and
+ * stderr go to one pipe that the shell reads without blocking wherever it
+ * waits (the prompt, "wait", a foreground job), into a ring of
+ * CSHELL_CAPTURE_KB (default 64) per job, so the job never waits on whoever
+ * views it. Bytes pushed out of the ring go to an unlinked file in $TMPDIR, up
+ * to CSHELL_CAPTURE_SPILL_MB (default 16) per job, and past that are only
+ * counted. "jobs output %N [--follow]" shows what was kept; a finished job's
+ * output stays until its slot goes to a newer job. */
+
+#define CAPTURE_KB_DEFAULT 64
+#define CAPTURE_SPILL_MB_DEFAULT 16
+
+typedef struct Capture {
+    int job_id;
+    int fd;                     /* read end, -1 once the job's side is closed */
+    char *ring;
+    size_t cap, start, len;
+    int spill_fd;
+    long long spilled, dropped;
+    int follow;                 /* copy to stdout as it arrives */
+} Capture;
+
+static Capture caps[CAPTURE_MAX];
+static int cap_count = 0;
+
+static long long env_size(const char *name, long long dflt, long long unit) {
+    const char *s = getenv(name);
+    long long v = s && *s ? atoll(s) : dflt;
+    return (v >= 0 ? v : dflt) * unit;
+}
+
+int capture_enabled(void) {
+    const char *s = getenv("CSHELL_CAPTURE_BG");
+    return s && strcmp(s, "1") == 0;
+}
+
+/* Index of a finished capture to give up for a new one, or -1 when every
+ * slot still has a job writing to it. */
+static int victim(void) {
+    int v = -1;
+    for (int i = 0; i < cap_count; ++i) {
+        if (caps[i].fd < 0 && (v < 0 || caps[i].job_id < caps[v].job_id)) v = i;
+    }
+    return v;
+}
+
+/* Point the job's stdout and stderr at a new capture pipe. -1 when there is
+ * no pipe or no slot to keep it in: the job keeps the terminal. */
+int capture_begin(JobOpts *jo) {
+    int p[2];
+    if (cap_count == CAPTURE_MAX && victim() < 0) return -1;
+    if (pipe2(p, O_CLOEXEC) < 0) return -1;
+    jo->err_fd = fcntl(p[1], F_DUPFD_CLOEXEC, 0);
+    if (jo->err_fd < 0) { close(p[0]); close(p[1]); return -1; }
+    fcntl(p[0], F_SETFL, O_NONBLOCK);
+    jo->out_fd = p[1];
+    jo->output_fd = p[0];
+    return 0;
+}
+
+static void capture_free(Capture *c) {
+    if (c->fd >= 0) close(c->fd);
+    if (c->spill_fd >= 0) close(c->spill_fd);
+    free(c->ring);
+}
+
+/* Keep the output read from fd (non-blocking) for job_id. A full table gives
+ * up the oldest finished capture; one still being written is never closed
+ * under its job. -1, fd untouched, when nothing can go. */
+int capture_attach(int job_id, int fd) {
+    if (cap_count == CAPTURE_MAX) {
+        int v = victim();
+        if (v < 0) return -1;
+        capture_free(&caps[v]);
+        caps[v] = caps[--cap_count];
+    }
+    Capture *c = &caps[cap_count++];
+    memset(c, 0, sizeof(*c));
+    c->job_id = job_id;
+    c->fd = fd;
+    c->spill_fd = -1;
+    c->cap = (size_t)env_size("CSHELL_CAPTURE_KB", CAPTURE_KB_DEFAULT, 1024);
+    if (!c->cap) c->cap = 1;
+    return 0;
+}
+
+static Capture *find_capture(int job_id) {
+    for (int i = 0; i < cap_count; ++i) if (caps[i].job_id == job_id) return &caps[i];
+    return NULL;
+}
+
+static void spill(Capture *c, const char *p, size_t n) {
+    long long room = env_size("CSHELL_CAPTURE_SPILL_MB", CAPTURE_SPILL_MB_DEFAULT, 1 << 20) - c->spilled;
+    if (c->spill_fd < 0 && room > 0 && !c->dropped) {
+        const char *dir = getenv("TMPDIR");
+        c->spill_fd = open(dir && *dir ? dir : "/tmp", O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    }
+    size_t keep = c->spill_fd < 0 || room <= 0 ? 0 : (size_t)room < n ? (size_t)room : n;
+    ssize_t w = keep ? pwrite(c->spill_fd, p, keep, c->spilled) : 0;
+    if (w > 0) c->spilled += w;
+    c->dropped += (long long)n - (w > 0 ? w : 0);
+}
+
+/* Spill the oldest n bytes of the ring. */
+static void ring_evict(Capture *c, size_t n) {
+    size_t first = c->cap - c->start < n ? c->cap - c->start : n;
+    spill(c, c->ring + c->start, first);
+    if (n > first) spill(c, c->ring, n - first);
+    c->start = (c->start + n) % c->cap;
+    c->len -= n;
+}
+
+static void append(Capture *c, const char *p, size_t n) {
+    if (c->follow) fwrite(p, 1, n, stdout);
+    if (!c->ring && !(c->ring = malloc(c->cap))) { spill(c, p, n); return; }
+    if (n > c->cap) {
+        ring_evict(c, c->len);
+        spill(c, p, n - c->cap);
+        p += n - c->cap;
+        n = c->cap;
+    }
+    if (c->len + n > c->cap) ring_evict(c, c->len + n - c->cap);
+    size_t at = (c->start + c->len) % c->cap, first = c->cap - at < n ? c->cap - at : n;
+    memcpy(c->ring + at, p, first);
+    memcpy(c->ring, p + first, n - first);
+    c->len += n;
+}
+
+static void drain(Capture *c) {
+    static char buf[65536];
+    for (int i = 0; c->fd >= 0 && i < CAPTURE_READS; ++i) {
+        ssize_t n = read(c->fd, buf, sizeof(buf));
+        if (n > 0) { append(c, buf, (size_t)n); continue; }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && errno == EAGAIN) break;
+        close(c->fd);
+        c->fd = -1;
+    }
+}
+
+/* Captures still open, for a poll() alongside the caller's own fds. */
+int capture_open(void) {
+    int n = 0;
+    for (int i = 0; i < cap_count; ++i) n += caps[i].fd >= 0;
+    return n;
+}
+
+int capture_pollfds(struct pollfd *pfd) {
+    int n = 0;
+    for (int i = 0; i < cap_count; ++i) {
+        if (caps[i].fd >= 0) { pfd[n].fd = caps[i].fd; pfd[n].events = POLLIN; pfd[n].revents = 0; ++n; }
+    }
+    return n;
+}
+
+/* Read whatever the n entries from capture_pollfds() said is ready. */
+void capture_events(const struct pollfd *pfd, int n) {
+    for (int k = 0; k < n; ++k) {
+        if (!pfd[k].revents) continue;
+        for (int i = 0; i < cap_count; ++i) if (caps[i].fd == pfd[k].fd) { drain(&caps[i]); break; }
+    }
+}
+
+static void show(Capture *c) {
+    char buf[65536], last = '\n';
+    for (long long off = 0; off < c->spilled;) {
+        ssize_t n = pread(c->spill_fd, buf, sizeof(buf), off);
+        if (n <= 0) break;
+        fwrite(buf, 1, (size_t)n, stdout);
+        last = buf[n - 1];
+        off += n;
+    }
+    if (c->dropped) printf("%s[... %lld bytes not kept ...]\n", last == '\n' ? "" : "\n", c->dropped);
+    size_t first = c->cap - c->start < c->len ? c->cap - c->start : c->len;
+    if (c->len) {
+        fwrite(c->ring + c->start, 1, first, stdout);
+        fwrite(c->ring, 1, c->len - first, stdout);
+    }
+}
+
+/* Stream c's output until the job closes it or Ctrl-C. SIGCHLD is held off,
+ * so an interrupted poll can only mean the user. */
+static void follow(Capture *c) {
+    sigset_t old;
+    block_sigchld(&old);
+    c->follow = 1;
+    while (c->fd >= 0) {
+        struct pollfd pfd[CAPTURE_MAX + 1];
+        int n = capture_pollfds(pfd);
+        pfd[n].fd = deadline_fd();
+        pfd[n].events = POLLIN;
+        pfd[n].revents = 0;
+        fflush(stdout);
+        int r = poll(pfd, n + 1, meter_timeout());
+        if (r < 0) break;
+        if (r == 0) { meter_tick(); continue; }
+        capture_events(pfd, n);
+        if (pfd[n].revents) deadline_fire();
+    }
+    c->follow = 0;
+    fflush(stdout);
+    restore_sigmask(&old);
+}
+
+/* jobs output %N [--follow] */
+int capture_show(Command *cmd) {
+    const char *id = cmd->args[2];
+    if (!id || id[0] != '%' || (cmd->args[3] && (strcmp(cmd->args[3], "--follow") != 0 || cmd->args[4]))) {
+        printf("Usage: jobs output %%N [--follow]\n");
+        return 1;
+    }
+    Capture *c = find_capture(atoi(id + 1));
+    if (!c) { printf("jobs: no output kept for %s\n", id); return 1; }
+    drain(c);
+    show(c);
+    if (cmd->args[3]) follow(c);
+    return 1;
+}
@@ -0,0 +1,341 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "shell.h"
+
+/* Per-job cgroup v2 subtrees.
+ *
+ * On first use the shell creates <its cgroup>/cshell.<pid>/, moves itself into
+ * a shell/ leaf below it (a cgroup holding processes can't delegate
+ * controllers) and enables the cpu, memory, io and pids controllers; each job
+ * then gets its own job-<n>/ leaf next to shell/. Accounting files (cpu.stat,
+ * *.pressure) exist in every v2 cgroup, so usage still works when controllers
+ * can't be delegated; if the subtree can't be created at all, jobs run exactly
+ * as before. */
+
+static int cg_state = 0;            /* 0 = not probed, 1 = usable, -1 = unavailable */
+static int cg_root_fd = -1;         /* cshell.<pid>/ */
+static char cg_base_path[2 * PATH_BUF];  /* the shell's own cgroup */
+static char cg_root_path[2 * PATH_BUF + 32];
+static int cg_next_id = 1;
+static pid_t cg_owner;              /* children inherit atexit() too */
+static int cg_base_added, cg_root_added;  /* controllers we switched on */
+
+static const char *cg_controllers[] = { "cpu", "memory", "io", "pids" };
+
+static int read_small(int dirfd, const char *name, char *buf, size_t len) {
+    int fd = openat(dirfd, name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    ssize_t n = read(fd, buf, len - 1);
+    close(fd);
+    if (n < 0) return -1;
+    buf[n] = '\0';
+    return (int)n;
+}
+
+static int write_small(int dirfd, const char *name, const char *val) {
+    int fd = openat(dirfd, name, O_WRONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    ssize_t n = write(fd, val, strlen(val));
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return n < 0 ? -1 : 0;
+}
+
+static int has_word(const char *list, const char *word) {
+    size_t wl = strlen(word);
+    for (const char *p = list; (p = strstr(p, word)); p += wl) {
+        if ((p == list || p[-1] == ' ') && (p[wl] == ' ' || p[wl] == '\n' || p[wl] == '\0')) return 1;
+    }
+    return 0;
+}
+
+/* Delegate every controller the parent offers, reporting any it refuses.
+ * Returns a mask (bit i = cg_controllers[i]) of the ones this switched on. */
+static int enable_controllers(int parent_fd, const char *where) {
+    char avail[256], on[256] = "";
+    int added = 0;
+    if (read_small(parent_fd, "cgroup.controllers", avail, sizeof(avail)) < 0) return 0;
+    if (read_small(parent_fd, "cgroup.subtree_control", on, sizeof(on)) < 0) on[0] = '\0';
+    for (size_t i = 0; i < sizeof(cg_controllers) / sizeof(cg_controllers[0]); ++i) {
+        char op[16];
+        if (!has_word(avail, cg_controllers[i]) || has_word(on, cg_controllers[i])) continue;
+        snprintf(op, sizeof(op), "+%s", cg_controllers[i]);
+        if (write_small(parent_fd, "cgroup.subtree_control", op) == 0) added |= 1 << i;
+        else fprintf(stderr, "cgroup: could not enable %s in %s: %s\n", cg_controllers[i], where, strerror(errno));
+    }
+    return added;
+}
+
+static void disable_controllers(int parent_fd, int mask) {
+    for (size_t i = 0; i < sizeof(cg_controllers) / sizeof(cg_controllers[0]); ++i) {
+        char op[16];
+        if (!(mask & 1 << i)) continue;
+        snprintf(op, sizeof(op), "-%s", cg_controllers[i]);
+        if (write_small(parent_fd, "cgroup.subtree_control", op) != 0) { /* best effort */ }
+    }
+}
+
+/* Move every process in cshell.<pid>/<from> into the cgroup.procs open as
+ * to_fd, so <from> can be removed. */
+static void evacuate(const char *from, int to_fd) {
+    char name[300], pids[4096];
+    snprintf(name, sizeof(name), "%s/cgroup.procs", from);
+    if (read_small(cg_root_fd, name, pids, sizeof(pids)) <= 0) return;
+    for (char *tok = strtok(pids, "\n"); tok; tok = strtok(NULL, "\n"))
+        cgroup_attach_fd(to_fd, (pid_t)atoi(tok));
+}
+
+/* Undo cgroup_available: surviving job processes go to the shell/ leaf while
+ * the job cgroups are removed, then the controllers we enabled are switched
+ * back off (the base cgroup can't take processes while they're on) and
+ * everything in shell/ returns to the base cgroup. */
+static void cgroup_shutdown(void) {
+    if (cg_root_fd < 0 || getpid() != cg_owner) return;
+    int shell_fd = openat(cg_root_fd, "shell/cgroup.procs", O_WRONLY | O_CLOEXEC);
+    DIR *d = fdopendir(dup(cg_root_fd));
+    if (d) {
+        struct dirent *e;
+        while ((e = readdir(d))) {
+            if (strncmp(e->d_name, "job-", 4) != 0) continue;
+            if (unlinkat(cg_root_fd, e->d_name, AT_REMOVEDIR) != 0 && errno == EBUSY && shell_fd >= 0) {
+                evacuate(e->d_name, shell_fd);
+                unlinkat(cg_root_fd, e->d_name, AT_REMOVEDIR);
+            }
+        }
+        closedir(d);
+    }
+    if (shell_fd >= 0) close(shell_fd);
+    disable_controllers(cg_root_fd, cg_root_added);
+    int base_fd = open(cg_base_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (base_fd >= 0) {
+        disable_controllers(base_fd, cg_base_added);
+        int procs = openat(base_fd, "cgroup.procs", O_WRONLY | O_CLOEXEC);
+        if (procs >= 0) { evacuate("shell", procs); close(procs); }
+        close(base_fd);
+    }
+    unlinkat(cg_root_fd, "shell", AT_REMOVEDIR);
+    close(cg_root_fd);
+    cg_root_fd = -1;
+    rmdir(cg_root_path);
+}
+
+int cgroup_available(void) {
+    if (cg_state) return cg_state > 0;
+    cg_state = -1;
+
+    char mnt[PATH_BUF] = "", rel[PATH_BUF] = "", line[PATH_BUF];
+    FILE *f = fopen("/proc/self/mounts", "re");
+    if (!f) return 0;
+    while (fgets(line, sizeof(line), f)) {
+        char dev[64], dir[PATH_BUF], type[32];
+        if (sscanf(line, "%63s %1023s %31s", dev, dir, type) == 3 && strcmp(type, "cgroup2") == 0) {
+            snprintf(mnt, sizeof(mnt), "%s", dir);
+            break;
+        }
+    }
+    fclose(f);
+    if (!mnt[0] || !(f = fopen("/proc/self/cgroup", "re"))) return 0;
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, "0::", 3) == 0) {
+            line[strcspn(line, "\n")] = '\0';
+            snprintf(rel, sizeof(rel), "%s", line + 3);
+            break;
+        }
+    }
+    fclose(f);
+    if (!rel[0]) return 0;
+
+    snprintf(cg_base_path, sizeof(cg_base_path), "%s%s", mnt, strcmp(rel, "/") == 0 ? "" : rel);
+    snprintf(cg_root_path, sizeof(cg_root_path), "%s/cshell.%d", cg_base_path, (int)getpid());
+    if (mkdir(cg_root_path, 0755) != 0 && errno != EEXIST) return 0;
+    cg_root_fd = open(cg_root_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (cg_root_fd < 0) { rmdir(cg_root_path); return 0; }
+
+    cg_owner = getpid();
+    atexit(cgroup_shutdown);
+
+    /* No internal processes: the shell has to leave its cgroup before that
+     * cgroup can hand controllers down to ours. */
+    char pid[24];
+    snprintf(pid, sizeof(pid), "%d", (int)cg_owner);
+    if ((mkdirat(cg_root_fd, "shell", 0755) != 0 && errno != EEXIST)
+        || write_small(cg_root_fd, "shell/cgroup.procs", pid) != 0)
+        fprintf(stderr, "cgroup: could not move the shell out of %s: %s\n", cg_base_path, strerror(errno));
+    int base_fd = open(cg_base_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (base_fd >= 0) { cg_base_added = enable_controllers(base_fd, cg_base_path); close(base_fd); }
+    cg_root_added = enable_controllers(cg_root_fd, cg_root_path);
+    cg_state = 1;
+    return 1;
+}
+
+/* Jobs only get cgroups when asked for with CSHELL_CGROUPS=1. */
+int cgroup_jobs_enabled(void) {
+    const char *v = getenv("CSHELL_CGROUPS");
+    return v && strcmp(v, "1") == 0 && cgroup_available();
+}
+
+int cgroup_create_job(void) {
+    if (!cgroup_available()) return 0;
+    char name[32];
+    int id = cg_next_id++;
+    snprintf(name, sizeof(name), "job-%d", id);
+    if (mkdirat(cg_root_fd, name, 0755) != 0) return 0;
+    return id;
+}
+
+int cgroup_procs_fd(int id) {
+    char name[64];
+    if (id <= 0 || cg_root_fd < 0) return -1;
+    snprintf(name, sizeof(name), "job-%d/cgroup.procs", id);
+    return openat(cg_root_fd, name, O_WRONLY | O_CLOEXEC);
+}
+
+int cgroup_attach_fd(int procs_fd, pid_t pid) {
+    char buf[24];
+    int n = snprintf(buf, sizeof(buf), "%d", (int)pid);
+    return write(procs_fd, buf, (size_t)n) == n ? 0 : -1;
+}
+
+/* Move every process in group pgid into job cgroup id. */
+static int cgroup_attach_pgrp(int id, pid_t pgid) {
+    int fd = cgroup_procs_fd(id);
+    if (fd < 0) return -1;
+    pid_t *pids = NULL;
+    int n = pgrp_members(pgid, &pids), moved = 0;
+    for (int i = 0; i < n; ++i) if (cgroup_attach_fd(fd, pids[i]) == 0) ++moved;
+    free(pids);
+    close(fd);
+    return moved;
+}
+
+void cgroup_release(int id) {
+    char name[32];
+    if (id <= 0 || cg_root_fd < 0) return;
+    snprintf(name, sizeof(name), "job-%d", id);
+    unlinkat(cg_root_fd, name, AT_REMOVEDIR);       /* EBUSY while stragglers live */
+}
+
+static double read_psi_avg10(int id, const char *file) {
+    char name[64], buf[256];
+    snprintf(name, sizeof(name), "job-%d/%s", id, file);
+    if (read_small(cg_root_fd, name, buf, sizeof(buf)) < 0) return -1;
+    const char *p = strstr(buf, "some avg10=");
+    return p ? atof(p + 11) : -1;
+}
+
+int cgroup_usage(int id, CgroupUsage *u) {
+    char name[64], buf[512];
+    u->cpu_usec = u->mem_bytes = -1;
+    u->cpu_psi = u->mem_psi = u->io_psi = -1;
+    if (id <= 0 || cg_root_fd < 0) return -1;
+    snprintf(name, sizeof(name), "job-%d/cpu.stat", id);
+    if (read_small(cg_root_fd, name, buf, sizeof(buf)) >= 0) {
+        const char *p = strstr(buf, "usage_usec ");
+        if (p) u->cpu_usec = atoll(p + 11);
+    }
+    snprintf(name, sizeof(name), "job-%d/memory.current", id);
+    if (read_small(cg_root_fd, name, buf, sizeof(buf)) >= 0) u->mem_bytes = atoll(buf);
+    u->cpu_psi = read_psi_avg10(id, "cpu.pressure");
+    u->mem_psi = read_psi_avg10(id, "memory.pressure");
+    u->io_psi = read_psi_avg10(id, "io.pressure");
+    return 0;
+}
+
+/* Bytes in "1.5G", "512m", "100kB", "4096": a k/m/g/t suffix in either case
+ * (powers of 1024), then an optional b or B. "max" -> -2; -1 on a syntax error. */
+long long parse_size(const char *s) {
+    if (strcmp(s, "max") == 0) return -2;
+    char *end;
+    double v = strtod(s, &end);
+    if (end == s || v < 0) return -1;
+    switch (*end) {
+    case 'k': case 'K': v *= 1024.0; ++end; break;
+    case 'm': case 'M': v *= 1024.0 * 1024; ++end; break;
+    case 'g': case 'G': v *= 1024.0 * 1024 * 1024; ++end; break;
+    case 't': case 'T': v *= 1024.0 * 1024 * 1024 * 1024; ++end; break;
+    }
+    if (*end == 'b' || *end == 'B') ++end;
+    return *end ? -1 : (long long)v;
+}
+
+static int apply_limit(int id, const char *key, const char *val) {
+    char file[64], buf[64];
+    const char *ctl;
+    if (strcmp(key, "cpu") == 0) {
+        ctl = "cpu.max";
+        if (strcmp(val, "max") == 0) snprintf(buf, sizeof(buf), "max 100000");
+        else {
+            char *end;
+            double pct = strtod(val, &end);
+            if (end == val || (*end && strcmp(end, "%") != 0) || pct <= 0) { printf("limit: bad cpu value '%s' (e.g. cpu=50%%)\n", val); return -1; }
+            snprintf(buf, sizeof(buf), "%lld 100000", (long long)(pct * 1000));
+        }
+    } else if (strcmp(key, "mem") == 0 || strcmp(key, "io") == 0 || strcmp(key, "pids") == 0) {
+        if (strcmp(key, "mem") == 0) ctl = "memory.max";
+        else if (strcmp(key, "pids") == 0) ctl = "pids.max";
+        else { printf("limit: io limits need a device (not supported)\n"); return -1; }
+        long long bytes = parse_size(val);
+        if (bytes == -1) { printf("limit: bad %s value '%s'\n", key, val); return -1; }
+        if (bytes == -2) snprintf(buf, sizeof(buf), "max");
+        else snprintf(buf, sizeof(buf), "%lld", bytes);
+    } else {
+        printf("limit: unknown resource '%s' (cpu, mem, pids)\n", key);
+        return -1;
+    }
+    snprintf(file, sizeof(file), "job-%d/%s", id, ctl);
+    if (write_small(cg_root_fd, file, buf) != 0) {
+        if (errno == ENOENT) printf("limit: %s controller not delegated to this shell\n", key);
+        else printf("limit: %s: %s\n", ctl, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/* limit %N key=value...: cgroup limits (cpu=50%, mem, pids) and deadlines
+ * (wall=5m, cpu=60s, grace; see deadline.c). A cgroup is only made for the
+ * former. */
+int handle_limit(Command *cmd) {
+    if (!cmd || !cmd->name) return 0;
+    if (strcmp(cmd->name, "limit") != 0) return 0;
+    if (!cmd->args[1] || cmd->args[1][0] != '%' || !cmd->args[2]) {
+        printf("Usage: limit %%N cpu=50%% mem=2G pids=100 wall=5m cpu=60s grace=5s\n");
+        return 1;
+    }
+    Job *job = find_job(atoi(cmd->args[1] + 1));
+    if (!job) { printf("limit: no such job\n"); return 1; }
+    int cgroup_keys = 0;
+    for (int i = 2; cmd->args[i]; ++i) {
+        char *eq = strchr(cmd->args[i], '=');
+        if (!eq) { printf("limit: expected key=value, got '%s'\n", cmd->args[i]); continue; }
+        *eq = '\0';
+        if (!deadline_limit(job, cmd->args[i], eq + 1)) ++cgroup_keys;
+        *eq = '=';
+    }
+    if (!cgroup_keys) return 1;
+    if (!cgroup_available()) { printf("limit: cgroup v2 delegation not available\n"); return 1; }
+    if (!job->cgroup_id) {
+        int id = cgroup_create_job();
+        if (!id || cgroup_attach_pgrp(id, job->pgid) <= 0) {
+            printf("limit: could not move job into a cgroup\n");
+            cgroup_release(id);
+            return 1;
+        }
+        job->cgroup_id = id;
+    }
+    for (int i = 2; cmd->args[i]; ++i) {
+        char *eq = strchr(cmd->args[i], '=');
+        if (!eq) continue;
+        *eq = '\0';
+        if (!deadline_key(cmd->args[i], eq + 1)) apply_limit(job->cgroup_id, cmd->args[i], eq + 1);
+        *eq = '=';
+    }
+    return 1;
+}
@@ -0,0 +1,279 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+
+#include "shell.h"
+
+/* Coprocesses: "coproc NAME cmd" starts cmd once, as a job, with its stdin and
+ * stdout on a socketpair the shell keeps, so a filter used over and over
+ * (jq -c --unbuffered, awk with fflush(), a line-buffered daemon) pays its
+ * startup once rather than per call. A socket rather than two pipes: one fd,
+ * MSG_NOSIGNAL instead of SIGPIPE when the coproc has died, and shutdown()
+ * gives it EOF while its last output can still be read.
+ *
+ *   coproc                          list
+ *   coproc NAME command [args]      start
+ *   coproc send NAME [-n] text      write text and a newline (-n: no newline)
+ *   coproc read NAME [-t T] [N]     print the next N lines (default 1)
+ *   coproc call NAME [-t T] [-l N] text
+ *                                   send a line, print an N-line reply
+ *   coproc call NAME [-t T] -L text length-framed: send "LEN\ntext", print the
+ *                                   LEN bytes of a "LEN\n..." reply
+ *   coproc close NAME               EOF to its stdin; forget it once drained
+ *
+ * Waits give up after -t (a duration), at EOF, or on Ctrl-C. What a reply
+ * overshoots is kept for the next read. */
+
+#define MAX_COPROCS 16
+
+typedef struct Coproc {
+    char name[32];
+    int job_id;
+    int fd;                     /* the shell's end, -1 when free */
+    int closed;                 /* our side shut down */
+    char *buf;                  /* read, not yet printed */
+    size_t len, cap;
+} Coproc;
+
+static Coproc coprocs[MAX_COPROCS];
+
+static const char *const verbs[] = { "send", "read", "call", "close", NULL };
+
+static Coproc *find_coproc(const char *name) {
+    for (int i = 0; i < MAX_COPROCS; ++i) {
+        if (coprocs[i].fd >= 0 && strcmp(coprocs[i].name, name) == 0) return &coprocs[i];
+    }
+    return NULL;
+}
+
+static void coproc_free(Coproc *co) {
+    if (co->fd >= 0) close(co->fd);
+    free(co->buf);
+    memset(co, 0, sizeof(*co));
+    co->fd = -1;
+}
+
+static int start(Command *cmd) {
+    const char *name = cmd->args[1];
+    if (strlen(name) >= sizeof(coprocs[0].name)) { printf("coproc: name too long\n"); return 1; }
+    for (int i = 0; verbs[i]; ++i) if (strcmp(name, verbs[i]) == 0) { printf("coproc: '%s' can't be a name\n", name); return 1; }
+    Coproc *co = find_coproc(name);
+    if (co && lookup_job(co->job_id)) { printf("coproc: %s is already running\n", name); return 1; }
+    for (int i = 0; i < MAX_COPROCS && !co; ++i) if (coprocs[i].fd < 0) co = &coprocs[i];
+    if (!co) { printf("coproc: too many coprocesses\n"); return 1; }
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0) { perror("coproc"); return 1; }
+
+    char line[MAX_LINE];
+    int off = snprintf(line, sizeof(line), "coproc %s:", name);
+    for (int i = 2; cmd->args[i] && off < (int)sizeof(line); ++i) off += snprintf(line + off, sizeof(line) - off, " %s", cmd->args[i]);
+    char **args = cmd->args;
+    cmd->args += 2;
+    cmd->argc -= 2;
+    cmd->name = cmd->args[0];
+    LaunchOpts lo = { -1, NULL, -1, -1, 0 };
+    sigset_t old;
+    block_sigchld(&old);
+    pid_t pid = launch_command(cmd, 0, sv[1], sv[1], shell_launcher, &lo);
+    Job *job = NULL;
+    if (pid > 0) {
+        setpgid(pid, pid);
+        job = add_job(pid, line, RUNNING);
+    }
+    restore_sigmask(&old);
+    cmd->args = args;
+    cmd->argc += 2;
+    cmd->name = args[0];
+    close(sv[1]);
+    if (pid <= 0 || !job) {
+        if (pid > 0) kill(pid, SIGTERM);
+        close(sv[0]);
+        printf("coproc: could not start %s\n", name);
+        return 1;
+    }
+    if (co->fd >= 0) coproc_free(co);
+    snprintf(co->name, sizeof(co->name), "%s", name);
+    co->job_id = job->job_id;
+    co->fd = sv[0];
+    printf("[%d] %d\n", job->job_id, (int)pid);
+    return 1;
+}
+
+static int send_all(Coproc *co, const char *p, size_t n) {
+    while (n) {
+        ssize_t w = send(co->fd, p, n, MSG_NOSIGNAL);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) { printf("coproc: %s: %s\n", co->name, strerror(errno)); return -1; }
+        p += w;
+        n -= (size_t)w;
+    }
+    return 0;
+}
+
+/* Read more of the coproc's output into co->buf. 1 when some arrived, 0 at
+ * EOF, -1 on timeout or Ctrl-C (SIGCHLD is held off by the caller, so an
+ * interrupted poll is the user). */
+static int fill(Coproc *co, long long deadline_us) {
+    if (co->len == co->cap) {
+        size_t ncap = co->cap ? co->cap * 2 : 4096;
+        char *tmp = realloc(co->buf, ncap);
+        if (!tmp) return -1;
+        co->buf = tmp;
+        co->cap = ncap;
+    }
+    struct pollfd pfd = { co->fd, POLLIN, 0 };
+    int ms = -1;
+    if (deadline_us) {
+        long long left = deadline_us - trace_now_us();
+        if (left <= 0) return -1;
+        ms = (int)((left + 999) / 1000);
+    }
+    int r = poll(&pfd, 1, ms);
+    if (r <= 0) return -1;
+    ssize_t n = recv(co->fd, co->buf + co->len, co->cap - co->len, 0);
+    if (n < 0) return errno == EINTR || errno == EAGAIN ? 1 : 0;
+    co->len += (size_t)n;
+    return n > 0;
+}
+
+static void consume(Coproc *co, size_t n) {
+    fwrite(co->buf, 1, n, stdout);
+    memmove(co->buf, co->buf + n, co->len - n);
+    co->len -= n;
+}
+
+/* Print the next lines lines; what came before EOF if it came first. */
+static int read_lines(Coproc *co, int lines, long long deadline_us) {
+    size_t scan = 0;
+    int seen = 0, r = 1;
+    for (;;) {
+        for (; scan < co->len && seen < lines; ++scan) if (co->buf[scan] == '\n') ++seen;
+        if (seen == lines) { consume(co, scan); return 0; }
+        if ((r = fill(co, deadline_us)) <= 0) break;
+    }
+    if (r == 0) consume(co, co->len);
+    else printf("coproc: %s: no reply\n", co->name);
+    return -1;
+}
+
+/* A "LEN\n" header and then LEN bytes. */
+static int read_framed(Coproc *co, long long deadline_us) {
+    char *nl;
+    while (!(nl = memchr(co->buf, '\n', co->len))) {
+        if (co->len > 32 || fill(co, deadline_us) <= 0) { printf("coproc: %s: no reply\n", co->name); return -1; }
+    }
+    char *end;
+    long long n = strtoll(co->buf, &end, 10);
+    if (end != nl || n < 0) { printf("coproc: %s: bad length header\n", co->name); return -1; }
+    size_t head = (size_t)(nl - co->buf) + 1;
+    while (co->len < head + (size_t)n) {
+        if (fill(co, deadline_us) <= 0) { printf("coproc: %s: short reply\n", co->name); return -1; }
+    }
+    memmove(co->buf, co->buf + head, co->len - head);
+    co->len -= head;
+    consume(co, (size_t)n);
+    return 0;
+}
+
+/* The words of args joined by blanks, in a malloc'd string with room to
+ * spare. */
+static char *join(char **args, size_t spare) {
+    size_t len = 1 + spare;
+    for (int i = 0; args[i]; ++i) len += strlen(args[i]) + 1;
+    char *s = malloc(len), *p = s;
+    if (!s) return NULL;
+    *p = '\0';
+    for (int i = 0; args[i]; ++i) p += sprintf(p, "%s%s", i ? " " : "", args[i]);
+    return s;
+}
+
+static void list(void) {
+    for (int i = 0; i < MAX_COPROCS; ++i) {
+        const Coproc *co = &coprocs[i];
+        if (co->fd < 0) continue;
+        Job *job = lookup_job(co->job_id);
+        printf("%-12s [%d] %s%s\n", co->name, co->job_id, job ? "running" : "exited",
+               co->closed ? ", input closed" : "");
+    }
+}
+
+static void usage(void) {
+    printf("Usage: coproc NAME command | coproc send|read|call|close NAME ... (see coproc.c)\n");
+}
+
+int handle_coproc(Command *cmd) {
+    if (!cmd || !cmd->name || strcmp(cmd->name, "coproc") != 0) return 0;
+    static int init = 0;
+    if (!init) { for (int i = 0; i < MAX_COPROCS; ++i) coprocs[i].fd = -1; init = 1; }
+    const char *verb = cmd->args[1];
+    if (!verb) { list(); return 1; }
+    int v = 0;
+    while (verbs[v] && strcmp(verbs[v], verb) != 0) ++v;
+    if (!verbs[v]) {
+        if (!cmd->args[2]) { usage(); return 1; }
+        return start(cmd);
+    }
+    if (!cmd->args[2]) { usage(); return 1; }
+    Coproc *co = find_coproc(cmd->args[2]);
+    if (!co) { printf("coproc: no coprocess %s\n", cmd->args[2]); return 1; }
+    last_status = 1;
+
+    int i = 3, lines = 1, framed = 0, newline = 1;
+    long long deadline_us = 0;
+    for (; cmd->args[i] && cmd->args[i][0] == '-'; ++i) {
+        const char *o = cmd->args[i];
+        if (strcmp(o, "-n") == 0) newline = 0;
+        else if (strcmp(o, "-L") == 0) framed = 1;
+        else if ((strcmp(o, "-t") == 0 || strcmp(o, "-l") == 0) && cmd->args[i + 1]) {
+            if (o[1] == 'l') lines = atoi(cmd->args[++i]);
+            else {
+                long long us = parse_duration(cmd->args[++i]);
+                if (us <= 0) { printf("coproc: bad timeout '%s'\n", cmd->args[i]); return 1; }
+                deadline_us = trace_now_us() + us;
+            }
+        } else break;
+    }
+    if (lines < 1) lines = 1;
+
+    if (v == 3) {                       /* close */
+        if (!co->closed) shutdown(co->fd, SHUT_WR);
+        co->closed = 1;
+        if (!lookup_job(co->job_id)) coproc_free(co);
+        last_status = 0;
+        return 1;
+    }
+    if (v == 1) {                       /* read */
+        if (cmd->args[i]) lines = atoi(cmd->args[i]) > 0 ? atoi(cmd->args[i]) : 1;
+    } else {                            /* send, call */
+        if (co->closed) { printf("coproc: %s: input is closed\n", co->name); return 1; }
+        char *text = join(cmd->args + i, 32);
+        if (!text) return 1;
+        size_t n = strlen(text);
+        if (framed) {                   /* the header goes in front, in one send */
+            char head[32];
+            int h = snprintf(head, sizeof(head), "%zu\n", n);
+            memmove(text + h, text, n);
+            memcpy(text, head, (size_t)h);
+            n += (size_t)h;
+        } else if (newline) {
+            text[n++] = '\n';
+        }
+        int rc = send_all(co, text, n);
+        free(text);
+        if (rc != 0) return 1;
+        if (v == 0) { last_status = 0; return 1; }
+    }
+    sigset_t old;
+    block_sigchld(&old);
+    int rc = framed ? read_framed(co, deadline_us) : read_lines(co, lines, deadline_us);
+    restore_sigmask(&old);
+    fflush(stdout);
+    last_status = rc == 0 ? 0 : 1;
+    return 1;
+}
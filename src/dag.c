@@ -0,0 +1,444 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "shell.h"
+
+/* Job dependencies.
+ *
+ *   after %1 %2 -- cmd     queue cmd to start once jobs 1 and 2 exit with 0
+ *   dag FILE               queue every "name: dep dep -- cmd" line of FILE
+ *   wait [-n] [%N ...]     wait for jobs (or, with -n, the next one) to end
+ *
+ * A queued command is a PENDING entry in the job table, so it has a job id
+ * other nodes can depend on from the moment it is declared. Whenever a job ends
+ * the event loop calls dag_schedule(), which drops nodes whose dependencies
+ * failed and starts ready ones, up to CSHELL_DAG_JOBS at a time (default: one
+ * per online cpu). Ready nodes go longest-remaining-path first, estimated from
+ * how long the same command took on earlier runs. */
+
+typedef struct DagNode {
+    int job_id;
+    char *line;             /* command text, parsed when it starts */
+    int ndeps;
+    int *deps;
+    int *dep_status;        /* each dep's wait status once it has ended, else DEP_PENDING */
+    double rank;            /* critical-path length from here, in seconds */
+} DagNode;
+
+typedef struct ExitRecord { int job_id; int status; } ExitRecord;     /* status -1: skipped */
+typedef struct Running { int job_id; double started; const char *command; } Running;
+typedef struct Estimate { const char *command; double seconds; } Estimate;
+
+#define DAG_ESTIMATES 256
+#define DAG_EXITS 256           /* recent exits kept for "wait" and for "after" an ended job */
+#define DEP_PENDING (-2)
+#define DAG_DEFAULT_COST 1.0
+
+static DagNode *nodes = NULL;
+static int node_count = 0, node_cap = 0;
+static ExitRecord exits[DAG_EXITS];    /* a ring: record i is exits[i % DAG_EXITS] */
+static long exit_count = 0;             /* ever recorded */
+static Running *running = NULL;
+static int running_count = 0, running_cap = 0;
+static Estimate estimates[DAG_ESTIMATES];
+static int estimate_count = 0;
+static int scheduling = 0;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int grow(void **v, int *cap, int need, size_t size) {
+    if (need <= *cap) return 0;
+    int n = *cap ? *cap * 2 : 16;
+    while (n < need) n *= 2;
+    void *tmp = realloc(*v, n * size);
+    if (!tmp) return -1;
+    *v = tmp;
+    *cap = n;
+    return 0;
+}
+
+/* The first record from mark on that is still in the ring. */
+static long oldest_since(long mark) { return mark > exit_count - DAG_EXITS ? mark : exit_count - DAG_EXITS; }
+
+static const ExitRecord *find_exit(int job_id) {
+    for (long i = exit_count - 1; i >= oldest_since(0); --i) if (exits[i % DAG_EXITS].job_id == job_id) return &exits[i % DAG_EXITS];
+    return NULL;
+}
+
+/* Pending nodes keep their dependencies' statuses themselves, so the ring can
+ * forget an exit however long they go on waiting. */
+static void record_exit(int job_id, int status) {
+    exits[exit_count % DAG_EXITS].job_id = job_id;
+    exits[exit_count % DAG_EXITS].status = status;
+    ++exit_count;
+    for (int i = 0; i < node_count; ++i) {
+        for (int d = 0; d < nodes[i].ndeps; ++d) if (nodes[i].deps[d] == job_id) nodes[i].dep_status[d] = status;
+    }
+}
+
+static double estimate_for(const char *command) {
+    for (int i = 0; i < estimate_count; ++i) if (estimates[i].command == command) return estimates[i].seconds;
+    return DAG_DEFAULT_COST;
+}
+
+/* Exponential moving average, so one slow run doesn't dominate. Commands are
+ * interned, so they compare by pointer. */
+static void update_estimate(const char *command, double seconds) {
+    for (int i = 0; i < estimate_count; ++i) {
+        if (estimates[i].command == command) { estimates[i].seconds = 0.7 * estimates[i].seconds + 0.3 * seconds; return; }
+    }
+    if (estimate_count == DAG_ESTIMATES) { strpool_release(estimates[0].command); memmove(estimates, estimates + 1, --estimate_count * sizeof(Estimate)); }
+    estimates[estimate_count].command = strpool_intern(command);
+    estimates[estimate_count].seconds = seconds;
+    ++estimate_count;
+}
+
+/* Called when a job leaves the table after exiting. */
+void dag_note_exit(int job_id, int status) {
+    record_exit(job_id, status);
+    for (int i = 0; i < running_count; ++i) {
+        if (running[i].job_id != job_id) continue;
+        update_estimate(running[i].command, now_sec() - running[i].started);
+        strpool_release(running[i].command);
+        running[i] = running[--running_count];
+        break;
+    }
+}
+
+static int dag_limit(void) {
+    const char *s = getenv("CSHELL_DAG_JOBS");
+    int n = s ? atoi(s) : 0;
+    if (n <= 0) n = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? n : 1;
+}
+
+/* Like lookup_job, but also finds jobs that ended and haven't been reaped. */
+static Job *job_entry(int job_id) {
+    for (int i = 0; i < job_count; ++i) if (jobs[i].job_id == job_id) return &jobs[i];
+    return NULL;
+}
+
+static int succeeded(int status) { return status >= 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0; }
+
+/* 1 = all dependencies succeeded, 0 = still waiting, -1 = one failed. */
+static int deps_state(const DagNode *n) {
+    int ready = 1;
+    for (int i = 0; i < n->ndeps; ++i) {
+        if (n->dep_status[i] == DEP_PENDING) { if (job_entry(n->deps[i])) ready = 0; continue; }  /* gone without a record: ignore */
+        if (!succeeded(n->dep_status[i])) return -1;
+    }
+    return ready;
+}
+
+/* The exit is recorded when the job entry is reaped (dag_note_exit). */
+static void remove_node(int i, int status) {
+    Job *job = job_entry(nodes[i].job_id);
+    if (job) {
+        job->state = DONE;
+        job->status = status;
+    } else {
+        record_exit(nodes[i].job_id, status);
+    }
+    free(nodes[i].line);
+    free(nodes[i].deps);
+    memmove(nodes + i, nodes + i + 1, (node_count - i - 1) * sizeof(DagNode));
+    --node_count;
+}
+
+/* rank = own cost + the longest rank among pending nodes that depend on it. */
+static double node_rank(int i, char *seen) {
+    if (seen[i]) return nodes[i].rank;
+    seen[i] = 1;
+    double best = 0;
+    for (int j = 0; j < node_count; ++j) {
+        for (int d = 0; d < nodes[j].ndeps; ++d) {
+            if (nodes[j].deps[d] != nodes[i].job_id) continue;
+            double r = node_rank(j, seen);
+            if (r > best) best = r;
+            break;
+        }
+    }
+    Job *job = lookup_job(nodes[i].job_id);
+    nodes[i].rank = (job ? estimate_for(job->command) : DAG_DEFAULT_COST) + best;
+    return nodes[i].rank;
+}
+
+static void start_node(int i) {
+    DagNode n = nodes[i];
+    memmove(nodes + i, nodes + i + 1, (node_count - i - 1) * sizeof(DagNode));
+    --node_count;
+    Job *job = lookup_job(n.job_id);
+    const char *command = job ? strpool_intern(job->command) : NULL;
+    Command *cmd = parse_input(n.line);
+    int rc = cmd ? execute_pending(cmd, n.line, n.job_id) : -1;
+    free_command(cmd);
+    job = job_entry(n.job_id);
+    if (rc >= 0 && job && job->state != PENDING && grow((void **)&running, &running_cap, running_count + 1, sizeof(Running)) == 0) {
+        running[running_count].job_id = n.job_id;
+        running[running_count].started = now_sec();
+        running[running_count].command = command;
+        ++running_count;
+        command = NULL;
+    } else if (job && job->state == PENDING) {
+        /* A builtin ran in place, or nothing could be started. */
+        job->state = DONE;
+        job->status = rc < 0 ? 127 << 8 : 0;
+    } else if (!job) {
+        record_exit(n.job_id, rc < 0 ? 127 << 8 : 0);
+    }
+    strpool_release(command);
+    free(n.line);
+    free(n.deps);
+}
+
+void dag_schedule(void) {
+    if (scheduling || !node_count) return;
+    scheduling = 1;
+    reap_done_jobs();
+
+    /* Drop nodes downstream of a failure; that can cascade, so repeat. */
+    for (int changed = 1; changed; ) {
+        changed = 0;
+        for (int i = 0; i < node_count; ) {
+            if (deps_state(&nodes[i]) < 0) {
+                Job *job = lookup_job(nodes[i].job_id);
+                printf("\n[%d] Skipped (dependency failed)  %s\n", nodes[i].job_id, job ? job->command : nodes[i].line);
+                remove_node(i, -1);
+                changed = 1;
+            } else ++i;
+        }
+        reap_done_jobs();
+    }
+
+    int slots = dag_limit() - running_count;
+    while (slots > 0 && node_count) {
+        char *seen = calloc(node_count, 1);
+        if (!seen) break;
+        int best = -1;
+        for (int i = 0; i < node_count; ++i) {
+            double r = node_rank(i, seen);
+            if (deps_state(&nodes[i]) == 1 && (best < 0 || r > nodes[best].rank)) best = i;
+        }
+        free(seen);
+        if (best < 0) break;
+        start_node(best);
+        --slots;
+    }
+    fflush(stdout);
+    scheduling = 0;
+    reap_done_jobs();
+}
+
+/* Queue line as a pending job depending on deps. Returns its job id or -1. */
+static int dag_add(const char *line, const int *deps, int ndeps) {
+    for (int i = 0; i < ndeps; ++i) {
+        if (!lookup_job(deps[i]) && !find_exit(deps[i])) { printf("after: no such job %%%d\n", deps[i]); return -1; }
+    }
+    if (grow((void **)&nodes, &node_cap, node_count + 1, sizeof(DagNode)) != 0) return -1;
+    DagNode *n = &nodes[node_count];
+    n->line = strdup(line);
+    n->deps = malloc((ndeps ? 2 * ndeps : 1) * sizeof(int));
+    if (!n->line || !n->deps) { free(n->line); free(n->deps); return -1; }
+    Job *job = add_job(0, line, PENDING);
+    if (!job) { printf("after: job table full\n"); free(n->line); free(n->deps); return -1; }
+    job->pgid = 0;
+    memcpy(n->deps, deps, ndeps * sizeof(int));
+    n->dep_status = n->deps + ndeps;
+    for (int i = 0; i < ndeps; ++i) {
+        const ExitRecord *r = find_exit(deps[i]);
+        n->dep_status[i] = r ? r->status : DEP_PENDING;
+    }
+    n->ndeps = ndeps;
+    n->job_id = job->job_id;
+    n->rank = 0;
+    ++node_count;
+    return n->job_id;
+}
+
+/* The next blank-separated word of *s, as [word, *len); advances *s past it. */
+static const char *next_word(const char **s, size_t *len) {
+    const char *w = *s;
+    while (isspace((unsigned char)*w)) ++w;
+    *len = 0;
+    while (w[*len] && !isspace((unsigned char)w[*len])) ++*len;
+    *s = w + *len;
+    return w;
+}
+
+/* "after %1 %2 [--] cmd ...", caught on the raw line before it is parsed:
+ * only the header words are split off here, and the command itself stays
+ * unparsed (and unexpanded) until the node runs. Returns 1 when line was an
+ * after. */
+int dag_after(const char *line) {
+    size_t len;
+    const char *w = next_word(&line, &len);
+    if (len != 5 || strncmp(w, "after", 5) != 0) return 0;
+    int deps[64], ndeps = 0;
+    const char *rest = line;
+    for (w = next_word(&line, &len); len > 1 && w[0] == '%'; rest = line, w = next_word(&line, &len)) {
+        if (ndeps == 64) { printf("after: too many dependencies\n"); return 1; }
+        deps[ndeps++] = atoi(w + 1);
+    }
+    if (len == 2 && strncmp(w, "--", 2) == 0) rest = line;
+    while (isspace((unsigned char)*rest)) ++rest;
+    if (!ndeps || !*rest) { printf("Usage: after %%N [%%M ...] -- command\n"); return 1; }
+    int id = dag_add(rest, deps, ndeps);
+    if (id > 0) { printf("[%d] waiting\n", id); dag_schedule(); }
+    return 1;
+}
+
+/* dag FILE: "name: [dep ...] -- command" per line ("name: command" when there
+ * are no deps), # comments. Nodes may be listed in any order; they are queued
+ * in dependency order so every dep already has a job id. */
+static void dag_file(const char *path) {
+    FILE *f = fopen(path, "re");
+    if (!f) { perror("dag"); return; }
+    typedef struct { char *name; char *deps; char *command; int job_id; } Entry;
+    Entry *v = NULL;
+    int n = 0, cap = 0, ok = 1, lineno = 0;
+    char *line = NULL;
+    size_t len = 0;
+    while (ok && getline(&line, &len, f) > 0) {
+        ++lineno;
+        line[strcspn(line, "\r\n")] = '\0';
+        char *p = line;
+        while (isspace((unsigned char)*p)) ++p;
+        if (!*p || *p == '#') continue;
+        char *colon = strchr(p, ':');
+        if (!colon || colon == p) { printf("dag: %s:%d: expected 'name: command'\n", path, lineno); ok = 0; break; }
+        *colon = '\0';
+        char *body = colon + 1, *sep = strstr(body, " -- "), *deps = "";
+        if (sep) { *sep = '\0'; deps = body; body = sep + 4; }
+        while (isspace((unsigned char)*body)) ++body;
+        if (grow((void **)&v, &cap, n + 1, sizeof(Entry)) != 0) { ok = 0; break; }
+        char *name = p + strlen(p);
+        while (name > p && isspace((unsigned char)name[-1])) *--name = '\0';
+        v[n].name = strdup(p);
+        v[n].deps = strdup(deps);
+        v[n].command = strdup(body);
+        v[n].job_id = 0;
+        ++n;
+    }
+    free(line);
+    fclose(f);
+
+    /* Repeatedly queue entries whose deps are all queued; anything left is a
+     * cycle or an unknown name. */
+    for (int progress = 1, queued = 0; ok && progress && queued < n; ) {
+        progress = 0;
+        for (int i = 0; i < n; ++i) {
+            if (v[i].job_id) continue;
+            int ids[64], nids = 0, ready = 1;
+            char *copy = strdup(v[i].deps), *save = NULL;
+            for (char *t = strtok_r(copy, " \t", &save); t && ready; t = strtok_r(NULL, " \t", &save)) {
+                int found = 0;
+                for (int j = 0; j < n && !found; ++j) {
+                    if (strcmp(v[j].name, t) != 0) continue;
+                    found = 1;
+                    if (!v[j].job_id) ready = 0; else if (nids < 64) ids[nids++] = v[j].job_id;
+                }
+                if (!found) { printf("dag: unknown dependency '%s' of %s\n", t, v[i].name); ready = 0; ok = 0; }
+            }
+            free(copy);
+            if (!ready) continue;
+            v[i].job_id = dag_add(v[i].command, ids, nids);
+            if (v[i].job_id < 0) { ok = 0; break; }
+            printf("[%d] %s\n", v[i].job_id, v[i].name);
+            progress = 1;
+            ++queued;
+        }
+        if (ok && !progress && queued < n) { printf("dag: dependency cycle; not queued:"); ok = 0;
+            for (int i = 0; i < n; ++i) if (!v[i].job_id) printf(" %s", v[i].name);
+            printf("\n");
+        }
+    }
+    for (int i = 0; i < n; ++i) { free(v[i].name); free(v[i].deps); free(v[i].command); }
+    free(v);
+    dag_schedule();
+}
+
+static void report(int job_id) {
+    const ExitRecord *r = find_exit(job_id);
+    if (!r) return;
+    if (r->status < 0) printf("[%d] Skipped\n", job_id);
+    else if (WIFSIGNALED(r->status)) printf("[%d] Killed (signal %d)\n", job_id, WTERMSIG(r->status));
+    else if (WEXITSTATUS(r->status)) printf("[%d] Exit %d\n", job_id, WEXITSTATUS(r->status));
+    else printf("[%d] Done\n", job_id);
+}
+
+/* Whether job_id has ended (or never existed). */
+static int ended(int job_id) { reap_done_jobs(); return !lookup_job(job_id); }
+
+static int anything_running(void) {
+    reap_done_jobs();
+    if (node_count) return 1;
+    for (int i = 0; i < job_count; ++i) if (jobs[i].state == RUNNING) return 1;
+    return 0;
+}
+
+static void handle_wait(Command *cmd) {
+    int i = 1, next = 0;
+    if (cmd->args[i] && strcmp(cmd->args[i], "-n") == 0) { next = 1; ++i; }
+    int first = i, ntargets = 0;
+    for (; cmd->args[i]; ++i) {
+        if (cmd->args[i][0] != '%') { printf("Usage: wait [-n] [%%N ...]\n"); return; }
+        ++ntargets;
+    }
+
+    if (next) {
+        /* The first of the targets (or of all jobs) to end from now on. */
+        long mark = exit_count;
+        for (;;) {
+            for (long r = oldest_since(mark); r < exit_count; ++r) {
+                int id = exits[r % DAG_EXITS].job_id, hit = !ntargets;
+                for (int t = first; t < first + ntargets && !hit; ++t) hit = atoi(cmd->args[t] + 1) == id;
+                if (hit) { report(id); return; }
+            }
+            mark = exit_count;
+            if (!ntargets && !anything_running()) return;
+            if (ntargets) {
+                int live = 0;
+                for (int t = first; t < first + ntargets; ++t) live |= !ended(atoi(cmd->args[t] + 1));
+                if (!live) return;
+            }
+            if (loop_wait_child() < 0) return;
+        }
+    }
+
+    if (!ntargets) {
+        /* Failures are reported as they come, before the ring can drop them. */
+        for (long mark = exit_count, more = 1; more; mark = exit_count) {
+            more = anything_running() && loop_wait_child() >= 0;
+            for (long r = oldest_since(mark); r < exit_count; ++r) {
+                if (!succeeded(exits[r % DAG_EXITS].status)) report(exits[r % DAG_EXITS].job_id);
+            }
+        }
+        return;
+    }
+    for (int t = first; t < first + ntargets; ++t) {
+        int id = atoi(cmd->args[t] + 1);
+        if (!lookup_job(id) && !find_exit(id)) { printf("wait: no such job %%%d\n", id); continue; }
+        while (!ended(id)) if (loop_wait_child() < 0) return;
+        report(id);
+    }
+}
+
+int handle_dag(Command *cmd) {
+    if (!cmd || !cmd->name) return 0;
+    if (strcmp(cmd->name, "wait") == 0) { handle_wait(cmd); return 1; }
+    if (strcmp(cmd->name, "dag") == 0) {
+        if (!cmd->args[1]) printf("Usage: dag FILE   (lines of 'name: [dep ...] -- command')\n");
+        else dag_file(cmd->args[1]);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,282 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/timerfd.h>
+
+#include "shell.h"
+
+/* Wall-clock and cpu deadlines for jobs: "timeout [-k GRACE] DURATION cmd" and
+ * "limit %N wall=5m cpu=60s grace=10s". One timerfd, armed for the earliest
+ * thing due, sits in the shell's wait loops. When a deadline passes the job's
+ * process group gets SIGTERM (and SIGCONT, in case it is stopped), then SIGKILL
+ * once the grace period (default 5s) is over; each is noted in the job table.
+ * Cpu time can't have a timer of its own, so it is looked at when the limit
+ * could first be reached with every cpu busy, and again after that. */
+
+#define GRACE_DEFAULT_US 5000000LL
+#define CPU_CHECK_MIN_US 10000LL
+
+typedef struct Deadline {
+    pid_t pgid;
+    long long wall_at;          /* monotonic, 0 for none */
+    long long cpu_limit;        /* user+system time for the whole job, 0 for none */
+    long long check_at;         /* next look at its cpu time */
+    long long grace;
+    long long kill_at;          /* SIGKILL due, once SIGTERM went out */
+    long long reaped_us;        /* cpu of stages reaped while in the foreground */
+    int sent;                   /* last signal sent, 0 if none */
+    const char *why;            /* "wall" or "cpu", once one has passed */
+} Deadline;
+
+static Deadline deadlines[MAX_JOBS];
+static int deadline_count = 0;
+static int timer_fd = -1;
+
+static long long mono_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* "30", "30s", "1.5m", "2h", "250ms" in microseconds, or -1. */
+long long parse_duration(const char *s) {
+    char *end;
+    double v = strtod(s, &end);
+    if (end == s || v < 0) return -1;
+    if (strcmp(end, "ms") == 0) v /= 1000;
+    else if (strcmp(end, "m") == 0) v *= 60;
+    else if (strcmp(end, "h") == 0) v *= 3600;
+    else if (strcmp(end, "d") == 0) v *= 86400;
+    else if (*end && strcmp(end, "s") != 0) return -1;
+    return (long long)(v * 1e6);
+}
+
+static Deadline *find_deadline(pid_t pgid, int create) {
+    for (int i = 0; i < deadline_count; ++i) if (deadlines[i].pgid == pgid) return &deadlines[i];
+    if (!create || deadline_count == MAX_JOBS || pgid <= 0) return NULL;
+    Deadline *d = &deadlines[deadline_count++];
+    memset(d, 0, sizeof(*d));
+    d->pgid = pgid;
+    d->grace = GRACE_DEFAULT_US;
+    return d;
+}
+
+static Job *job_of(pid_t pgid) {
+    for (int i = 0; i < job_count; ++i) {
+        if (jobs[i].pgid == pgid && jobs[i].state != DONE && jobs[i].state != PENDING) return &jobs[i];
+    }
+    return NULL;
+}
+
+/* The next thing due, 0 if nothing is. */
+static long long next_due(const Deadline *d) {
+    if (d->kill_at) return d->kill_at;
+    if (d->sent) return 0;
+    long long at = d->wall_at;
+    if (d->cpu_limit && (!at || d->check_at < at)) at = d->check_at;
+    return at;
+}
+
+static void arm(void) {
+    long long at = 0;
+    for (int i = 0; i < deadline_count; ++i) {
+        long long t = next_due(&deadlines[i]);
+        if (t && (!at || t < at)) at = t;
+    }
+    if (timer_fd < 0 && at) timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (timer_fd < 0) return;
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    if (at) {
+        its.it_value.tv_sec = at / 1000000;
+        its.it_value.tv_nsec = at % 1000000 * 1000;
+    }
+    timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+/* The timerfd while a deadline is pending, else -1. */
+int deadline_fd(void) {
+    for (int i = 0; i < deadline_count; ++i) if (next_due(&deadlines[i])) return timer_fd;
+    return -1;
+}
+
+/* Cpu time used by the job so far: its cgroup's count when it has one, else
+ * what its reaped stages used plus the live ones' own and their children's. */
+static long long job_cpu_us(const Deadline *d) {
+    Job *job = job_of(d->pgid);
+    CgroupUsage u;
+    if (job && job->cgroup_id && cgroup_usage(job->cgroup_id, &u) == 0 && u.cpu_usec >= 0) return u.cpu_usec;
+    long long us = job ? job->cpu_us : d->reaped_us;
+    long hz = sysconf(_SC_CLK_TCK);
+    pid_t *pids = NULL;
+    int n = pgrp_members(d->pgid, &pids);
+    for (int i = 0; i < n; ++i) {
+        char path[32], buf[1024];
+        snprintf(path, sizeof(path), "/proc/%d/stat", (int)pids[i]);
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        ssize_t len = fd >= 0 ? read(fd, buf, sizeof(buf) - 1) : -1;
+        if (fd >= 0) close(fd);
+        if (len <= 0) continue;
+        buf[len] = '\0';
+        char *p = strrchr(buf, ')');
+        unsigned long long ut, st;
+        long long cut, cst;
+        /* utime is field 14; fields 3-13 are skipped */
+        if (p && sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu %lld %lld", &ut, &st, &cut, &cst) == 4)
+            us += (long long)(ut + st + cut + cst) * 1000000 / hz;
+    }
+    free(pids);
+    return us;
+}
+
+/* Whether group pgid has a process that isn't just a zombie: one that ended
+ * while the shell was busy is only reaped later, and must not be "killed". */
+static int group_alive(pid_t pgid) {
+    pid_t *pids = NULL;
+    int n = pgrp_members(pgid, &pids), alive = 0;
+    for (int i = 0; i < n && !alive; ++i) {
+        char path[32], buf[256];
+        snprintf(path, sizeof(path), "/proc/%d/stat", (int)pids[i]);
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        ssize_t len = fd >= 0 ? read(fd, buf, sizeof(buf) - 1) : -1;
+        if (fd >= 0) close(fd);
+        if (len <= 0) continue;
+        buf[len] = '\0';
+        char *p = strrchr(buf, ')');
+        alive = p && p[1] == ' ' && p[2] != 'Z' && p[2] != 'X';
+    }
+    free(pids);
+    return n < 0 || alive;      /* no /proc: assume it is */
+}
+
+/* Returns 0, sending nothing, when the job has already ended. */
+static int signal_job(Deadline *d, int sig) {
+    const char *name = sig == SIGKILL ? "SIGKILL" : "SIGTERM";
+    if (!group_alive(d->pgid)) return 0;
+    kill(-d->pgid, sig);
+    if (sig == SIGTERM) kill(-d->pgid, SIGCONT);
+    d->sent = sig;
+    Job *job = job_of(d->pgid);
+    if (job) {
+        job->killed = sig;
+        job->killed_by = d->why;
+        printf("[%d] %s limit reached, sending %s\n", job->job_id, d->why, name);
+    } else {
+        printf("timeout: %s limit reached, sending %s\n", d->why, name);
+    }
+    fflush(stdout);
+    return 1;
+}
+
+static void expire(Deadline *d, const char *why, long long now) {
+    d->why = why;
+    if (!signal_job(d, d->grace > 0 ? SIGTERM : SIGKILL)) { d->wall_at = d->cpu_limit = 0; return; }
+    if (d->grace > 0) d->kill_at = now + d->grace;
+}
+
+/* Act on everything that is due; call when deadline_fd() is readable. */
+void deadline_fire(void) {
+    uint64_t ticks;
+    if (timer_fd >= 0 && read(timer_fd, &ticks, sizeof(ticks)) < 0) { /* spurious or already read */ }
+    long long now = mono_us();
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int i = 0; i < deadline_count; ++i) {
+        Deadline *d = &deadlines[i];
+        if (d->kill_at) {
+            if (now >= d->kill_at) { signal_job(d, SIGKILL); d->kill_at = 0; }
+            continue;
+        }
+        if (d->sent) continue;
+        if (d->wall_at && now >= d->wall_at) { expire(d, "wall", now); continue; }
+        if (d->cpu_limit && now >= d->check_at) {
+            long long left = d->cpu_limit - job_cpu_us(d);
+            if (left <= 0) { expire(d, "cpu", now); continue; }
+            left /= ncpu > 0 ? ncpu : 1;
+            d->check_at = now + (left > CPU_CHECK_MIN_US ? left : CPU_CHECK_MIN_US);
+        }
+    }
+    arm();
+}
+
+/* Give the job in group pgid a wall-clock deadline wall_us from now. */
+void deadline_set(pid_t pgid, long long wall_us, long long grace_us) {
+    Deadline *d = find_deadline(pgid, 1);
+    if (!d) return;
+    d->wall_at = mono_us() + wall_us;
+    if (grace_us >= 0) d->grace = grace_us;
+    arm();
+}
+
+/* cpu time of a stage the foreground wait reaped. */
+void deadline_reaped(pid_t pgid, long long cpu_us) {
+    Deadline *d = find_deadline(pgid, 0);
+    if (d) d->reaped_us += cpu_us;
+}
+
+/* Forget the job's deadlines. Returns the last signal they sent it, 0 if none. */
+int deadline_end(pid_t pgid) {
+    Deadline *d = find_deadline(pgid, 0);
+    if (!d) return 0;
+    int sent = d->sent;
+    *d = deadlines[--deadline_count];
+    arm();
+    return sent;
+}
+
+/* Whether a "limit" setting is a deadline: wall, grace, or cpu given as a
+ * duration (cpu=50% is a cgroup limit). */
+int deadline_key(const char *key, const char *val) {
+    if (strcmp(key, "wall") == 0 || strcmp(key, "grace") == 0) return 1;
+    return strcmp(key, "cpu") == 0 && *val && isalpha((unsigned char)val[strlen(val) - 1]) && strcmp(val, "max") != 0;
+}
+
+/* Apply a "limit" setting to job if it is a deadline. Returns 1 when it was
+ * (even if the value was bad), 0 when it is for the cgroup. */
+int deadline_limit(Job *job, const char *key, const char *val) {
+    if (!deadline_key(key, val)) return 0;
+    long long us = parse_duration(val);
+    if (us < 0) { printf("limit: bad %s value '%s' (e.g. %s=30s)\n", key, val, key); return 1; }
+    Deadline *d = find_deadline(job->pgid, 1);
+    if (!d) { printf("limit: too many deadlines\n"); return 1; }
+    long long now = mono_us();
+    if (key[0] == 'w') {
+        long long ran = job->start_us ? trace_now_us() - job->start_us : 0;
+        d->wall_at = now + (us > ran ? us - ran : 0);
+    } else if (key[0] == 'c') {
+        d->cpu_limit = us > 0 ? us : 1;
+        d->check_at = now;
+    } else {
+        d->grace = us;
+    }
+    arm();
+    if (!d->sent && next_due(d) && next_due(d) <= now) deadline_fire();
+    return 1;
+}
+
+/* Split a leading "timeout [-k GRACE] DURATION" off cmd. Returns 1 when a
+ * prefix was taken, 0 when there is none and -1 on a usage error. */
+int timeout_prefix(Command *cmd, JobOpts *jo) {
+    if (!cmd || !cmd->name || strcmp(cmd->name, "timeout") != 0) return 0;
+    int i = 1;
+    long long grace = -1;
+    if (cmd->args[i] && strcmp(cmd->args[i], "-k") == 0 && cmd->args[i + 1]) {
+        grace = parse_duration(cmd->args[i + 1]);
+        if (grace < 0) { printf("timeout: bad grace period '%s'\n", cmd->args[i + 1]); return -1; }
+        i += 2;
+    }
+    long long us = cmd->args[i] ? parse_duration(cmd->args[i]) : -1;
+    if (us <= 0 || !cmd->args[i + 1]) { printf("Usage: timeout [-k GRACE] DURATION command [| command ...]\n"); return -1; }
+    jo->timeout_us = us;
+    jo->kill_after_us = grace;
+    i += 1;
+    cmd->args += i;
+    cmd->argc -= i;
+    cmd->name = cmd->args[0];
+    return 1;
+}
@@ -0,0 +1,410 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <ctype.h>
+#include <errno.h>
+#include <signal.h>
+#include <spawn.h>
+#include <termios.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#include "shell.h"
+
+Launcher shell_launcher = LAUNCH_FORK;
+int job_control = 1;        /* hand the terminal to foreground jobs */
+int last_status = 0;        /* exit code of the last foreground job, 128+N for signal N */
+
+static const char *launcher_names[] = { "fork", "vfork", "spawn" };
+
+int parse_launcher(const char *name, Launcher *out) {
+    if (!name) return -1;
+    for (int i = 0; i < 3; ++i) {
+        if (strcmp(name, launcher_names[i]) == 0) { *out = (Launcher)i; return 0; }
+    }
+    return -1;
+}
+
+const char *launcher_name(Launcher l) {
+    return (l >= LAUNCH_FORK && l <= LAUNCH_SPAWN) ? launcher_names[l] : "?";
+}
+
+/* Affinity and memory policy for a stage; raw syscalls only, so this is safe
+ * in a vfork child. */
+static void apply_placement(const LaunchOpts *opts) {
+    if (!opts) return;
+    if (opts->cpus) sched_setaffinity(0, sizeof(cpu_set_t), opts->cpus);
+    if (opts->mem_node >= 0 && opts->mem_node < (int)(8 * sizeof(unsigned long))) {
+        unsigned long nodemask = 1UL << opts->mem_node;
+        syscall(SYS_set_mempolicy, MPOL_BIND, &nodemask, 8 * sizeof(nodemask) + 1);
+    }
+}
+
+/* Child side shared by fork and vfork: wire up stdio and exec. Only async-signal-safe
+ * calls past this point, since under vfork we are still running on the parent's stack. */
+static void exec_child(Command *cmd, const char *full, pid_t pgid, int in_fd, int out_fd, const LaunchOpts *opts) {
+    sigset_t none;
+    sigemptyset(&none);
+    sigprocmask(SIG_SETMASK, &none, NULL);  /* the shell holds SIGCHLD off while launching */
+    setpgid(0, pgid);
+    if (opts && opts->cgroup_procs_fd >= 0 && write(opts->cgroup_procs_fd, "0", 1) < 0) { /* attach() tries again from the parent */ }
+    apply_placement(opts);
+    if (in_fd != -1) dup2(in_fd, STDIN_FILENO);
+    if (out_fd != -1) dup2(out_fd, STDOUT_FILENO);
+    if (opts && opts->err_fd >= 0) dup2(opts->err_fd, STDERR_FILENO);
+    execv(full, cmd->args);
+    perror("execv"); _exit(127);
+}
+
+static pid_t spawn_child(Command *cmd, const char *full, pid_t pgid, int in_fd, int out_fd, const LaunchOpts *opts) {
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_t fa;
+    sigset_t defsigs;
+    posix_spawnattr_init(&attr);
+    posix_spawn_file_actions_init(&fa);
+    sigemptyset(&defsigs);
+    sigaddset(&defsigs, SIGINT);
+    sigaddset(&defsigs, SIGTSTP);
+    sigset_t none;
+    sigemptyset(&none);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK);
+    posix_spawnattr_setpgroup(&attr, pgid);
+    posix_spawnattr_setsigdefault(&attr, &defsigs);
+    posix_spawnattr_setsigmask(&attr, &none);
+    if (in_fd != -1) posix_spawn_file_actions_adddup2(&fa, in_fd, STDIN_FILENO);
+    if (out_fd != -1) posix_spawn_file_actions_adddup2(&fa, out_fd, STDOUT_FILENO);
+    if (opts && opts->err_fd >= 0) posix_spawn_file_actions_adddup2(&fa, opts->err_fd, STDERR_FILENO);
+
+    /* posix_spawn has no attribute for affinity or memory policy; the child
+     * inherits both, so borrow them for the duration of the call. */
+    cpu_set_t saved_cpus;
+    int placed = opts && (opts->cpus || opts->mem_node >= 0);
+    if (placed) {
+        if (sched_getaffinity(0, sizeof(saved_cpus), &saved_cpus) != 0) placed = 0;
+        else apply_placement(opts);
+    }
+    extern char **environ;
+    pid_t pid = -1;
+    int rc = posix_spawn(&pid, full, &fa, &attr, cmd->args, environ);
+    if (rc == EPERM && pgid != 0) {
+        /* The group leader already exited and was reaped; fork would just ignore the
+         * failed setpgid, so start the stage in a group of its own instead. */
+        posix_spawnattr_setpgroup(&attr, 0);
+        rc = posix_spawn(&pid, full, &fa, &attr, cmd->args, environ);
+    }
+    if (placed) {
+        sched_setaffinity(0, sizeof(saved_cpus), &saved_cpus);
+        if (opts->mem_node >= 0) syscall(SYS_set_mempolicy, MPOL_DEFAULT, NULL, 0);
+    }
+    posix_spawn_file_actions_destroy(&fa);
+    posix_spawnattr_destroy(&attr);
+    if (rc != 0) { fprintf(stderr, "%s: %s\n", cmd->name, strerror(rc)); return -1; }
+    return pid;
+}
+
+/* Put a launched child in the job cgroup. fork and vfork children join it
+ * themselves before exec, but may have failed to, and posix_spawn can't; the
+ * write is harmless when it is already there. An exited child is no error. */
+static pid_t attach(pid_t pid, const LaunchOpts *opts) {
+    if (pid > 0 && opts && opts->cgroup_procs_fd >= 0 && cgroup_attach_fd(opts->cgroup_procs_fd, pid) != 0 && errno != ESRCH)
+        fprintf(stderr, "cgroup: pid %d left outside the job cgroup: %s\n", (int)pid, strerror(errno));
+    return pid;
+}
+
+static pid_t launch(Command *cmd, pid_t pgid, int in_fd, int out_fd, Launcher how, const LaunchOpts *opts) {
+    if (how == LAUNCH_FORK) {
+        /* Resolved in the parent so the lookup lands in the PATH cache. */
+        char *full = find_command_in_path(cmd->name);
+        pid_t pid = fork();
+        if (pid < 0) { perror("fork"); free(full); return -1; }
+        if (pid == 0) {
+            signal(SIGINT, SIG_DFL);
+            signal(SIGTSTP, SIG_DFL);
+            if (!full) { fprintf(stderr, "%s: command not found\n", cmd->name); _exit(127); }
+            exec_child(cmd, full, pgid, in_fd, out_fd, opts);
+        }
+        free(full);
+        return attach(pid, opts);
+    }
+
+    /* vfork and posix_spawn share the parent's memory until exec, so resolve the
+     * path up front where malloc is still safe. */
+    char *full = find_command_in_path(cmd->name);
+    if (!full) { fprintf(stderr, "%s: command not found\n", cmd->name); return -1; }
+    pid_t pid;
+    if (how == LAUNCH_VFORK) {
+        pid = vfork();
+        if (pid == 0) exec_child(cmd, full, pgid, in_fd, out_fd, opts);
+        if (pid < 0) perror("vfork");
+    } else {
+        pid = spawn_child(cmd, full, pgid, in_fd, out_fd, opts);
+    }
+    free(full);
+    return attach(pid, opts);
+}
+
+/* Start one command in process group pgid (0 = lead a new group), with stdin/stdout
+ * taken from in_fd/out_fd when they are not -1; its own redirections, opened
+ * here (redir.c), take their place. Pipe fds should be O_CLOEXEC so the child
+ * only keeps the dup'd copies. Returns the child's pid or -1. */
+pid_t launch_command(Command *cmd, pid_t pgid, int in_fd, int out_fd, Launcher how, const LaunchOpts *opts) {
+    int rfd[2];
+    if (redir_begin(cmd, opts ? opts->prealloc : 0, rfd) < 0) return -1;
+    pid_t pid = launch(cmd, pgid, rfd[0] >= 0 ? rfd[0] : in_fd, rfd[1] >= 0 ? rfd[1] : out_fd, how, opts);
+    redir_launched(rfd, pid > 0 ? (pgid ? pgid : pid) : -1);
+    return pid;
+}
+
+/* Hand what the job wrote to capture_fd to the capture callback: at most
+ * reads reads, or everything there is (reads 0). Closed at EOF. */
+void drain_capture(JobOpts *jo, int reads) {
+    char buf[65536];
+    for (int i = 0; jo->capture_fd >= 0 && (!reads || i < reads); ++i) {
+        ssize_t n = read(jo->capture_fd, buf, sizeof(buf));
+        if (n > 0) { jo->capture(buf, (size_t)n, jo->capture_arg); continue; }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && errno == EAGAIN) break;
+        close(jo->capture_fd);
+        jo->capture_fd = -1;
+    }
+}
+
+/* Give the terminal to a foreground job and wait for it, or register it as a
+ * background job. A job that stops in the foreground becomes a stopped job.
+ * jo->job_id names a pending job entry to fill in instead of adding a new one;
+ * a foreground job's wait status is left in jo->status. */
+static int finish_job(pid_t last_pid, pid_t pgid, int background, const char *full_line, int cgroup_id, JobOpts *jo) {
+    Job *job;
+    int job_id = jo ? jo->job_id : 0;
+    long long start = trace_now_us(), cpu = 0;
+    if (jo && jo->timeout_us) deadline_set(pgid, jo->timeout_us, jo->kill_after_us);
+    if (!background) {
+        if (job_control) tcsetpgrp(STDIN_FILENO, pgid);
+        /* Wait for every stage, not just the last, so nothing from this job is
+         * still running (or unreaped) once the prompt comes back. */
+        int status = 0, st;
+        pid_t w;
+        struct rusage ru;
+        while ((w = loop_wait_fg(pgid, &st, &ru, jo)) > 0) {
+            if (!WIFSTOPPED(st)) { cpu += rusage_cpu_us(&ru); deadline_reaped(pgid, rusage_cpu_us(&ru)); }
+            if (w == last_pid || WIFSTOPPED(st)) status = st;
+            if (WIFSTOPPED(st)) break;
+        }
+        if (job_control) tcsetpgrp(STDIN_FILENO, getpid());
+        if (jo) jo->status = status;
+        last_status = WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WIFSTOPPED(status) ? 128 + WSTOPSIG(status) : WEXITSTATUS(status);
+        if (jo && jo->capture_fd >= 0) drain_capture(jo, 0);   /* what the last writers left */
+        if (!WIFSTOPPED(status)) {
+            if (deadline_end(pgid)) last_status = 124;      /* as timeout(1) */
+            meter_end(pgid);
+            redir_end(pgid, status);
+            trace_job(start, cpu, trace_now_us(), status, full_line);
+            cgroup_release(cgroup_id);
+            return 1;
+        }
+        job = add_job(last_pid, full_line, STOPPED);
+        if (job) { job->start_us = start; job->cpu_us = cpu; }
+        printf("\n[%d] Stopped\n", next_job_id - 1);
+        /* The rest of a captured job's output is kept with it ("jobs output");
+         * closing the pipe would kill it once continued. */
+        if (job && jo && jo->capture_fd >= 0 && capture_attach(job->job_id, jo->capture_fd) == 0) {
+            printf("[%d] further output: jobs output %%%d\n", job->job_id, job->job_id);
+            jo->capture_fd = -1;
+        }
+    } else if (job_id && (job = lookup_job(job_id))) {
+        job->pid = last_pid;
+        job->start_us = start;
+        job->state = RUNNING;
+    } else {
+        job = add_job(last_pid, full_line, RUNNING);
+        printf("[%d] %d\n", next_job_id - 1, last_pid);
+    }
+    if (job) { job->pgid = pgid; job->cgroup_id = cgroup_id; }
+    else cgroup_release(cgroup_id);
+    if (job && jo && jo->output_fd >= 0 && capture_attach(job->job_id, jo->output_fd) == 0) jo->output_fd = -1;
+    return 1;
+}
+
+/* Job cgroup (when CSHELL_CGROUPS=1) shared by every stage of one job. */
+static int job_cgroup_begin(LaunchOpts *lo) {
+    int id = cgroup_jobs_enabled() ? cgroup_create_job() : 0;
+    lo->cgroup_procs_fd = id ? cgroup_procs_fd(id) : -1;
+    lo->cpus = NULL;
+    lo->mem_node = -1;
+    lo->err_fd = -1;
+    lo->prealloc = 0;
+    return id;
+}
+
+static void job_cgroup_end(LaunchOpts *lo) {
+    if (lo->cgroup_procs_fd >= 0) close(lo->cgroup_procs_fd);
+    lo->cgroup_procs_fd = -1;
+}
+
+/* Core per stage for "pin" jobs. Without topology, an explicit cpu list still
+ * applies to every stage as a plain mask. */
+static cpu_set_t *plan_stages(Command *cmd_list, const JobOpts *jo, int **nodes) {
+    int n = 0;
+    for (Command *c = cmd_list; c; c = c->next) ++n;
+    cpu_set_t *sets = malloc(n * sizeof(cpu_set_t));
+    *nodes = malloc(n * sizeof(int));
+    if (!sets || !*nodes) { free(sets); free(*nodes); *nodes = NULL; return NULL; }
+    int rc = affinity_plan(n, jo->have_cpus ? &jo->cpus : NULL, sets, *nodes);
+    if (rc == 0) return sets;
+    if (rc == -1 && jo->have_cpus) {
+        for (int i = 0; i < n; ++i) { sets[i] = jo->cpus; (*nodes)[i] = -1; }
+        return sets;
+    }
+    fprintf(stderr, "pin: %s, running unpinned\n", rc == -2 ? "no online cpu in the list" : "cpu topology not available");
+    free(sets); free(*nodes); *nodes = NULL;
+    return NULL;
+}
+
+int execute_pipeline(Command *cmd_list, int background, const char *full_line, JobOpts *jo) {
+    if (!cmd_list) return 0;
+    Command *cmd = cmd_list;
+    int prev_fd = -1;
+    int pipefd[2];
+    pid_t last_pid = -1;
+    pid_t pgid = 0;
+    LaunchOpts lo;
+    int cg = job_cgroup_begin(&lo);
+    int *nodes = NULL;
+    cpu_set_t *sets = jo && jo->place ? plan_stages(cmd_list, jo, &nodes) : NULL;
+    if (jo) { lo.err_fd = jo->err_fd; lo.prealloc = jo->prealloc; }
+    int nstages = 0;
+    for (Command *c = cmd_list; c; c = c->next) ++nstages;
+    Meter *meter = jo && jo->meter && nstages > 1 ? meter_begin(nstages) : NULL;
+
+    for (int stage = 0; cmd; ++stage) {
+        if (sets) {
+            lo.cpus = &sets[stage];
+            lo.mem_node = jo->bind_mem ? nodes[stage] : -1;
+        }
+        int has_next = (cmd->next != NULL);
+        if (has_next) {
+            if (pipe2(pipefd, O_CLOEXEC) < 0) { perror("pipe"); break; }
+            meter_pipe(meter, stage, pipefd[0]);
+        } else {
+            pipefd[0] = -1;
+            pipefd[1] = jo ? jo->out_fd : -1;
+        }
+
+        pid_t pid = cmd->shards > 1 ? shard_launch(cmd, pgid, prev_fd, pipefd[1], &lo)
+                                    : launch_command(cmd, pgid, prev_fd, pipefd[1], shell_launcher, &lo);
+        if (pid > 0) {
+            if (pgid == 0) pgid = pid;
+            setpgid(pid, pgid);
+            last_pid = pid;
+            meter_stage(meter, stage, pid, pgid, cmd->args[0]);
+        }
+        if (pipefd[1] != -1) close(pipefd[1]);
+        if (prev_fd != -1) close(prev_fd);
+        prev_fd = pipefd[0];
+        cmd = cmd->next;
+    }
+    if (jo && jo->out_fd >= 0) {
+        if (cmd) close(jo->out_fd);     /* stopped before the last stage */
+        jo->out_fd = -1;
+    }
+    if (jo && jo->err_fd >= 0) {
+        close(jo->err_fd);
+        jo->err_fd = -1;
+    }
+    if (prev_fd != -1) close(prev_fd);
+    job_cgroup_end(&lo);
+    free(sets);
+    free(nodes);
+    if (last_pid < 0) { meter_cancel(meter); cgroup_release(cg); return -1; }
+    return finish_job(last_pid, pgid, background, full_line, cg, jo);
+}
+
+/* CSHELL_PIN_PIPELINES=1 places every pipeline's stages as if prefixed with
+ * "pin"; "numa" also binds their memory. CSHELL_PIPE_METER=1 meters them. */
+void job_opts_init(JobOpts *jo, const Command *cmd_list) {
+    memset(jo, 0, sizeof(*jo));
+    jo->out_fd = jo->err_fd = jo->output_fd = jo->capture_fd = -1;
+    jo->kill_after_us = -1;
+    const char *pin = getenv("CSHELL_PIN_PIPELINES");
+    if (cmd_list->next && pin && (strcmp(pin, "1") == 0 || strcmp(pin, "numa") == 0)) {
+        jo->place = 1;
+        jo->bind_mem = strcmp(pin, "numa") == 0;
+    }
+    jo->meter = cmd_list->next && meter_enabled();
+}
+
+static int launch_job(Command *cmd_list, int background, const char *full_line, JobOpts *jo) {
+    if (cmd_list->next || jo->place || jo->out_fd >= 0) return execute_pipeline(cmd_list, background, full_line, jo);
+
+    LaunchOpts lo;
+    int cg = job_cgroup_begin(&lo);
+    lo.prealloc = jo->prealloc;
+    pid_t pid = launch_command(cmd_list, 0, -1, -1, shell_launcher, &lo);
+    job_cgroup_end(&lo);
+    if (pid < 0) { cgroup_release(cg); return -1; }
+    setpgid(pid, pid);
+    return finish_job(pid, pid, background, full_line, cg, jo);
+}
+
+/* Run cmd_list with the options gathered so far; prefixes such as "timeout"
+ * and "pin" are stripped here. */
+int execute_job(Command *cmd_list, int background, const char *full_line, JobOpts *jo) {
+    last_status = 0;
+    if (timeout_prefix(cmd_list, jo) < 0 || prealloc_prefix(cmd_list, jo) < 0 || pin_prefix(cmd_list, jo) < 0) { last_status = 2; return 1; }
+    if (handle_builtin(cmd_list)) return 1;
+    /* Keep the SIGCHLD handler from reaping a stage before the job is in the
+     * table (background) or before finish_job waits for it (foreground);
+     * either way its exit would be lost. */
+    if (background && jo->out_fd < 0 && capture_enabled()) capture_begin(jo);
+    sigset_t old;
+    block_sigchld(&old);
+    int rc = launch_job(cmd_list, background, full_line, jo);
+    restore_sigmask(&old);
+    if (jo->output_fd >= 0) {       /* not handed to a job */
+        close(jo->output_fd);
+        jo->output_fd = -1;
+    }
+    if (rc < 0) last_status = 127;
+    return rc;
+}
+
+int execute_command(Command *cmd_list, int background, const char *full_line) {
+    if (!cmd_list) return 0;
+    JobOpts jo;
+    job_opts_init(&jo, cmd_list);
+    if (memo_run(cmd_list, background, full_line, &jo)) return 1;
+    return execute_job(cmd_list, background, full_line, &jo);
+}
+
+/* Start the pending job job_id (a DAG node) in the background. Returns -1 if
+ * nothing could be launched; a builtin runs in place and leaves it pending. */
+int execute_pending(Command *cmd_list, const char *line, int job_id) {
+    if (!cmd_list) return 0;
+    JobOpts jo;
+    job_opts_init(&jo, cmd_list);
+    jo.job_id = job_id;
+    return execute_job(cmd_list, 1, line, &jo);
+}
+
+/* Run one input line: a trailing '&' backgrounds it. line is modified.
+ * Returns last_status. */
+int execute_line(char *line) {
+    int background = 0;
+    size_t len = strlen(line);
+    if (len > 0 && line[len-1] == '&') {
+        background = 1;
+        line[--len] = '\0';
+        while (len > 0 && isspace((unsigned char)line[len-1])) { line[--len] = '\0'; }
+    }
+    if (dag_after(line)) return last_status;
+    Command *cmd = parse_input(line);
+    if (cmd) {
+        execute_command(cmd, background, line);
+        free_command(cmd);
+    }
+    return last_status;
+}
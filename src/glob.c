@@ -0,0 +1,510 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "shell.h"
+
+/* Pathname and brace expansion for unquoted words.
+ *
+ * A pattern is compiled once into per-component matchers. Directories are read
+ * with large getdents64() batches and d_type decides "is this a directory"
+ * without a stat() unless the filesystem reports DT_UNKNOWN or a symlink.
+ * Matches are sorted bytewise with a multikey quicksort. */
+
+#define GLOB_DENTS_BUF (256 * 1024)
+
+typedef enum { OP_LIT, OP_ANY, OP_STAR, OP_CLASS } GlobOpKind;
+typedef struct {
+    GlobOpKind kind;
+    int len;                 /* OP_LIT: bytes at lit */
+    const char *lit;
+    uint8_t set[32];         /* OP_CLASS: 256-bit membership */
+} GlobOp;
+
+typedef enum { COMP_LITERAL, COMP_GLOB, COMP_GLOBSTAR } CompKind;
+typedef struct {
+    CompKind kind;
+    char *text;              /* component text; OP_LIT points into it */
+    GlobOp *ops;
+    int nops;
+    int dot_ok;              /* pattern itself starts with '.' */
+} GlobComp;
+
+typedef struct {
+    char **v;
+    size_t n, cap;
+} StrVec;
+
+typedef struct {
+    GlobComp *comps;
+    int ncomps;
+    int absolute;
+    int dirs_only;           /* pattern ended in '/' */
+    char **dents;            /* getdents64 buffers, one per directory depth */
+    int ndents;
+    int depth;
+    StrVec out;
+} GlobCtx;
+
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+static int vec_push(StrVec *v, char *s) {
+    if (v->n == v->cap) {
+        size_t ncap = v->cap ? v->cap * 2 : 64;
+        char **tmp = realloc(v->v, ncap * sizeof(char*));
+        if (!tmp) return -1;
+        v->v = tmp;
+        v->cap = ncap;
+    }
+    v->v[v->n++] = s;
+    return 0;
+}
+
+static void vec_free(StrVec *v) {
+    for (size_t i = 0; i < v->n; ++i) free(v->v[i]);
+    free(v->v);
+    v->v = NULL; v->n = v->cap = 0;
+}
+
+int has_glob_chars(const char *word) {
+    return strpbrk(word, "*?[") != NULL;
+}
+
+/* ---- pattern compilation and matching ---- */
+
+static int compile_class(const char *p, GlobOp *op) {
+    const char *start = p;
+    int negate = 0;
+    ++p;
+    if (*p == '!' || *p == '^') { negate = 1; ++p; }
+    memset(op->set, 0, sizeof(op->set));
+    int first = 1;
+    while (*p && (first || *p != ']')) {
+        unsigned char lo = (unsigned char)*p, hi = lo;
+        if (p[1] == '-' && p[2] && p[2] != ']') { hi = (unsigned char)p[2]; p += 3; }
+        else ++p;
+        for (unsigned c = lo; c <= hi; ++c) op->set[c >> 3] |= (uint8_t)(1u << (c & 7));
+        first = 0;
+    }
+    if (*p != ']') return -1;                       /* unterminated: '[' is literal */
+    if (negate) for (int i = 0; i < 32; ++i) op->set[i] = (uint8_t)~op->set[i];
+    op->set[0] &= (uint8_t)~1u;                     /* never match NUL */
+    op->kind = OP_CLASS;
+    return (int)(p - start) + 1;
+}
+
+static int compile_comp(GlobComp *c) {
+    const char *p = c->text;
+    size_t cap = strlen(p) + 1;
+    c->ops = malloc(cap * sizeof(GlobOp));
+    if (!c->ops) return -1;
+    c->nops = 0;
+    c->dot_ok = (p[0] == '.');
+    while (*p) {
+        GlobOp *op = &c->ops[c->nops];
+        if (*p == '*') {
+            while (*p == '*') ++p;
+            op->kind = OP_STAR;
+            ++c->nops;
+            continue;
+        }
+        if (*p == '?') { op->kind = OP_ANY; ++p; ++c->nops; continue; }
+        if (*p == '[') {
+            int used = compile_class(p, op);
+            if (used > 0) { p += used; ++c->nops; continue; }
+        }
+        if (c->nops && c->ops[c->nops-1].kind == OP_LIT && c->ops[c->nops-1].lit + c->ops[c->nops-1].len == p) {
+            ++c->ops[c->nops-1].len;
+        } else {
+            op->kind = OP_LIT; op->lit = p; op->len = 1;
+            ++c->nops;
+        }
+        ++p;
+    }
+    return 0;
+}
+
+/* Iterative matcher that backtracks only to the most recent '*', which keeps it
+ * linear for the usual prefix*suffix patterns. */
+static int match_ops(const GlobOp *ops, int nops, const char *s) {
+    int oi = 0;
+    int star_oi = -1;
+    const char *star_s = NULL;
+    while (1) {
+        if (oi < nops) {
+            const GlobOp *op = &ops[oi];
+            switch (op->kind) {
+            case OP_STAR:
+                star_oi = ++oi;
+                star_s = s;
+                if (oi == nops) return 1;
+                continue;
+            case OP_LIT:
+                if (strncmp(s, op->lit, op->len) == 0) { s += op->len; ++oi; continue; }
+                break;
+            case OP_ANY:
+                if (*s) { ++s; ++oi; continue; }
+                break;
+            case OP_CLASS: {
+                unsigned char ch = (unsigned char)*s;
+                if (ch && (op->set[ch >> 3] & (1u << (ch & 7)))) { ++s; ++oi; continue; }
+                break;
+            }
+            }
+        } else if (!*s) {
+            return 1;
+        }
+        if (star_oi < 0 || !*star_s) return 0;
+        oi = star_oi;
+        s = ++star_s;
+    }
+}
+
+static int comp_matches(const GlobComp *c, const char *name) {
+    if (name[0] == '.' && !c->dot_ok) return 0;
+    return match_ops(c->ops, c->nops, name);
+}
+
+/* ---- directory walk ---- */
+
+static char *join_path(const char *dir, const char *name) {
+    size_t dl = strlen(dir), nl = strlen(name);
+    char *s = malloc(dl + nl + 2);
+    if (!s) return NULL;
+    memcpy(s, dir, dl);
+    size_t off = dl;
+    if (dl && dir[dl-1] != '/') s[off++] = '/';
+    memcpy(s + off, name, nl + 1);
+    return s;
+}
+
+static int entry_is_dir(int dirfd, const char *name, unsigned char type, int follow) {
+    if (type == DT_DIR) return 1;
+    if (type != DT_UNKNOWN && !(type == DT_LNK && follow)) return 0;
+    struct stat st;
+    if (fstatat(dirfd, name, &st, follow ? 0 : AT_SYMLINK_NOFOLLOW) != 0) return 0;
+    return S_ISDIR(st.st_mode);
+}
+
+static void glob_walk(GlobCtx *g, int ci, const char *prefix);
+
+static void emit(GlobCtx *g, const char *path) {
+    char *s;
+    if (g->dirs_only) {
+        size_t l = strlen(path);
+        s = malloc(l + 2);
+        if (s) { memcpy(s, path, l); s[l] = '/'; s[l+1] = '\0'; }
+    } else {
+        s = strdup(path);
+    }
+    if (s && vec_push(&g->out, s) != 0) free(s);
+}
+
+/* Read dir once and call back for each entry except . and .. */
+typedef void (*dent_fn)(GlobCtx *g, int ci, const char *prefix, int dirfd, const char *name, unsigned char type);
+
+static void scan_dir(GlobCtx *g, int ci, const char *prefix, dent_fn fn) {
+    /* Callbacks recurse into subdirectories while this batch is still being
+     * walked, so each depth gets its own buffer, reused across siblings. */
+    if (g->depth == g->ndents) {
+        char **tmp = realloc(g->dents, (g->ndents + 1) * sizeof(char*));
+        if (!tmp) return;
+        g->dents = tmp;
+        if (!(g->dents[g->ndents] = malloc(GLOB_DENTS_BUF))) return;
+        ++g->ndents;
+    }
+    char *buf = g->dents[g->depth];
+    int fd = open(*prefix ? prefix : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return;
+    ++g->depth;
+    long nread;
+    while ((nread = syscall(SYS_getdents64, fd, buf, GLOB_DENTS_BUF)) > 0) {
+        for (long off = 0; off < nread; ) {
+            struct linux_dirent64 *d = (struct linux_dirent64 *)(buf + off);
+            off += d->d_reclen;
+            const char *n = d->d_name;
+            if (n[0] == '.' && (n[1] == '\0' || (n[1] == '.' && n[2] == '\0'))) continue;
+            fn(g, ci, prefix, fd, n, d->d_type);
+        }
+    }
+    --g->depth;
+    close(fd);
+}
+
+static void on_glob_entry(GlobCtx *g, int ci, const char *prefix, int dirfd, const char *name, unsigned char type) {
+    if (!comp_matches(&g->comps[ci], name)) return;
+    int last = (ci + 1 == g->ncomps);
+    if (!last || g->dirs_only) {
+        if (!entry_is_dir(dirfd, name, type, 1)) return;
+    }
+    char *path = join_path(prefix, name);
+    if (!path) return;
+    if (last) emit(g, path);
+    else glob_walk(g, ci + 1, path);
+    free(path);
+}
+
+static void on_globstar_entry(GlobCtx *g, int ci, const char *prefix, int dirfd, const char *name, unsigned char type) {
+    if (name[0] == '.') return;
+    int last = (ci + 1 == g->ncomps);
+    int is_dir = entry_is_dir(dirfd, name, type, 0);     /* like bash, don't follow links */
+    if (!is_dir && !last) return;
+    char *path = join_path(prefix, name);
+    if (!path) return;
+    if (last && (is_dir || !g->dirs_only)) emit(g, path);
+    if (is_dir) glob_walk(g, ci, path);
+    free(path);
+}
+
+static void glob_walk(GlobCtx *g, int ci, const char *prefix) {
+    GlobComp *c = &g->comps[ci];
+    int last = (ci + 1 == g->ncomps);
+    if (c->kind == COMP_LITERAL) {
+        char *path = join_path(prefix, c->text);
+        if (!path) return;
+        if (!last) glob_walk(g, ci + 1, path);
+        else {
+            struct stat st;
+            if (lstat(path, &st) == 0 && (!g->dirs_only || S_ISDIR(st.st_mode) ||
+                                          (stat(path, &st) == 0 && S_ISDIR(st.st_mode)))) emit(g, path);
+        }
+        free(path);
+    } else if (c->kind == COMP_GLOB) {
+        scan_dir(g, ci, prefix, on_glob_entry);
+    } else {
+        /* '**' matches zero directories here, or any number below. */
+        if (!last) glob_walk(g, ci + 1, prefix);
+        scan_dir(g, ci, prefix, on_globstar_entry);
+    }
+}
+
+/* ---- sorting ---- */
+
+static inline int char_at(const char *s, size_t d) { return (unsigned char)s[d]; }
+
+static void swap_str(char **v, size_t a, size_t b) { char *t = v[a]; v[a] = v[b]; v[b] = t; }
+
+/* Bentley-Sedgewick multikey quicksort: compares one byte per level, so long
+ * shared prefixes (dir/app-0001.log, dir/app-0002.log, ...) are not rescanned. */
+static void mkqsort(char **v, size_t n, size_t d) {
+    while (n > 1) {
+        if (n < 16) {
+            for (size_t i = 1; i < n; ++i)
+                for (size_t j = i; j > 0 && strcmp(v[j-1] + d, v[j] + d) > 0; --j) swap_str(v, j, j - 1);
+            return;
+        }
+        swap_str(v, 0, n / 2);
+        int pivot = char_at(v[0], d);
+        /* Partition into [0,lt) < pivot, [lt,gt) == pivot, [gt,n) > pivot. */
+        size_t lt = 0, i = 0, gt = n;
+        while (i < gt) {
+            int c = char_at(v[i], d);
+            if (c < pivot) swap_str(v, lt++, i++);
+            else if (c > pivot) swap_str(v, i, --gt);
+            else ++i;
+        }
+        mkqsort(v, lt, d);
+        mkqsort(v + gt, n - gt, d);
+        if (pivot == 0) return;
+        v += lt; n = gt - lt; ++d;
+    }
+}
+
+/* ---- brace expansion ---- */
+
+#define BRACE_MAX (1 << 20)     /* words from one brace expansion; a range past it stays literal */
+
+static int brace_range(const char *body, size_t len, long *a, long *b, int *alpha);
+
+/* Find the first {..} group whose body has a top-level comma or is a ".."
+ * range. Returns 0 and fills open/close when one exists. */
+static int find_brace(const char *w, const char **open, const char **close) {
+    for (const char *p = strchr(w, '{'); p; p = strchr(p + 1, '{')) {
+        int depth = 0, comma = 0;
+        const char *q;
+        for (q = p; *q; ++q) {
+            if (*q == '{') ++depth;
+            else if (*q == '}') { if (--depth == 0) break; }
+            else if (*q == ',' && depth == 1) comma = 1;
+        }
+        if (!*q) return -1;
+        long a, b;
+        int alpha;
+        if (comma || brace_range(p + 1, (size_t)(q - p - 1), &a, &b, &alpha) == 0) {
+            *open = p; *close = q;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int brace_expand(const char *w, StrVec *out);
+
+static int brace_emit(const char *pre, size_t prelen, const char *mid, size_t midlen, const char *post, StrVec *out) {
+    size_t postlen = strlen(post);
+    char *s = malloc(prelen + midlen + postlen + 1);
+    if (!s) return -1;
+    memcpy(s, pre, prelen);
+    memcpy(s + prelen, mid, midlen);
+    memcpy(s + prelen + midlen, post, postlen + 1);
+    int rc = brace_expand(s, out);
+    free(s);
+    return rc;
+}
+
+static int brace_range(const char *body, size_t len, long *a, long *b, int *alpha) {
+    char buf[64];
+    if (len >= sizeof(buf)) return -1;
+    memcpy(buf, body, len); buf[len] = '\0';
+    char *dots = strstr(buf, "..");
+    if (!dots || strchr(buf, ',')) return -1;
+    *dots = '\0';
+    const char *l = buf, *r = dots + 2;
+    if (l[0] && !l[1] && r[0] && !r[1] && !(l[0] >= '0' && l[0] <= '9')) {
+        *alpha = 1; *a = (unsigned char)l[0]; *b = (unsigned char)r[0];
+        return 0;
+    }
+    char *e1, *e2;
+    *a = strtol(l, &e1, 10);
+    *b = strtol(r, &e2, 10);
+    if (!*l || !*r || *e1 || *e2) return -1;
+    if ((*a <= *b ? (unsigned long)*b - (unsigned long)*a : (unsigned long)*a - (unsigned long)*b) >= BRACE_MAX) return -1;
+    *alpha = 0;
+    return 0;
+}
+
+static int brace_expand(const char *w, StrVec *out) {
+    const char *open, *close;
+    if (find_brace(w, &open, &close) != 0) {
+        if (out->n >= BRACE_MAX) return -1;        /* the whole word is then left as it was */
+        char *s = strdup(w);
+        if (!s || vec_push(out, s) != 0) { free(s); return -1; }
+        return 0;
+    }
+    size_t prelen = (size_t)(open - w);
+    const char *body = open + 1;
+    size_t bodylen = (size_t)(close - body);
+    long a, b;
+    int alpha;
+    if (brace_range(body, bodylen, &a, &b, &alpha) == 0) {
+        long step = a <= b ? 1 : -1;
+        for (long x = a; ; x += step) {
+            char mid[32];
+            int ml = alpha ? snprintf(mid, sizeof(mid), "%c", (int)x) : snprintf(mid, sizeof(mid), "%ld", x);
+            if (brace_emit(w, prelen, mid, (size_t)ml, close + 1, out) != 0) return -1;
+            if (x == b) break;
+        }
+        return 0;
+    }
+    const char *alt = body;
+    int depth = 0;
+    for (const char *p = body; p <= close; ++p) {
+        if (p < close && *p == '{') ++depth;
+        else if (p < close && *p == '}') --depth;
+        else if (p == close || (*p == ',' && depth == 0)) {
+            if (brace_emit(w, prelen, alt, (size_t)(p - alt), close + 1, out) != 0) return -1;
+            alt = p + 1;
+        }
+    }
+    return 0;
+}
+
+/* ---- public entry points ---- */
+
+static void free_ctx(GlobCtx *g) {
+    for (int i = 0; i < g->ncomps; ++i) { free(g->comps[i].text); free(g->comps[i].ops); }
+    free(g->comps);
+    for (int i = 0; i < g->ndents; ++i) free(g->dents[i]);
+    free(g->dents);
+}
+
+static int compile_pattern(GlobCtx *g, const char *pattern) {
+    memset(g, 0, sizeof(*g));
+    g->absolute = (pattern[0] == '/');
+    size_t plen = strlen(pattern);
+    g->dirs_only = (plen > 1 && pattern[plen-1] == '/');
+    int max = 1;
+    for (const char *p = pattern; *p; ++p) if (*p == '/') ++max;
+    g->comps = calloc((size_t)max, sizeof(GlobComp));
+    if (!g->comps) return -1;
+    const char *p = pattern;
+    while (*p) {
+        while (*p == '/') ++p;
+        if (!*p) break;
+        const char *e = strchr(p, '/');
+        size_t len = e ? (size_t)(e - p) : strlen(p);
+        GlobComp *c = &g->comps[g->ncomps++];
+        c->text = strndup(p, len);
+        if (!c->text) return -1;
+        if (strcmp(c->text, "**") == 0) c->kind = COMP_GLOBSTAR;
+        else if (has_glob_chars(c->text)) { c->kind = COMP_GLOB; if (compile_comp(c) != 0) return -1; }
+        else c->kind = COMP_LITERAL;
+        p += len;
+    }
+    return g->ncomps ? 0 : -1;
+}
+
+/* Glob one brace-free word into out; the word itself when nothing matches. */
+static int glob_one(const char *pattern, StrVec *out) {
+    if (!has_glob_chars(pattern)) {
+        char *s = strdup(pattern);
+        if (!s || vec_push(out, s) != 0) { free(s); return -1; }
+        return 0;
+    }
+    GlobCtx g;
+    if (compile_pattern(&g, pattern) != 0) { free_ctx(&g); return -1; }
+    glob_walk(&g, 0, g.absolute ? "/" : "");
+    free_ctx(&g);
+    if (g.out.n == 0) {
+        free(g.out.v);
+        char *s = strdup(pattern);
+        if (!s || vec_push(out, s) != 0) { free(s); return -1; }
+        return 0;
+    }
+    mkqsort(g.out.v, g.out.n, 0);
+    for (size_t i = 0; i < g.out.n; ++i) {
+        if (vec_push(out, g.out.v[i]) != 0) { g.out.n = i; vec_free(&g.out); return -1; }
+        g.out.v[i] = NULL;
+    }
+    free(g.out.v);
+    return 0;
+}
+
+/* Brace- and pathname-expand an unquoted word. Returns NULL when the word
+ * needs no expansion, otherwise a free_tokens() block of *count words. */
+char **expand_word(const char *word, int *count) {
+    if (!strpbrk(word, "*?[{")) return NULL;
+    StrVec braces = {0}, words = {0};
+    int rc = brace_expand(word, &braces);
+    for (size_t i = 0; rc == 0 && i < braces.n; ++i) rc = glob_one(braces.v[i], &words);
+    vec_free(&braces);
+    if (rc != 0) { vec_free(&words); return NULL; }
+
+    size_t text = 0;
+    for (size_t i = 0; i < words.n; ++i) text += strlen(words.v[i]) + 1;
+    char **block = malloc((words.n + 1) * sizeof(char*) + text);
+    if (block) {
+        char *dst = (char *)(block + words.n + 1);
+        for (size_t i = 0; i < words.n; ++i) {
+            size_t l = strlen(words.v[i]) + 1;
+            block[i] = memcpy(dst, words.v[i], l);
+            dst += l;
+        }
+        block[words.n] = NULL;
+        *count = (int)words.n;
+    }
+    vec_free(&words);
+    return block;
+}
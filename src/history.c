@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include "shell.h"
+
+/* History is kept in $HISTFILE (default ~/.cshell_history for a shell reading
+ * a terminal; empty disables it), one command per line, appended as commands
+ * are entered so concurrent shells interleave rather than overwrite. Loading
+ * keeps the last HISTORY_SIZE lines, and cuts the file back to just those
+ * once it has grown to several times that: in place, under an exclusive
+ * flock() that appends wait out, so other shells keep writing to the same
+ * file and none of their lines is lost. */
+
+char *history[HISTORY_SIZE];
+int history_count = 0;
+
+static int hist_fd = -1;
+
+void add_history(const char *line) {
+    if (!line) return;
+    char *copy = strdup(line);
+    if (!copy) return;
+    if (history_count < HISTORY_SIZE) {
+        history[history_count++] = copy;
+    } else {
+        free(history[0]);
+        memmove(history, history + 1, (HISTORY_SIZE - 1) * sizeof(char*));
+        history[HISTORY_SIZE - 1] = copy;
+    }
+    if (hist_fd >= 0 && !strchr(line, '\n')) {
+        struct iovec iov[2] = { { copy, strlen(copy) }, { "\n", 1 } };
+        flock(hist_fd, LOCK_SH);
+        if (writev(hist_fd, iov, 2) < 0) { /* best effort */ }
+        flock(hist_fd, LOCK_UN);
+    }
+}
+
+static const char *history_file(char *buf, size_t size) {
+    const char *path = getenv("HISTFILE"), *home = getenv("HOME");
+    if (path) return *path ? path : NULL;
+    if (!isatty(STDIN_FILENO) || !home) return NULL;
+    snprintf(buf, size, "%s/.cshell_history", home);
+    return buf;
+}
+
+/* Cut path down to its last HISTORY_SIZE lines. */
+static void history_trim(const char *path) {
+    int fd = open(path, O_RDWR | O_CLOEXEC);
+    if (fd < 0) return;
+    struct stat st;
+    char *buf = NULL;
+    if (flock(fd, LOCK_EX) == 0 && fstat(fd, &st) == 0 && st.st_size > 0 && (buf = malloc((size_t)st.st_size))) {
+        ssize_t n = pread(fd, buf, (size_t)st.st_size, 0);
+        size_t start = 0;
+        int lines = 0;
+        for (ssize_t i = n - 1; i > 0; --i) {
+            if (buf[i - 1] == '\n' && ++lines == HISTORY_SIZE) { start = (size_t)i; break; }
+        }
+        if (n == st.st_size && start > 0 && pwrite(fd, buf + start, (size_t)n - start, 0) == n - (ssize_t)start &&
+            ftruncate(fd, n - (off_t)start) != 0) { /* best effort */ }
+    }
+    free(buf);
+    close(fd);
+}
+
+void history_load(void) {
+    char buf[PATH_BUF];
+    const char *path = history_file(buf, sizeof(buf));
+    if (!path) return;
+    FILE *f = fopen(path, "re");
+    int lines = 0;
+    if (f) {
+        char *line = NULL;
+        size_t cap = 0;
+        ssize_t n;
+        int saved = hist_fd;
+        hist_fd = -1;                   /* loading, not entering */
+        while ((n = getline(&line, &cap, f)) > 0) {
+            if (line[n - 1] == '\n') line[--n] = '\0';
+            if (n) { add_history(line); ++lines; }
+        }
+        hist_fd = saved;
+        free(line);
+        fclose(f);
+    }
+    if (lines > 4 * HISTORY_SIZE) history_trim(path);
+    if (hist_fd < 0) hist_fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+}
+
+void print_history(void) {
+    for (int i = 0; i < history_count; ++i) {
+        printf("%4d  %s\n", i+1, history[i]);
+    }
+}
+
+void clear_history(void) {
+    for (int i = 0; i < history_count; ++i) free(history[i]);
+    history_count = 0;
+}
@@ -0,0 +1,228 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include "shell.h"
+
+Job jobs[MAX_JOBS];
+int job_count = 0;
+int next_job_id = 1;
+
+/* The SIGCHLD handler only flips job states; anything that reshapes the table
+ * or touches the string pool runs in the main loop with SIGCHLD held off. */
+void block_sigchld(sigset_t *old) {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &set, old);
+}
+
+void restore_sigmask(const sigset_t *old) { sigprocmask(SIG_SETMASK, old, NULL); }
+
+Job *add_job(pid_t pid, const char *command, JobState state) {
+    sigset_t old;
+    Job *job = NULL;
+    block_sigchld(&old);
+    if (job_count < MAX_JOBS) {
+        job = &jobs[job_count];
+        job->job_id = next_job_id++;
+        job->pid = pid;
+        job->pgid = pid;
+        job->command = strpool_intern(command);
+        job->state = state;
+        job->cgroup_id = 0;
+        job->status = 0;
+        job->start_us = state == PENDING ? 0 : trace_now_us();
+        job->end_us = job->cpu_us = 0;
+        job->killed = 0;
+        job->killed_by = NULL;
+        ++job_count;
+    }
+    restore_sigmask(&old);
+    return job;
+}
+
+static void remove_job_at(int i) {
+    if (jobs[i].state == DONE) {
+        /* Only when a signal ended it, and named by that signal rather than
+         * the last one the deadline sent. */
+        if (jobs[i].killed && WIFSIGNALED(jobs[i].status)) {
+            int sig = WTERMSIG(jobs[i].status);
+            char name[16];
+            if (sig == SIGKILL || sig == SIGTERM) snprintf(name, sizeof(name), "%s", sig == SIGKILL ? "SIGKILL" : "SIGTERM");
+            else snprintf(name, sizeof(name), "signal %d", sig);
+            printf("[%d] Killed (%s limit, %s) %s\n", jobs[i].job_id, jobs[i].killed_by ? jobs[i].killed_by : "?", name, jobs[i].command);
+        }
+        trace_job(jobs[i].start_us, jobs[i].cpu_us, jobs[i].end_us, jobs[i].status, jobs[i].command);
+        dag_note_exit(jobs[i].job_id, jobs[i].status);
+    }
+    strpool_release(jobs[i].command);
+    cgroup_release(jobs[i].cgroup_id);
+    meter_end(jobs[i].pgid);
+    deadline_end(jobs[i].pgid);
+    redir_end(jobs[i].pgid, jobs[i].state == DONE ? jobs[i].status : -1);
+    for (int j = i; j + 1 < job_count; ++j) jobs[j] = jobs[j+1];
+    --job_count;
+}
+
+void remove_job(pid_t pid) {
+    sigset_t old;
+    block_sigchld(&old);
+    for (int i = 0; i < job_count; ++i) {
+        if (jobs[i].pid == pid) { remove_job_at(i); break; }
+    }
+    restore_sigmask(&old);
+}
+
+void reap_done_jobs(void) {
+    sigset_t old;
+    block_sigchld(&old);
+    for (int i = 0; i < job_count; ) {
+        if (jobs[i].state == DONE) remove_job_at(i); else ++i;
+    }
+    restore_sigmask(&old);
+}
+
+/* Jobs that have processes to signal; see lookup_job for pending ones too. */
+Job *find_job(int job_id) {
+    Job *job = lookup_job(job_id);
+    return job && job->state != PENDING ? job : NULL;
+}
+
+Job *lookup_job(int job_id) {
+    for (int i = 0; i < job_count; ++i) {
+        if (jobs[i].job_id == job_id && jobs[i].state != DONE) return &jobs[i];
+    }
+    return NULL;
+}
+
+static const char *state_name(JobState state) {
+    return state == RUNNING ? "Running" : state == STOPPED ? "Stopped" : "Waiting";
+}
+
+/* The state, and what a passed deadline did to the job. */
+static const char *job_state(const Job *job, char *buf, size_t len) {
+    if (!job->killed) return state_name(job->state);
+    snprintf(buf, len, "%s (%s limit, %s)", state_name(job->state), job->killed_by ? job->killed_by : "?",
+             job->killed == SIGKILL ? "SIGKILL" : "SIGTERM");
+    return buf;
+}
+
+void list_jobs(void) {
+    reap_done_jobs();
+    for (int i = 0; i < job_count; ++i) {
+        char state[48];
+        printf("[%d] %s %s\n", jobs[i].job_id, job_state(&jobs[i], state, sizeof(state)), jobs[i].command);
+    }
+}
+
+/* Collect the pids of every process in group pgid from /proc. Returns the
+ * count (the array in *out is malloc'd) or -1. */
+int pgrp_members(pid_t pgid, pid_t **out) {
+    DIR *d = opendir("/proc");
+    if (!d) return -1;
+    pid_t *v = NULL;
+    int n = 0, cap = 0;
+    struct dirent *e;
+    while ((e = readdir(d))) {
+        char path[300], stat[512];
+        if (e->d_name[0] < '1' || e->d_name[0] > '9') continue;
+        snprintf(path, sizeof(path), "/proc/%s/stat", e->d_name);
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) continue;
+        ssize_t len = read(fd, stat, sizeof(stat) - 1);
+        close(fd);
+        if (len <= 0) continue;
+        stat[len] = '\0';
+        char *rp = strrchr(stat, ')');
+        int ppid, pgrp;
+        char state;
+        if (!rp || sscanf(rp + 2, "%c %d %d", &state, &ppid, &pgrp) != 3 || pgrp != pgid) continue;
+        if (n == cap) {
+            cap = cap ? cap * 2 : 8;
+            pid_t *tmp = realloc(v, cap * sizeof(pid_t));
+            if (!tmp) break;
+            v = tmp;
+        }
+        v[n++] = (pid_t)atoi(e->d_name);
+    }
+    closedir(d);
+    *out = v;
+    return n;
+}
+
+static void format_usage(const Job *job, char *buf, size_t len) {
+    CgroupUsage u;
+    buf[0] = '\0';
+    if (!job->cgroup_id || cgroup_usage(job->cgroup_id, &u) != 0) return;
+    int off = 0;
+    if (u.cpu_usec >= 0) off += snprintf(buf + off, len - off, " cpu=%.2fs", u.cpu_usec / 1e6);
+    if (u.mem_bytes >= 0 && off < (int)len) off += snprintf(buf + off, len - off, " mem=%.1fM", u.mem_bytes / 1048576.0);
+    if (u.cpu_psi >= 0 && off < (int)len)
+        snprintf(buf + off, len - off, " psi=%.2f/%.2f/%.2f", u.cpu_psi, u.mem_psi < 0 ? 0 : u.mem_psi, u.io_psi < 0 ? 0 : u.io_psi);
+}
+
+/* jobs -l: pids plus live cgroup usage (cpu time, memory, cpu/mem/io pressure). */
+void list_jobs_long(void) {
+    reap_done_jobs();
+    for (int i = 0; i < job_count; ++i) {
+        char usage[128], state[48];
+        format_usage(&jobs[i], usage, sizeof(usage));
+        printf("[%d] %d %s%s  %s\n", jobs[i].job_id, (int)jobs[i].pid,
+               job_state(&jobs[i], state, sizeof(state)), usage, jobs[i].command);
+    }
+}
+
+/* jobs -v: per-stage pipe figures for metered pipelines (see meter.c). */
+void list_jobs_verbose(void) {
+    reap_done_jobs();
+    for (int i = 0; i < job_count; ++i) {
+        char state[48];
+        printf("[%d] %s %s\n", jobs[i].job_id, job_state(&jobs[i], state, sizeof(state)), jobs[i].command);
+        meter_print(jobs[i].pgid);
+    }
+}
+
+/* Each child is peeked at first (WNOWAIT) so its process group is still known
+ * when wait4() reaps it: every stage's cpu time goes to its job. */
+void sigchld_handler(int sig) {
+    (void)sig;
+    int saved = errno;
+    while (1) {
+        siginfo_t info;
+        info.si_pid = 0;
+        if (waitid(P_ALL, 0, &info, WEXITED | WSTOPPED | WCONTINUED | WNOHANG | WNOWAIT) < 0 || info.si_pid == 0) break;
+        pid_t pgid = getpgid(info.si_pid);
+        int status;
+        struct rusage ru;
+        pid_t pid = wait4(info.si_pid, &status, WNOHANG | WUNTRACED | WCONTINUED, &ru);
+        if (pid <= 0) break;
+        int ended = WIFEXITED(status) || WIFSIGNALED(status);
+        for (int i = 0; ended && i < job_count; ++i) {
+            if (jobs[i].pgid == pgid && jobs[i].state != DONE) { jobs[i].cpu_us += rusage_cpu_us(&ru); break; }
+        }
+        for (int i = 0; i < job_count; ++i) {
+            if (jobs[i].pid == pid) {
+                if (ended) {
+                    jobs[i].status = status;
+                    jobs[i].end_us = trace_now_us();
+                    jobs[i].state = DONE;
+                } else if (WIFSTOPPED(status)) {
+                    jobs[i].state = STOPPED;
+                } else if (WIFCONTINUED(status)) {
+                    jobs[i].state = RUNNING;
+                }
+                break;
+            }
+        }
+    }
+    loop_wake();
+    errno = saved;
+}
@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include "shell.h"
+
+/* The shell's event loop. SIGCHLD only flips job states and writes a byte to a
+ * self-pipe; whoever is blocked (the prompt read, or a "wait") wakes up, reaps
+ * finished jobs and lets the scheduler start whatever became runnable. */
+
+static int wake_pipe[2] = { -1, -1 };
+static int sigchld_fd = -1;
+
+void loop_init(void) {
+    if (wake_pipe[0] >= 0) return;
+    if (pipe2(wake_pipe, O_CLOEXEC | O_NONBLOCK) < 0) wake_pipe[0] = wake_pipe[1] = -1;
+}
+
+/* Async-signal-safe. */
+void loop_wake(void) {
+    if (wake_pipe[1] >= 0) {
+        int saved = errno;
+        if (write(wake_pipe[1], "", 1) < 0) { /* pipe full: a wakeup is already pending */ }
+        errno = saved;
+    }
+}
+
+static void child_event(void) {
+    char buf[64];
+    while (read(wake_pipe[0], buf, sizeof(buf)) > 0) { }
+    reap_done_jobs();
+    dag_schedule();
+}
+
+/* Whether stdio already holds unread input, in which case polling the fd
+ * could block on data we have in hand. */
+static int stdin_buffered(void) {
+#ifdef __GLIBC__
+    return stdin->_IO_read_ptr < stdin->_IO_read_end;
+#else
+    return 1;
+#endif
+}
+
+/* The nearer of two poll timeouts, -1 being none. */
+static int min_timeout(int a, int b) {
+    return a < 0 ? b : b < 0 || a < b ? a : b;
+}
+
+/* Read one line from stdin (malloc'd, newline kept), running child events,
+ * enforcing deadlines, draining captured job output, sampling metered pipes,
+ * collecting prewarm results and starting idle warm-ups while waiting for it.
+ * Returns NULL at EOF. */
+char *loop_read_line(void) {
+    loop_init();
+    while (wake_pipe[0] >= 0 && !stdin_buffered()) {
+        struct pollfd pfd[4 + CAPTURE_MAX] = { { STDIN_FILENO, POLLIN, 0 }, { wake_pipe[0], POLLIN, 0 }, { prewarm_fd(), POLLIN, 0 },
+                                               { deadline_fd(), POLLIN, 0 } };
+        int ncap = capture_pollfds(pfd + 4);
+        int n = poll(pfd, 4 + ncap, min_timeout(prewarm_timeout(), meter_timeout()));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (n == 0) {
+            meter_tick();
+            if (prewarm_timeout() == 0) prewarm_idle();
+            continue;
+        }
+        if (pfd[1].revents) child_event();
+        if (pfd[2].revents) prewarm_collect();
+        if (pfd[3].revents) deadline_fire();
+        capture_events(pfd + 4, ncap);
+        if (pfd[0].revents) break;
+    }
+    char *line = NULL;
+    size_t n = 0;
+    if (getline(&line, &n, stdin) <= 0) { free(line); return NULL; }
+    prewarm_activity();
+    return line;
+}
+
+/* Block until the next child event and handle it. Returns -1 when interrupted
+ * by something else (e.g. Ctrl-C) or without a wake pipe, 0 otherwise. */
+int loop_wait_child(void) {
+    loop_init();
+    if (wake_pipe[0] < 0) return -1;
+    for (;;) {
+        struct pollfd pfd[2 + CAPTURE_MAX] = { { wake_pipe[0], POLLIN, 0 }, { deadline_fd(), POLLIN, 0 } };
+        int ncap = capture_pollfds(pfd + 2);
+        int n = poll(pfd, 2 + ncap, meter_timeout());
+        if (n == 0) { meter_tick(); continue; }
+        if (n < 0) {
+            /* SIGCHLD itself interrupts poll; only give up if it wasn't that. */
+            if (errno != EINTR || poll(pfd, 1, 0) <= 0) return -1;
+            pfd[0].revents = POLLIN;
+            ncap = 0;
+        }
+        if (pfd[1].revents) deadline_fire();
+        capture_events(pfd + 2, ncap);
+        if (pfd[0].revents) break;
+    }
+    child_event();
+    return 0;
+}
+
+/* wait4(-pgid, status, WUNTRACED, ru) for a foreground job, still enforcing
+ * deadlines, draining captured output (and jo's capture_fd, when it has one)
+ * and sampling metered pipes meanwhile. SIGCHLD must be blocked: it is read
+ * from a signalfd here, and raised again if one was taken, so the handler
+ * still hears about other children. */
+pid_t loop_wait_fg(pid_t pgid, int *status, struct rusage *ru, JobOpts *jo) {
+    int own = jo && jo->capture_fd >= 0;
+    int busy = own || meter_timeout() >= 0 || deadline_fd() >= 0 || capture_open();
+    if (sigchld_fd < 0 && busy) {
+        sigset_t set;
+        sigemptyset(&set);
+        sigaddset(&set, SIGCHLD);
+        sigchld_fd = signalfd(-1, &set, SFD_CLOEXEC | SFD_NONBLOCK);
+    }
+    if (!busy) return wait4(-pgid, status, WUNTRACED, ru);
+    /* The handler is installed with SA_NOCLDSTOP, and a job that stops must
+     * wake the poll too. */
+    struct sigaction sa, old;
+    sigaction(SIGCHLD, NULL, &old);
+    sa = old;
+    sa.sa_flags &= ~SA_NOCLDSTOP;
+    sigaction(SIGCHLD, &sa, NULL);
+    int taken = 0;
+    pid_t w;
+    while ((w = wait4(-pgid, status, WUNTRACED | WNOHANG, ru)) == 0) {
+        struct pollfd pfd[3 + CAPTURE_MAX] = { { sigchld_fd, POLLIN, 0 }, { deadline_fd(), POLLIN, 0 },
+                                               { jo ? jo->capture_fd : -1, POLLIN, 0 } };
+        int ncap = capture_pollfds(pfd + 3);
+        int ms = meter_timeout();
+        if (sigchld_fd < 0 && (ms < 0 || ms > 10)) ms = 10;    /* no signalfd: look for the exit now and then */
+        int n = poll(pfd, 3 + ncap, ms);
+        if (n < 0 && errno != EINTR) { w = wait4(-pgid, status, WUNTRACED, ru); break; }
+        if (n == 0) meter_tick();
+        if (n > 0 && pfd[0].revents) {
+            struct signalfd_siginfo si;
+            while (read(sigchld_fd, &si, sizeof(si)) > 0) taken = 1;
+        }
+        if (n > 0 && pfd[1].revents) deadline_fire();
+        if (n > 0 && pfd[2].revents) drain_capture(jo, CAPTURE_READS);
+        if (n > 0) capture_events(pfd + 3, ncap);
+    }
+    sigaction(SIGCHLD, &old, NULL);
+    if (taken) raise(SIGCHLD);
+    return w;
+}
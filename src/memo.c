@@ -0,0 +1,355 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/sendfile.h>
+
+#include "shell.h"
+
+/* Output memoization.
+ *
+ *   memo [-c] [-i PATH]... [-e VAR]... [--] cmd [| cmd ...]
+ *   memo            show the cache
+ *   memo --clear    empty it
+ *
+ * The key covers the working directory, every stage's argv, the identity of
+ * the '<' file and each -i PATH (device, inode, size, mtime; with -c a hash of
+ * the content instead), and the -e variables plus those named in
+ * CSHELL_MEMO_ENV. On a hit the stored stdout is replayed and the command never
+ * runs. On a miss stdout is teed through the shell into a new entry, which is
+ * kept unless the job was killed or stopped or could not be started.
+ *
+ * Entries are files in CSHELL_MEMO_DIR (default ~/.cache/cshell/memo) named by
+ * a 64-bit hash of the key; the full key is stored too, so a hash collision is
+ * just a miss. A hit bumps the entry's mtime, and once the directory outgrows
+ * CSHELL_MEMO_MAX (default 256M) the least recently used entries go. */
+
+#define MEMO_MAGIC "CSHMEMO1"
+#define MEMO_DEFAULT_MAX (256LL << 20)
+#define MEMO_MAX_OPTS 32
+
+typedef struct MemoHeader {
+    char magic[8];
+    int32_t status;         /* wait status of the run */
+    uint32_t key_len;
+    uint64_t out_len;
+} MemoHeader;
+
+typedef struct KeyBuf { char *data; size_t len, cap; } KeyBuf;
+
+typedef struct Capture {
+    int out_fd;             /* where the output really goes */
+    int tmp_fd;             /* the entry being written, -1 once abandoned */
+    uint64_t len;
+} Capture;
+
+static void key_add(KeyBuf *k, const void *p, size_t n) {
+    if (!k->data && k->cap) return;         /* an earlier allocation failed */
+    if (k->len + n > k->cap) {
+        size_t cap = k->cap ? k->cap : 256;
+        while (cap < k->len + n) cap *= 2;
+        char *tmp = realloc(k->data, cap);
+        if (!tmp) { free(k->data); k->data = NULL; k->cap = 1; return; }
+        k->data = tmp;
+        k->cap = cap;
+    }
+    memcpy(k->data + k->len, p, n);
+    k->len += n;
+}
+
+/* Strings go in with their terminator so "ab" "c" and "a" "bc" differ. */
+static void key_str(KeyBuf *k, const char *s) { key_add(k, s ? s : "", strlen(s ? s : "") + 1); }
+
+static uint64_t fnv64(uint64_t h, const void *p, size_t n) {
+    const unsigned char *c = p;
+    for (size_t i = 0; i < n; ++i) { h ^= c[i]; h *= 1099511628211ULL; }
+    return h;
+}
+
+static void key_file(KeyBuf *k, const char *path, int content) {
+    struct stat st;
+    char buf[128];
+    key_str(k, path);
+    if (stat(path, &st) != 0) { key_str(k, "missing"); return; }
+    if (content && S_ISREG(st.st_mode)) {
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        uint64_t h = 14695981039346656037ULL;
+        char chunk[65536];
+        ssize_t n;
+        while (fd >= 0 && (n = read(fd, chunk, sizeof(chunk))) > 0) h = fnv64(h, chunk, (size_t)n);
+        if (fd >= 0) close(fd);
+        snprintf(buf, sizeof(buf), "content:%llx:%lld", (unsigned long long)h, (long long)st.st_size);
+    } else {
+        snprintf(buf, sizeof(buf), "stat:%llx:%llx:%lld:%lld.%09ld", (unsigned long long)st.st_dev,
+                 (unsigned long long)st.st_ino, (long long)st.st_size, (long long)st.st_mtim.tv_sec, st.st_mtim.tv_nsec);
+    }
+    key_str(k, buf);
+}
+
+static void key_env(KeyBuf *k, const char *var) {
+    const char *v = getenv(var);
+    key_str(k, var);
+    key_str(k, v ? v : "\x01unset");
+}
+
+static int memo_dir(char *out, size_t len) {
+    const char *dir = getenv("CSHELL_MEMO_DIR"), *base;
+    if (dir && *dir) snprintf(out, len, "%s", dir);
+    else if ((base = getenv("XDG_CACHE_HOME")) && *base) snprintf(out, len, "%s/cshell/memo", base);
+    else if ((base = getenv("HOME")) && *base) snprintf(out, len, "%s/.cache/cshell/memo", base);
+    else return -1;
+    /* mkdir -p */
+    for (char *p = out + 1; *p; ++p) {
+        if (*p != '/') continue;
+        *p = '\0';
+        mkdir(out, 0755);
+        *p = '/';
+    }
+    return mkdir(out, 0755) == 0 || errno == EEXIST ? 0 : -1;
+}
+
+static long long memo_max(void) {
+    const char *s = getenv("CSHELL_MEMO_MAX");
+    long long v = s ? parse_size(s) : -1;
+    return v > 0 ? v : MEMO_DEFAULT_MAX;
+}
+
+static int write_all(int fd, const void *p, size_t n) {
+    const char *c = p;
+    while (n) {
+        ssize_t w = write(fd, c, n);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return -1;
+        c += w;
+        n -= (size_t)w;
+    }
+    return 0;
+}
+
+/* Copy len bytes from in_fd's current offset to out_fd. */
+static int copy_out(int in_fd, int out_fd, uint64_t len) {
+    while (len) {
+        ssize_t n = sendfile(out_fd, in_fd, NULL, len > (1 << 30) ? (1 << 30) : (size_t)len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EINVAL || errno == ENOSYS)) break;      /* e.g. an O_APPEND target */
+        if (n <= 0) return -1;
+        len -= (uint64_t)n;
+    }
+    char buf[65536];
+    while (len) {
+        ssize_t n = read(in_fd, buf, len < sizeof(buf) ? (size_t)len : sizeof(buf));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0 || write_all(out_fd, buf, (size_t)n) != 0) return -1;
+        len -= (uint64_t)n;
+    }
+    return 0;
+}
+
+/* Replay the entry at path if it holds key. Returns 1 on a hit. */
+static int memo_replay(const char *path, const KeyBuf *key, int out_fd, int *status) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return 0;
+    MemoHeader h;
+    int hit = 0;
+    char *stored = malloc(key->len ? key->len : 1);
+    if (stored && read(fd, &h, sizeof(h)) == (ssize_t)sizeof(h) && memcmp(h.magic, MEMO_MAGIC, 8) == 0 &&
+        h.key_len == key->len && read(fd, stored, key->len) == (ssize_t)key->len && memcmp(stored, key->data, key->len) == 0) {
+        hit = 1;
+        *status = h.status;
+        futimens(fd, NULL);                 /* LRU clock */
+        if (copy_out(fd, out_fd, h.out_len) != 0) fprintf(stderr, "memo: short replay of %s\n", path);
+    }
+    free(stored);
+    close(fd);
+    return hit;
+}
+
+static void capture_write(const char *buf, size_t len, void *arg) {
+    Capture *c = arg;
+    if (write_all(c->out_fd, buf, len) != 0) { /* reader went away; keep caching */ }
+    if (c->tmp_fd >= 0 && write_all(c->tmp_fd, buf, len) != 0) { close(c->tmp_fd); c->tmp_fd = -1; }
+    c->len += len;
+}
+
+typedef struct MemoEntry { char name[24]; time_t mtime; long long size; } MemoEntry;
+
+static int cmp_mtime(const void *a, const void *b) {
+    const MemoEntry *x = a, *y = b;
+    return (x->mtime > y->mtime) - (x->mtime < y->mtime);
+}
+
+/* Scan the cache; with evict, drop least recently used entries until it is
+ * back under 90% of the size limit. Returns the total size kept. */
+static long long memo_scan(const char *dir, int *count, int evict, int clear) {
+    DIR *d = opendir(dir);
+    if (!d) return -1;
+    MemoEntry *v = NULL;
+    int n = 0, cap = 0;
+    long long total = 0;
+    struct dirent *e;
+    while ((e = readdir(d))) {
+        struct stat st;
+        if (e->d_name[0] == '.' || strlen(e->d_name) >= sizeof(v->name)) continue;
+        if (fstatat(dirfd(d), e->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0 || !S_ISREG(st.st_mode)) continue;
+        if (clear) { unlinkat(dirfd(d), e->d_name, 0); continue; }
+        if (n == cap) {
+            cap = cap ? cap * 2 : 64;
+            MemoEntry *tmp = realloc(v, cap * sizeof(MemoEntry));
+            if (!tmp) break;
+            v = tmp;
+        }
+        snprintf(v[n].name, sizeof(v[n].name), "%s", e->d_name);
+        v[n].mtime = st.st_mtime;
+        v[n].size = (long long)st.st_size;
+        total += v[n].size;
+        ++n;
+    }
+    long long max = memo_max();
+    if (evict && total > max) {
+        qsort(v, n, sizeof(MemoEntry), cmp_mtime);
+        for (int i = 0; i < n && total > max - max / 10; ++i) {
+            if (unlinkat(dirfd(d), v[i].name, 0) == 0) { total -= v[i].size; --*count; }
+        }
+    }
+    closedir(d);
+    free(v);
+    *count += n;
+    return total;
+}
+
+/* Strip "memo [opts] [--]" off cmd, building the key as we go. */
+static int memo_prefix(Command *cmd, KeyBuf *key) {
+    const char *inputs[MEMO_MAX_OPTS], *envs[MEMO_MAX_OPTS];
+    int ninputs = 0, nenvs = 0, content = 0, i = 1;
+    for (; cmd->args[i] && cmd->args[i][0] == '-'; ++i) {
+        const char *a = cmd->args[i];
+        if (strcmp(a, "--") == 0) { ++i; break; }
+        if (strcmp(a, "-c") == 0) { content = 1; continue; }
+        if ((strcmp(a, "-i") == 0 || strcmp(a, "-e") == 0) && cmd->args[i+1]) {
+            if (a[1] == 'i' && ninputs < MEMO_MAX_OPTS) inputs[ninputs++] = cmd->args[++i];
+            else if (a[1] == 'e' && nenvs < MEMO_MAX_OPTS) envs[nenvs++] = cmd->args[++i];
+            else { printf("memo: too many %s options\n", a); return -1; }
+            continue;
+        }
+        printf("Usage: memo [-c] [-i PATH]... [-e VAR]... [--] command\n");
+        return -1;
+    }
+    if (!cmd->args[i]) { printf("Usage: memo [-c] [-i PATH]... [-e VAR]... [--] command\n"); return -1; }
+    cmd->args += i;
+    cmd->argc -= i;
+    cmd->name = cmd->args[0];
+
+    char cwd[PATH_BUF];
+    key_str(key, getcwd(cwd, sizeof(cwd)) ? cwd : "");
+    for (Command *c = cmd; c; c = c->next) {
+        for (int a = 0; a < c->argc; ++a) key_str(key, c->args[a]);
+        key_str(key, "\x01|");
+        if (c->input_file) key_file(key, c->input_file, content);
+    }
+    for (int k = 0; k < ninputs; ++k) key_file(key, inputs[k], content);
+    for (int k = 0; k < nenvs; ++k) key_env(key, envs[k]);
+    const char *list = getenv("CSHELL_MEMO_ENV");
+    if (list) {
+        char *copy = strdup(list), *save = NULL;
+        for (char *t = copy ? strtok_r(copy, ": ,", &save) : NULL; t; t = strtok_r(NULL, ": ,", &save)) key_env(key, t);
+        free(copy);
+    }
+    return key->data ? 0 : -1;
+}
+
+static void memo_show(int clear) {
+    char dir[PATH_BUF];
+    int count = 0;
+    if (memo_dir(dir, sizeof(dir)) != 0) { printf("memo: no cache directory\n"); return; }
+    long long total = memo_scan(dir, &count, 0, clear);
+    if (clear) printf("memo: cleared %s\n", dir);
+    else printf("memo: %s: %d entries, %.1fM of %.1fM\n", dir, count, total / 1048576.0, memo_max() / 1048576.0);
+}
+
+/* Handle "memo ..." (returns 1), or return 0 for anything else. */
+int memo_run(Command *cmd_list, int background, const char *full_line, JobOpts *jo) {
+    if (!cmd_list || !cmd_list->name || strcmp(cmd_list->name, "memo") != 0) return 0;
+    if (!cmd_list->args[1] || strcmp(cmd_list->args[1], "--clear") == 0) { memo_show(cmd_list->args[1] != NULL); return 1; }
+
+    KeyBuf key = { NULL, 0, 0 };
+    if (memo_prefix(cmd_list, &key) != 0) { free(key.data); return 1; }
+    char dir[PATH_BUF], path[PATH_BUF + 32], tmp[PATH_BUF + 32];
+    Command *last = cmd_list;
+    while (last->next) last = last->next;
+    if (background || last->replace || memo_dir(dir, sizeof(dir)) != 0) {
+        /* Output of a background job isn't ours to tee, nor is a ">!" file
+         * that only appears once the job succeeds; just run it. */
+        free(key.data);
+        execute_job(cmd_list, background, full_line, jo);
+        return 1;
+    }
+    snprintf(path, sizeof(path), "%s/%016llx", dir, (unsigned long long)fnv64(14695981039346656037ULL, key.data, key.len));
+
+    /* The shell owns the final destination: the last stage's '>' file if any. */
+    int out_fd = STDOUT_FILENO;
+    if (last->output_file) {
+        out_fd = open(last->output_file, O_WRONLY | O_CREAT | O_CLOEXEC | (last->append ? O_APPEND : O_TRUNC), 0644);
+        if (out_fd < 0) { perror(last->output_file); free(key.data); return 1; }
+        last->output_file = NULL;
+    }
+
+    int status = 0;
+    if (memo_replay(path, &key, out_fd, &status)) {
+        if (WIFEXITED(status) && WEXITSTATUS(status)) fprintf(stderr, "memo: exit %d (cached)\n", WEXITSTATUS(status));
+        jo->status = status;
+        last_status = WEXITSTATUS(status);
+        if (out_fd != STDOUT_FILENO) close(out_fd);
+        free(key.data);
+        return 1;
+    }
+
+    int p[2];
+    Capture c = { out_fd, -1, 0 };
+    snprintf(tmp, sizeof(tmp), "%s/.tmp.XXXXXX", dir);
+    c.tmp_fd = mkostemp(tmp, O_CLOEXEC);
+    MemoHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, MEMO_MAGIC, 8);
+    h.key_len = (uint32_t)key.len;
+    if (c.tmp_fd >= 0 && (write_all(c.tmp_fd, &h, sizeof(h)) != 0 || write_all(c.tmp_fd, key.data, key.len) != 0)) {
+        close(c.tmp_fd);
+        c.tmp_fd = -1;
+    }
+    if (pipe2(p, O_CLOEXEC) < 0) {
+        perror("memo: pipe");
+    } else {
+        jo->out_fd = p[1];
+        fcntl(p[0], F_SETFL, O_NONBLOCK);
+        jo->capture_fd = p[0];
+        jo->capture = capture_write;
+        jo->capture_arg = &c;
+        jo->status = -1;
+        execute_job(cmd_list, 0, full_line, jo);
+        if (jo->out_fd >= 0) close(jo->out_fd);             /* a builtin: nothing ran */
+        if (jo->capture_fd >= 0) { close(jo->capture_fd); jo->status = -1; }
+    }
+
+    /* Not cached: killed or stopped jobs, and 126/127 (the command couldn't be run). */
+    int keep = c.tmp_fd >= 0 && jo->status != -1 && WIFEXITED(jo->status) &&
+               WEXITSTATUS(jo->status) != 126 && WEXITSTATUS(jo->status) != 127;
+    if (keep) {
+        h.status = jo->status;
+        h.out_len = c.len;
+        keep = pwrite(c.tmp_fd, &h, sizeof(h), 0) == (ssize_t)sizeof(h) && rename(tmp, path) == 0;
+    }
+    if (c.tmp_fd >= 0) close(c.tmp_fd);
+    if (!keep) unlink(tmp);
+    else {
+        int count = 0;
+        memo_scan(dir, &count, 1, 0);
+    }
+    if (out_fd != STDOUT_FILENO) close(out_fd);
+    free(key.data);
+    return 1;
+}
@@ -0,0 +1,209 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+
+#include "shell.h"
+
+/* Pipe metering for pipelines run with CSHELL_PIPE_METER=1. The shell keeps an
+ * O_PATH handle on each pipe between stages: neither a reader nor a writer, so
+ * EOF and SIGPIPE behave as usual. Every CSHELL_PIPE_METER_MS (default 100) it
+ * reopens each pipe for a moment to read its fill level (FIONREAD) and
+ * capacity, and reads every stage's byte counts from /proc/PID/io. Time a pipe
+ * spends full is time its writer was stalled on the next stage; time it spends
+ * empty is time that next stage waited for input. A pipe found full in 3 of
+ * its last 4 samples gets twice the capacity, up to fs.pipe-max-size. */
+
+#define METER_INTERVAL_DEFAULT 100
+
+typedef struct MeterStage {
+    pid_t pid;
+    int dir;                    /* /proc/PID, -1 once the process is gone */
+    char name[24];
+    long long rchar, wchar;     /* last values from /proc/PID/io */
+} MeterStage;
+
+typedef struct MeterPipe {
+    int fd;                     /* O_PATH handle, -1 once the writer is gone */
+    int size, fill;             /* capacity and bytes queued, last sample */
+    unsigned recent;            /* one bit per sample, 1 = full */
+    int grown;
+    long long full_us, empty_us;
+} MeterPipe;
+
+struct Meter {
+    pid_t pgid;
+    int n;                      /* stages; pipe[i] joins stage i to i + 1 */
+    long long start_us, last_us;
+    MeterStage *stage;
+    MeterPipe *pipe;
+};
+
+static Meter *meters[MAX_JOBS];
+static int meter_count = 0;
+static long long next_sample_us = 0;
+static int pipe_max = 0;
+
+static int interval_ms(void) {
+    const char *s = getenv("CSHELL_PIPE_METER_MS");
+    int ms = s ? atoi(s) : 0;
+    return ms > 0 ? ms : METER_INTERVAL_DEFAULT;
+}
+
+int meter_enabled(void) {
+    const char *s = getenv("CSHELL_PIPE_METER");
+    return s && strcmp(s, "1") == 0;
+}
+
+static Meter *find_meter(pid_t pgid) {
+    for (int i = 0; pgid > 0 && i < meter_count; ++i) if (meters[i]->pgid == pgid) return meters[i];
+    return NULL;
+}
+
+Meter *meter_begin(int nstages) {
+    if (meter_count == MAX_JOBS) return NULL;
+    Meter *m = calloc(1, sizeof(Meter));
+    if (m) {
+        m->stage = calloc(nstages, sizeof(MeterStage));
+        m->pipe = calloc(nstages, sizeof(MeterPipe));
+    }
+    if (!m || !m->stage || !m->pipe) {
+        if (m) { free(m->stage); free(m->pipe); free(m); }
+        return NULL;
+    }
+    m->n = nstages;
+    for (int i = 0; i < nstages; ++i) m->stage[i].dir = m->pipe[i].fd = -1;
+    m->start_us = m->last_us = trace_now_us();
+    if (!meter_count) next_sample_us = m->start_us + interval_ms() * 1000LL;
+    meters[meter_count++] = m;
+    return m;
+}
+
+/* The pipe after stage i; fd is either of its ends. */
+void meter_pipe(Meter *m, int i, int fd) {
+    if (!m || i < 0 || i >= m->n - 1) return;
+    char path[32];
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+    m->pipe[i].fd = open(path, O_PATH | O_CLOEXEC);
+    m->pipe[i].size = fcntl(fd, F_GETPIPE_SZ);
+}
+
+void meter_stage(Meter *m, int i, pid_t pid, pid_t pgid, const char *name) {
+    if (!m || i < 0 || i >= m->n) return;
+    char path[32];
+    snprintf(path, sizeof(path), "/proc/%d", (int)pid);
+    m->pgid = pgid;
+    m->stage[i].pid = pid;
+    m->stage[i].dir = open(path, O_PATH | O_DIRECTORY | O_CLOEXEC);
+    snprintf(m->stage[i].name, sizeof(m->stage[i].name), "%s", name ? name : "?");
+}
+
+void meter_cancel(Meter *m) {
+    if (!m) return;
+    for (int i = 0; i < m->n; ++i) {
+        if (m->stage[i].dir >= 0) close(m->stage[i].dir);
+        if (m->pipe[i].fd >= 0) close(m->pipe[i].fd);
+    }
+    for (int i = 0; i < meter_count; ++i) {
+        if (meters[i] == m) { meters[i] = meters[--meter_count]; break; }
+    }
+    free(m->stage);
+    free(m->pipe);
+    free(m);
+}
+
+void meter_end(pid_t pgid) { meter_cancel(find_meter(pgid)); }
+
+static void read_io(MeterStage *s) {
+    if (s->dir < 0) return;
+    char buf[512], *p;
+    int fd = openat(s->dir, "io", O_RDONLY | O_CLOEXEC);
+    ssize_t len = fd >= 0 ? read(fd, buf, sizeof(buf) - 1) : -1;
+    if (fd >= 0) close(fd);
+    if (len <= 0) { close(s->dir); s->dir = -1; return; }     /* reaped */
+    buf[len] = '\0';
+    if ((p = strstr(buf, "rchar:"))) s->rchar = atoll(p + 6);
+    if ((p = strstr(buf, "wchar:"))) s->wchar = atoll(p + 6);
+}
+
+static int max_pipe_size(void) {
+    if (!pipe_max) {
+        FILE *f = fopen("/proc/sys/fs/pipe-max-size", "re");
+        if (!f || fscanf(f, "%d", &pipe_max) != 1 || pipe_max <= 0) pipe_max = 1 << 20;
+        if (f) fclose(f);
+    }
+    return pipe_max;
+}
+
+static void sample_pipe(MeterPipe *p, long long dt) {
+    char path[32];
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", p->fd);
+    int fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) return;
+    int fill = 0, size = fcntl(fd, F_GETPIPE_SZ);
+    if (size > 0 && ioctl(fd, FIONREAD, &fill) == 0) {
+        int full = fill >= size - size / 16;        /* within one slot of it */
+        p->size = size;
+        p->fill = fill;
+        p->recent = p->recent << 1 | (unsigned)full;
+        if (full) p->full_us += dt;
+        else if (fill == 0) p->empty_us += dt;
+        if (__builtin_popcount(p->recent & 0xf) >= 3 && size < max_pipe_size()) {
+            int want = size * 2 < max_pipe_size() ? size * 2 : max_pipe_size();
+            int got = fcntl(fd, F_SETPIPE_SZ, want);
+            if (got > 0) { p->size = got; ++p->grown; }
+            p->recent = 0;
+        }
+    }
+    close(fd);
+}
+
+static void sample(Meter *m) {
+    long long now = trace_now_us(), dt = now - m->last_us;
+    m->last_us = now;
+    for (int i = 0; i < m->n; ++i) read_io(&m->stage[i]);
+    for (int i = 0; i + 1 < m->n; ++i) {
+        MeterPipe *p = &m->pipe[i];
+        if (p->fd < 0) continue;
+        if (m->stage[i].dir < 0) { close(p->fd); p->fd = -1; continue; }
+        sample_pipe(p, dt);
+    }
+}
+
+/* Sample every metered job if it is time to. */
+void meter_tick(void) {
+    long long now = trace_now_us();
+    if (!meter_count || now < next_sample_us) return;
+    for (int i = 0; i < meter_count; ++i) sample(meters[i]);
+    next_sample_us = now + interval_ms() * 1000LL;
+}
+
+/* Milliseconds until meter_tick has work, or -1 when nothing is metered. */
+int meter_timeout(void) {
+    if (!meter_count) return -1;
+    long long left = next_sample_us - trace_now_us();
+    return left <= 0 ? 0 : (int)((left + 999) / 1000);
+}
+
+/* One line per stage: bytes written and the rate since the start, time spent
+ * blocked on a full output pipe and starved on an empty input pipe. */
+void meter_print(pid_t pgid) {
+    Meter *m = find_meter(pgid);
+    if (!m) return;
+    sample(m);
+    double secs = (m->last_us - m->start_us) / 1e6;
+    for (int i = 0; i < m->n; ++i) {
+        const MeterStage *s = &m->stage[i];
+        double mb = s->wchar / 1048576.0;
+        printf("    %d %-7d %-12s out %9.1fM %8.1fM/s", i + 1, (int)s->pid, s->name, mb, secs > 0 ? mb / secs : 0.0);
+        if (i > 0) printf("  starved %6.2fs", m->pipe[i - 1].empty_us / 1e6);
+        if (i + 1 < m->n) {
+            const MeterPipe *p = &m->pipe[i];
+            printf("  blocked %6.2fs  pipe %d/%dK", p->full_us / 1e6, p->fill / 1024, p->size / 1024);
+            if (p->grown) printf(" (grown %dx)", p->grown);
+        }
+        printf("\n");
+    }
+}
@@ -0,0 +1,156 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "shell.h"
+
+void free_command(Command *cmd) {
+    while (cmd) {
+        Command *n = cmd->next;
+        free(cmd);
+        cmd = n;
+    }
+}
+
+/* Pack one pipeline stage into a single right-sized allocation. */
+static Command *build_command(const char **argv, int argc, const char *in, const char *out, int append, int replace) {
+    size_t text = 0;
+    for (int i = 0; i < argc; ++i) text += strlen(argv[i]) + 1;
+    if (in) text += strlen(in) + 1;
+    if (out) text += strlen(out) + 1;
+    Command *cmd = malloc(sizeof(Command) + (argc + 1) * sizeof(char*) + text);
+    if (!cmd) return NULL;
+    cmd->args = (char **)(cmd + 1);
+    char *dst = (char *)(cmd->args + argc + 1);
+    for (int i = 0; i < argc; ++i) {
+        size_t len = strlen(argv[i]) + 1;
+        cmd->args[i] = memcpy(dst, argv[i], len);
+        dst += len;
+    }
+    cmd->args[argc] = NULL;
+    cmd->argc = argc;
+    cmd->name = argc ? cmd->args[0] : NULL;
+    cmd->input_file = in ? strcpy(dst, in) : NULL;
+    if (in) dst += strlen(in) + 1;
+    cmd->output_file = out ? strcpy(dst, out) : NULL;
+    cmd->append = append;
+    cmd->replace = replace;
+    cmd->shards = 0;
+    cmd->shard_unordered = 0;
+    cmd->next = NULL;
+    return cmd;
+}
+
+Command *parse_input(const char *rawline) {
+    if (!rawline) return NULL;
+    int tcount = 0;
+    char **tokens = tokenize_line(rawline, &tcount);
+    if (!tokens) return NULL;
+
+    /* words is a view over tokens (and the alias expansion, if any); the strings
+     * stay owned by the token blocks. */
+    char **words = tokens;
+    char **alias_tokens = NULL;
+    if (tcount > 0) {
+        const char *alias_cmd = check_alias(tokens[0]);
+        if (alias_cmd) {
+            int acount = 0;
+            alias_tokens = tokenize_line(alias_cmd, &acount);
+            words = malloc((acount + tcount) * sizeof(char*));
+            if (!alias_tokens || !words) { free(words); free_tokens(alias_tokens); free_tokens(tokens); return NULL; }
+            int idx = 0;
+            for (int i = 0; i < acount; ++i) words[idx++] = alias_tokens[i];
+            for (int i = 1; i < tcount; ++i) words[idx++] = tokens[i];
+            words[idx] = NULL;
+            tcount = idx;
+        }
+    }
+
+    /* argv is a scratch view of the current stage; it is copied into the
+     * Command when the stage ends. Glob/brace results it points at are kept in
+     * expansions until then. */
+    int argcap = tcount + 1;
+    const char **argv = malloc(argcap * sizeof(char*));
+    char ***expansions = NULL;
+    int nexpansions = 0, expcap = 0;
+    Command *head = NULL;
+    Command *tail = NULL;
+    int argc = 0, append = 0, replace = 0, open_stage = 0, shards = 0, unordered = 0;
+    const char *in = NULL, *out = NULL;
+    int i = 0;
+    while (argv && i <= tcount) {
+        char *tok = i < tcount ? words[i] : NULL;
+        int quoted = tok && token_quoted(tok);
+        if (tok) open_stage = 1;
+        if (!tok || (!quoted && tok[0] == '|')) {
+            if (open_stage) {
+                Command *cmd = build_command(argv, argc, in, out, append, replace);
+                if (!cmd) { fprintf(stderr,"out of memory\n"); break; }
+                cmd->shards = shards;
+                cmd->shard_unordered = unordered;
+                if (!head) head = cmd; else tail->next = cmd;
+                tail = cmd;
+            }
+            argc = 0; append = 0; replace = 0; in = out = NULL; open_stage = 0;
+            shards = tok ? atoi(tok + 1) : 0;   /* "|N>": the next stage, N times */
+            unordered = tok && strchr(tok, 'u') != NULL;
+            if (shards > SHARD_MAX) { fprintf(stderr,"warning: |%d> clamped to %d shards\n", shards, SHARD_MAX); shards = SHARD_MAX; }
+            if (shards < 2) shards = 0;
+            while (nexpansions) free_tokens(expansions[--nexpansions]);
+            ++i; continue;
+        } else if (!quoted && strcmp(tok, "<") == 0) {
+            ++i;
+            if (i >= tcount) { fprintf(stderr,"syntax error: expected filename after '<'\n"); tcount = i; continue; }
+            in = words[i];
+            ++i; continue;
+        } else if (!quoted && (strcmp(tok, ">") == 0 || strcmp(tok, ">>") == 0 || strcmp(tok, ">!") == 0)) {
+            int is_append = (strcmp(tok, ">>") == 0);
+            ++i;
+            if (i >= tcount) { fprintf(stderr,"syntax error: expected filename after '%s'\n", tok); tcount = i; continue; }
+            out = words[i];
+            append = is_append;
+            replace = tok[1] == '!';
+            ++i; continue;
+        } else {
+            const char *arg = tok;
+            char **expanded = NULL;
+            int nexp = 0;
+            if (token_quote_char(tok) != '\'' && has_subst(tok)) {
+                expanded = subst_word(tok, quoted, &nexp);
+                if (!expanded) { ++i; continue; }
+            } else if (arg[0] == '$' && arg[1] != '(') {
+                const char *val = getenv(arg + 1);
+                arg = val ? val : "";
+            } else if (!quoted) {
+                expanded = expand_word(arg, &nexp);
+            }
+            if (expanded && nexpansions == expcap) {
+                expcap = expcap ? expcap * 2 : 4;
+                char ***tmp = realloc(expansions, expcap * sizeof(char**));
+                if (!tmp) { free_tokens(expanded); fprintf(stderr,"out of memory\n"); break; }
+                expansions = tmp;
+            }
+            if (argc + nexp + 1 > argcap) {
+                argcap = (argc + nexp + 1) * 2;
+                const char **tmp = realloc(argv, argcap * sizeof(char*));
+                if (!tmp) { free_tokens(expanded); fprintf(stderr,"out of memory\n"); break; }
+                argv = tmp;
+            }
+            if (expanded) {
+                for (int k = 0; k < nexp; ++k) argv[argc++] = expanded[k];
+                expansions[nexpansions++] = expanded;
+            } else {
+                argv[argc++] = arg;
+            }
+            ++i; continue;
+        }
+    }
+
+    while (nexpansions) free_tokens(expansions[--nexpansions]);
+    free(expansions);
+    free(argv);
+    if (words != tokens) free(words);
+    free_tokens(alias_tokens);
+    free_tokens(tokens);
+    return head;
+}
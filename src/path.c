@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+
+#include "shell.h"
+
+/* Resolved commands are cached per name, like sh's "hash". A hit costs one
+ * access() to confirm the file is still there instead of a probe per PATH
+ * entry; the whole cache is dropped when PATH changes. */
+
+#define PATH_CACHE_BUCKETS 1024
+
+typedef struct PathEntry {
+    struct PathEntry *next;
+    char *full;
+    char name[];
+} PathEntry;
+
+static PathEntry *path_cache[PATH_CACHE_BUCKETS];
+static char *cached_path = NULL;    /* the PATH the cache was built for */
+static int path_cached_count = 0;
+
+static unsigned path_hash(const char *s) {
+    unsigned h = 2166136261u;
+    for (; *s; ++s) { h ^= (unsigned char)*s; h *= 16777619u; }
+    return h & (PATH_CACHE_BUCKETS - 1);
+}
+
+void path_cache_clear(void) {
+    for (int i = 0; i < PATH_CACHE_BUCKETS; ++i) {
+        while (path_cache[i]) {
+            PathEntry *e = path_cache[i];
+            path_cache[i] = e->next;
+            free(e->full);
+            free(e);
+        }
+    }
+    free(cached_path);
+    cached_path = NULL;
+    path_cached_count = 0;
+}
+
+/* Drop the cache if PATH is not what it was built for. */
+static void path_cache_check(const char *pathenv) {
+    if (cached_path && strcmp(cached_path, pathenv) == 0) return;
+    path_cache_clear();
+    cached_path = strdup(pathenv);
+}
+
+static PathEntry **path_cache_slot(const char *cmd) {
+    PathEntry **pp = &path_cache[path_hash(cmd)];
+    while (*pp && strcmp((*pp)->name, cmd) != 0) pp = &(*pp)->next;
+    return pp;
+}
+
+static void path_cache_put(const char *cmd, const char *full) {
+    size_t len = strlen(cmd) + 1;
+    PathEntry *e = malloc(sizeof(PathEntry) + len);
+    if (!e) return;
+    e->full = strdup(full);
+    if (!e->full) { free(e); return; }
+    memcpy(e->name, cmd, len);
+    PathEntry **slot = &path_cache[path_hash(cmd)];
+    e->next = *slot;
+    *slot = e;
+    ++path_cached_count;
+}
+
+char *find_command_in_path(const char *cmd) {
+    if (!cmd || *cmd == '\0') return NULL;
+    if (cmd[0] == '/' || cmd[0] == '.') {
+        if (access(cmd, X_OK) == 0) return strdup(cmd);
+        return NULL;
+    }
+    const char *pathenv = getenv("PATH");
+    if (!pathenv) return NULL;
+    path_cache_check(pathenv);
+    PathEntry **slot = path_cache_slot(cmd);
+    if (*slot) {
+        if (access((*slot)->full, X_OK) == 0) return strdup((*slot)->full);
+        PathEntry *stale = *slot;           /* moved or removed: look again */
+        *slot = stale->next;
+        free(stale->full);
+        free(stale);
+        --path_cached_count;
+    }
+    const char *snapped = rc_cached_path(cmd, pathenv);
+    if (snapped && access(snapped, X_OK) == 0) {
+        path_cache_put(cmd, snapped);
+        return strdup(snapped);
+    }
+    char *pathdup = strdup(pathenv);
+    if (!pathdup) return NULL;
+    char full[PATH_BUF];
+    char *saveptr = NULL;
+    char *dir = strtok_r(pathdup, ":", &saveptr);
+    while (dir) {
+        snprintf(full, sizeof(full), "%s/%s", dir, cmd);
+        if (access(full, X_OK) == 0) {
+            free(pathdup);
+            path_cache_put(cmd, full);
+            return strdup(full);
+        }
+        dir = strtok_r(NULL, ":", &saveptr);
+    }
+    free(pathdup);
+    return NULL;
+}
+
+/* Fill the cache with every executable on PATH, first match winning, so
+ * processes forked from this one never pay for a cold lookup. */
+void path_cache_prewarm(void) {
+    const char *pathenv = getenv("PATH");
+    if (!pathenv) return;
+    path_cache_check(pathenv);
+    char *pathdup = strdup(pathenv);
+    if (!pathdup) return;
+    char *saveptr = NULL, full[PATH_BUF];
+    for (char *dir = strtok_r(pathdup, ":", &saveptr); dir; dir = strtok_r(NULL, ":", &saveptr)) {
+        DIR *d = opendir(dir);
+        if (!d) continue;
+        struct dirent *e;
+        while ((e = readdir(d))) {
+            if (e->d_name[0] == '.' || *path_cache_slot(e->d_name)) continue;
+            snprintf(full, sizeof(full), "%s/%s", dir, e->d_name);
+            if (access(full, X_OK) == 0) path_cache_put(e->d_name, full);
+        }
+        closedir(d);
+    }
+    free(pathdup);
+}
+
+/* Remember where someone else (the prewarm child) found cmd. */
+void path_cache_add(const char *cmd, const char *full) {
+    const char *pathenv = getenv("PATH");
+    if (!pathenv) return;
+    path_cache_check(pathenv);
+    if (!*path_cache_slot(cmd)) path_cache_put(cmd, full);
+}
+
+/* Call fn for every cached command; returns how many there are. */
+int path_cache_each(void (*fn)(const char *name, const char *full, void *arg), void *arg) {
+    for (int i = 0; fn && i < PATH_CACHE_BUCKETS; ++i) {
+        for (PathEntry *e = path_cache[i]; e; e = e->next) fn(e->name, e->full, arg);
+    }
+    return path_cached_count;
+}
+
+/* hash [-r]: list or forget remembered command locations. */
+int handle_hash(Command *cmd) {
+    if (!cmd || !cmd->name || strcmp(cmd->name, "hash") != 0) return 0;
+    if (cmd->args[1] && strcmp(cmd->args[1], "-r") == 0) { path_cache_clear(); rc_forget_paths(); return 1; }
+    for (int i = 0; i < PATH_CACHE_BUCKETS; ++i) {
+        for (PathEntry *e = path_cache[i]; e; e = e->next) printf("%s\t%s\n", e->name, e->full);
+    }
+    return 1;
+}
@@ -0,0 +1,423 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <glob.h>
+#include <link.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include "shell.h"
+
+/* Predictive warm-up. The commands in history are ranked by frecency (each use
+ * counts for less the further back it is, halving every PREWARM_HALF_LIFE
+ * commands), and the top $CSHELL_PREWARM of them (default 16, 0 disables) are
+ * resolved on PATH and their binaries, ELF interpreter and shared libraries
+ * read ahead into the page cache. That runs in a child at idle cpu and io
+ * priority, once at startup and again when the prompt has sat idle for
+ * $CSHELL_PREWARM_IDLE seconds (default 600, 0 disables), since the cache may
+ * have been evicted by then. The child hands the paths it resolved back over
+ * a pipe, which the event loop drains into the shell's PATH cache, so the
+ * first run of a warmed command costs neither a PATH probe nor disk reads. */
+
+#define PREWARM_DEFAULT 16
+#define PREWARM_MAX 64
+#define PREWARM_HALF_LIFE 50
+#define PREWARM_IDLE_DEFAULT 600
+#define PREWARM_MAX_FILES 256
+
+typedef struct Rank {
+    char name[64];
+    double score;
+} Rank;
+
+/* One warm-up pass: what it has touched so far and where libraries live. */
+typedef struct Warm {
+    struct { dev_t dev; ino_t ino; } seen[PREWARM_MAX_FILES];
+    int files;
+    long long bytes;
+    int advice;             /* POSIX_FADV_WILLNEED, or DONTNEED to evict */
+    int verbose;
+    char **libdirs;
+    int nlibdirs;
+} Warm;
+
+static int warm_fd = -1;            /* results from the running warm-up child */
+static char *warm_path = NULL;      /* the PATH it resolved against */
+static char warm_buf[4096];
+static size_t warm_len = 0;
+static long long last_activity_ms = 0;
+static int idle_fired = 0;
+
+static const char *const builtin_names[] = {
+    "cd", "exit", "pwd", "history", "jobs", "alias", "set", "fg", "bg", "vfs", "schedule",
+    "limit", "pin", "dag", "after", "wait", "hash", "memo", "prewarm",
+    "coproc", NULL
+};
+
+/* Words that run the command after them. */
+static const char *const prefix_names[] = { "memo", "pin", "timeout", "prealloc", "after", "limit", "nice", "nohup", "time", "env", "exec", NULL };
+
+static int in_list(const char *const *list, const char *w) {
+    for (; *list; ++list) if (strcmp(*list, w) == 0) return 1;
+    return 0;
+}
+
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int env_int(const char *name, int dflt) {
+    const char *v = getenv(name);
+    return v && *v ? atoi(v) : dflt;
+}
+
+static void add_score(Rank *r, int *n, int max, const char *w, size_t len, double weight) {
+    if (len == 0 || len >= sizeof(r->name)) return;
+    for (int i = 0; i < *n; ++i) {
+        if (strncmp(r[i].name, w, len) == 0 && r[i].name[len] == '\0') { r[i].score += weight; return; }
+    }
+    if (*n == max) return;
+    memcpy(r[*n].name, w, len);
+    r[*n].name[len] = '\0';
+    r[(*n)++].score = weight;
+}
+
+/* Credit every command a history line runs: the first word of each pipeline
+ * stage or list element, past prefixes like "memo" and their options, with
+ * one level of aliases followed. Anything that isn't a plain name is left
+ * out. */
+static void score_line(Rank *r, int *n, int max, const char *line, double weight, int depth) {
+    const char *s = line;
+    while (*s) {
+        int prefixed = 0;
+        for (;;) {
+            s += strspn(s, " \t");
+            size_t len = strcspn(s, " \t|;&<>()`'\"");
+            char word[64];
+            if (len == 0 || len >= sizeof(word)) break;
+            memcpy(word, s, len);
+            word[len] = '\0';
+            if (prefixed && (word[0] == '-' || word[0] == '%' || (word[0] >= '0' && word[0] <= '9') || strchr(word, '='))) { s += len; continue; }
+            if (in_list(prefix_names, word)) { prefixed = 1; s += len; continue; }
+            const char *alias = depth == 0 ? check_alias(word) : NULL;
+            if (alias) score_line(r, n, max, alias, weight, 1);
+            else if (!strpbrk(word, "/=$*?[{~") && !in_list(builtin_names, word)) add_score(r, n, max, word, len, weight);
+            break;
+        }
+        /* on to the next stage or list element */
+        char quote = 0;
+        for (; *s; ++s) {
+            if (quote) { if (*s == quote) quote = 0; continue; }
+            if (*s == '\'' || *s == '"') quote = *s;
+            else if (*s == '|' || *s == ';' || *s == '&') break;
+        }
+        s += strspn(s, "|;&");
+    }
+}
+
+static int by_score(const void *a, const void *b) {
+    const Rank *x = a, *y = b;
+    return (x->score < y->score) - (x->score > y->score);
+}
+
+/* The top max commands in history by frecency, best first. */
+static int rank_commands(Rank *top, int max) {
+    int n = 0, cap = HISTORY_SIZE * 2;
+    Rank *all = malloc(cap * sizeof(Rank));
+    if (!all) return 0;
+    const double decay = 0.986233;      /* 0.5 ^ (1 / PREWARM_HALF_LIFE) */
+    double w = 1;
+    for (int i = history_count - 1; i >= 0; --i, w *= decay) score_line(all, &n, cap, history[i], w, 0);
+    qsort(all, n, sizeof(Rank), by_score);
+    if (n > max) n = max;
+    memcpy(top, all, n * sizeof(Rank));
+    free(all);
+    return n;
+}
+
+/* The directories the dynamic linker searches by default: ld.so.conf (and
+ * what it includes) plus the built-in ones. */
+static void add_libdir(Warm *w, const char *dir) {
+    for (int i = 0; i < w->nlibdirs; ++i) if (strcmp(w->libdirs[i], dir) == 0) return;
+    char **tmp = realloc(w->libdirs, (w->nlibdirs + 1) * sizeof(char *));
+    if (!tmp) return;
+    w->libdirs = tmp;
+    if ((w->libdirs[w->nlibdirs] = strdup(dir))) ++w->nlibdirs;
+}
+
+static void read_ld_conf(Warm *w, const char *path, int depth) {
+    FILE *f = depth < 4 ? fopen(path, "re") : NULL;
+    if (!f) return;
+    char line[PATH_BUF];
+    while (fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "#\n")] = '\0';
+        char *s = line + strspn(line, " \t");
+        s[strcspn(s, " \t")] = '\0';
+        if (strcmp(s, "include") == 0) {
+            char *pat = s + strlen(s) + 1;
+            pat += strspn(pat, " \t");
+            pat[strcspn(pat, " \t")] = '\0';
+            glob_t g;
+            if (*pat && glob(pat, 0, NULL, &g) == 0) {
+                for (size_t i = 0; i < g.gl_pathc; ++i) read_ld_conf(w, g.gl_pathv[i], depth + 1);
+                globfree(&g);
+            }
+        } else if (s[0] == '/') {
+            add_libdir(w, s);
+        }
+    }
+    fclose(f);
+}
+
+static void warm_file(Warm *w, const char *path);
+
+static const char *elf_str(const char *map, size_t size, size_t off) {
+    return off < size && memchr(map + off, '\0', size - off) ? map + off : NULL;
+}
+
+/* File offset of virtual address addr, through the PT_LOAD headers. */
+static size_t elf_offset(const ElfW(Phdr) *ph, int n, ElfW(Addr) addr) {
+    for (int i = 0; i < n; ++i) {
+        if (ph[i].p_type == PT_LOAD && addr >= ph[i].p_vaddr && addr < ph[i].p_vaddr + ph[i].p_filesz)
+            return addr - ph[i].p_vaddr + ph[i].p_offset;
+    }
+    return (size_t)-1;
+}
+
+static void warm_library(Warm *w, const char *name, const char *runpath, const char *origin) {
+    char full[2 * PATH_BUF];
+    if (strchr(name, '/')) { warm_file(w, name); return; }
+    const char *lists[2] = { runpath, getenv("LD_LIBRARY_PATH") };
+    for (int l = 0; l < 2; ++l) {
+        for (const char *s = lists[l]; s && *s; s += strspn(s, ":")) {
+            size_t len = strcspn(s, ":");
+            if (strncmp(s, "$ORIGIN", 7) == 0) snprintf(full, sizeof(full), "%s%.*s/%s", origin, (int)len - 7, s + 7, name);
+            else snprintf(full, sizeof(full), "%.*s/%s", (int)len, s, name);
+            s += len;
+            if (access(full, R_OK) == 0) { warm_file(w, full); return; }
+        }
+    }
+    for (int i = 0; i < w->nlibdirs; ++i) {
+        snprintf(full, sizeof(full), "%s/%s", w->libdirs[i], name);
+        if (access(full, R_OK) == 0) { warm_file(w, full); return; }
+    }
+}
+
+/* A script's interpreter, through "#!/usr/bin/env NAME" too. */
+static void warm_script_interp(Warm *w, const char *map, size_t size) {
+    char line[PATH_BUF];
+    size_t len = 0;
+    while (len + 2 < size && len < sizeof(line) - 1 && map[len + 2] != '\n') { line[len] = map[len + 2]; ++len; }
+    line[len] = '\0';
+    char *save = NULL, *interp = strtok_r(line, " \t", &save), *arg = strtok_r(NULL, " \t", &save);
+    if (!interp) return;
+    warm_file(w, interp);
+    char *full = arg && strcmp(interp, "/usr/bin/env") == 0 ? find_command_in_path(arg) : NULL;
+    if (full) warm_file(w, full);
+    free(full);
+}
+
+/* Warm what a file loads: for ELF, its interpreter and DT_NEEDED libraries. */
+static void warm_elf_deps(Warm *w, const char *path, const char *map, size_t size) {
+    if (size > 2 && map[0] == '#' && map[1] == '!') { warm_script_interp(w, map, size); return; }
+    const ElfW(Ehdr) *eh = (const ElfW(Ehdr) *)map;
+    if (size < sizeof(*eh) || memcmp(eh->e_ident, ELFMAG, SELFMAG) != 0 || eh->e_ident[EI_CLASS] != (sizeof(void *) == 8 ? ELFCLASS64 : ELFCLASS32)) return;
+    if (eh->e_phentsize != sizeof(ElfW(Phdr)) || eh->e_phoff > size || eh->e_phnum > (size - eh->e_phoff) / sizeof(ElfW(Phdr))) return;
+    const ElfW(Phdr) *ph = (const ElfW(Phdr) *)(map + eh->e_phoff);
+    const ElfW(Dyn) *dyn = NULL;
+    size_t ndyn = 0;
+    for (int i = 0; i < eh->e_phnum; ++i) {
+        if (ph[i].p_type == PT_INTERP) {
+            const char *interp = elf_str(map, size, ph[i].p_offset);
+            if (interp) warm_file(w, interp);
+        } else if (ph[i].p_type == PT_DYNAMIC && ph[i].p_offset < size) {
+            dyn = (const ElfW(Dyn) *)(map + ph[i].p_offset);
+            ndyn = (size - ph[i].p_offset < ph[i].p_filesz ? size - ph[i].p_offset : ph[i].p_filesz) / sizeof(ElfW(Dyn));
+        }
+    }
+    if (!dyn) return;
+    size_t strtab = (size_t)-1, runpath = (size_t)-1;
+    for (size_t i = 0; i < ndyn && dyn[i].d_tag != DT_NULL; ++i) {
+        if (dyn[i].d_tag == DT_STRTAB) strtab = elf_offset(ph, eh->e_phnum, dyn[i].d_un.d_ptr);
+        else if (dyn[i].d_tag == DT_RUNPATH || (dyn[i].d_tag == DT_RPATH && runpath == (size_t)-1)) runpath = dyn[i].d_un.d_val;
+    }
+    if (strtab >= size) return;
+    char origin[PATH_BUF];
+    snprintf(origin, sizeof(origin), "%s", path);
+    char *slash = strrchr(origin, '/');
+    if (slash) *slash = '\0';
+    const char *rp = runpath != (size_t)-1 ? elf_str(map, size, strtab + runpath) : NULL;
+    for (size_t i = 0; i < ndyn && dyn[i].d_tag != DT_NULL; ++i) {
+        if (dyn[i].d_tag != DT_NEEDED) continue;
+        const char *lib = elf_str(map, size, strtab + dyn[i].d_un.d_val);
+        if (lib) warm_library(w, lib, rp, origin);
+    }
+}
+
+static void warm_file(Warm *w, const char *path) {
+    if (w->files == PREWARM_MAX_FILES) return;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) { close(fd); return; }
+    for (int i = 0; i < w->files; ++i) {
+        if (w->seen[i].dev == st.st_dev && w->seen[i].ino == st.st_ino) { close(fd); return; }
+    }
+    w->seen[w->files].dev = st.st_dev;
+    w->seen[w->files].ino = st.st_ino;
+    ++w->files;
+    w->bytes += st.st_size;
+    if (w->verbose) printf("prewarm: %s (%lld KiB)\n", path, (long long)st.st_size / 1024);
+    if (w->advice != POSIX_FADV_WILLNEED || readahead(fd, 0, (size_t)st.st_size) != 0)
+        posix_fadvise(fd, 0, 0, w->advice);
+    void *map = st.st_size ? mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (map == MAP_FAILED) return;
+    warm_elf_deps(w, path, map, (size_t)st.st_size);
+    munmap(map, (size_t)st.st_size);
+}
+
+static void warm_init(Warm *w, int advice, int verbose) {
+    memset(w, 0, sizeof(*w));
+    w->advice = advice;
+    w->verbose = verbose;
+    read_ld_conf(w, "/etc/ld.so.conf", 0);
+    static const char *const defaults[] = { "/lib64", "/usr/lib64", "/lib", "/usr/lib", NULL };
+    for (int i = 0; defaults[i]; ++i) add_libdir(w, defaults[i]);
+}
+
+static void warm_free(Warm *w) {
+    for (int i = 0; i < w->nlibdirs; ++i) free(w->libdirs[i]);
+    free(w->libdirs);
+}
+
+/* Read the binary at path and everything it loads into the page cache (or,
+ * with POSIX_FADV_DONTNEED, drop them from it). Returns the number of files. */
+int prewarm_binary(const char *path, int advice, int verbose) {
+    Warm w;
+    warm_init(&w, advice, verbose);
+    warm_file(&w, path);
+    warm_free(&w);
+    return w.files;
+}
+
+/* Resolve and warm the ranked commands; each resolved "name\tpath" line goes
+ * to out_fd if that is >= 0. */
+static void warm_commands(const Rank *top, int n, int out_fd, Warm *w) {
+    for (int i = 0; i < n; ++i) {
+        char *full = find_command_in_path(top[i].name);
+        if (!full) continue;
+        if (out_fd >= 0) dprintf(out_fd, "%s\t%s\n", top[i].name, full);
+        warm_file(w, full);
+        free(full);
+    }
+}
+
+void prewarm_start(void) {
+    int max = env_int("CSHELL_PREWARM", PREWARM_DEFAULT);
+    if (warm_fd >= 0 || max <= 0 || !getenv("PATH")) return;
+    if (max > PREWARM_MAX) max = PREWARM_MAX;
+    Rank top[PREWARM_MAX];
+    int n = rank_commands(top, max);
+    if (n == 0) return;
+    int p[2];
+    if (pipe2(p, O_CLOEXEC) < 0) return;
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(p[0]);
+        setpgid(0, 0);
+        signal(SIGINT, SIG_IGN);
+        signal(SIGTSTP, SIG_IGN);
+        signal(SIGQUIT, SIG_IGN);
+        setpriority(PRIO_PROCESS, 0, 19);
+        syscall(SYS_ioprio_set, 1 /* IOPRIO_WHO_PROCESS */, 0, 3 << 13 /* IOPRIO_CLASS_IDLE */);
+        Warm w;
+        warm_init(&w, POSIX_FADV_WILLNEED, 0);
+        warm_commands(top, n, p[1], &w);
+        _exit(0);
+    }
+    close(p[1]);
+    if (pid < 0) { close(p[0]); return; }
+    fcntl(p[0], F_SETFL, O_NONBLOCK);
+    warm_fd = p[0];
+    warm_len = 0;
+    free(warm_path);
+    warm_path = strdup(getenv("PATH"));
+}
+
+int prewarm_fd(void) {
+    return warm_fd;
+}
+
+/* Move what the warm-up child has resolved into the PATH cache. */
+void prewarm_collect(void) {
+    ssize_t n;
+    while (warm_fd >= 0 && (n = read(warm_fd, warm_buf + warm_len, sizeof(warm_buf) - 1 - warm_len)) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) return;
+            break;
+        }
+        warm_len += (size_t)n;
+        warm_buf[warm_len] = '\0';
+        char *line = warm_buf, *nl;
+        const char *path = getenv("PATH");
+        while ((nl = strchr(line, '\n'))) {
+            *nl = '\0';
+            char *tab = strchr(line, '\t');
+            if (tab && path && warm_path && strcmp(path, warm_path) == 0) { *tab = '\0'; path_cache_add(line, tab + 1); }
+            line = nl + 1;
+        }
+        warm_len -= (size_t)(line - warm_buf);
+        memmove(warm_buf, line, warm_len);
+        if (warm_len == sizeof(warm_buf) - 1) warm_len = 0;      /* no newline in sight: drop it */
+    }
+    close(warm_fd);
+    warm_fd = -1;
+}
+
+/* Milliseconds until the prompt counts as idle and gets another warm-up, or
+ * -1 for never. */
+int prewarm_timeout(void) {
+    int idle = env_int("CSHELL_PREWARM_IDLE", PREWARM_IDLE_DEFAULT);
+    if (idle <= 0 || idle_fired || warm_fd >= 0 || env_int("CSHELL_PREWARM", PREWARM_DEFAULT) <= 0) return -1;
+    if (!last_activity_ms) last_activity_ms = now_ms();
+    long long left = last_activity_ms + idle * 1000LL - now_ms();
+    return left < 0 ? 0 : left > 1 << 30 ? 1 << 30 : (int)left;
+}
+
+void prewarm_idle(void) {
+    idle_fired = 1;
+    prewarm_start();
+}
+
+void prewarm_activity(void) {
+    last_activity_ms = now_ms();
+    idle_fired = 0;
+}
+
+/* prewarm [-v]: warm the top commands now, in the foreground. */
+int handle_prewarm(Command *cmd) {
+    if (!cmd || !cmd->name || strcmp(cmd->name, "prewarm") != 0) return 0;
+    int verbose = cmd->args[1] && strcmp(cmd->args[1], "-v") == 0;
+    int max = env_int("CSHELL_PREWARM", PREWARM_DEFAULT);
+    Rank top[PREWARM_MAX];
+    int n = rank_commands(top, max <= 0 ? PREWARM_DEFAULT : max > PREWARM_MAX ? PREWARM_MAX : max);
+    Warm w;
+    warm_init(&w, POSIX_FADV_WILLNEED, verbose);
+    warm_commands(top, n, -1, &w);
+    warm_free(&w);
+    printf("prewarm: %d commands, %d files, %lld KiB\n", n, w.files, w.bytes / 1024);
+    return 1;
+}
@@ -0,0 +1,352 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "shell.h"
+
+/* Startup file and its compiled snapshot.
+ *
+ * ~/.cshellrc (or $CSHELL_RC; empty disables it) is run line by line at
+ * startup. When it only defines aliases and variables, the resulting state is
+ * also written to a snapshot ($CSHELL_RC_SNAPSHOT, default
+ * ~/.cache/cshell/rc.snap; empty disables it): hash tables of aliases,
+ * variables and a prewarmed command-path cache, all as offsets into one file.
+ * Later shells mmap that file and use it in place instead of re-running the rc;
+ * it is rebuilt when the rc file's inode, size or mtime differ from the ones
+ * recorded in it. Lines that do anything else (run commands, cd, ...), or
+ * whose words expand ($VAR, $(...), `...`, globs) and so may come out
+ * differently in the next shell, make the rc run in full every time, since
+ * their effects cannot be replayed. */
+
+#define SNAP_MAGIC "CSHSNAP1"
+
+typedef struct SnapHeader {
+    char magic[8];
+    uint64_t rc_ino, rc_size;
+    int64_t rc_mtime_sec, rc_mtime_nsec;
+    uint64_t file_size;
+    uint32_t alias_buckets, alias_table;    /* (name, command) offset pairs */
+    uint32_t var_buckets, var_table;        /* offsets of "NAME=value" */
+    uint32_t path_buckets, path_table;      /* (name, full path) offset pairs */
+    uint32_t path_env;                      /* the PATH the path table is for */
+} SnapHeader;
+
+static const char *snap = NULL;             /* mapped snapshot, never unmapped */
+static const SnapHeader *sh = NULL;
+static int snap_paths_dropped = 0;
+
+/* Offset 0 is the header, so it doubles as "empty bucket". */
+static const char *snap_str(uint32_t off) { return off && off < sh->file_size ? snap + off : NULL; }
+static const uint32_t *snap_table(uint32_t off) { return (const uint32_t *)(snap + off); }
+
+static uint32_t snap_hash(const char *s, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; ++i) { h ^= (unsigned char)s[i]; h *= 16777619u; }
+    return h;
+}
+
+/* Look key up in a table of (key, value) pairs; returns the value. */
+static const char *snap_pair_lookup(uint32_t buckets, uint32_t table, const char *key) {
+    if (!sh || buckets == 0) return NULL;
+    const uint32_t *t = snap_table(table);
+    size_t len = strlen(key);
+    for (uint32_t i = snap_hash(key, len) & (buckets - 1);; i = (i + 1) & (buckets - 1)) {
+        const char *k = snap_str(t[2 * i]);
+        if (!k) return NULL;
+        if (strcmp(k, key) == 0) return snap_str(t[2 * i + 1]);
+    }
+}
+
+/* The "NAME=value" entry for name, if the snapshot sets it. */
+static const char *snap_var(const char *name, size_t len) {
+    if (!sh || sh->var_buckets == 0) return NULL;
+    const uint32_t *t = snap_table(sh->var_table);
+    for (uint32_t i = snap_hash(name, len) & (sh->var_buckets - 1);; i = (i + 1) & (sh->var_buckets - 1)) {
+        const char *v = snap_str(t[i]);
+        if (!v) return NULL;
+        if (strncmp(v, name, len) == 0 && v[len] == '=') return v;
+    }
+}
+
+const char *rc_alias(const char *name) {
+    return snap_pair_lookup(sh ? sh->alias_buckets : 0, sh ? sh->alias_table : 0, name);
+}
+
+void rc_list_aliases(void) {
+    if (!sh) return;
+    const uint32_t *t = snap_table(sh->alias_table);
+    for (uint32_t i = 0; i < sh->alias_buckets; ++i) {
+        const char *name = snap_str(t[2 * i]);
+        if (!name) continue;
+        int shadowed = 0;
+        for (int a = 0; a < alias_count && !shadowed; ++a) shadowed = strcmp(aliases[a].name, name) == 0;
+        if (!shadowed) printf("alias %s=\"%s\"\n", name, snap_str(t[2 * i + 1]));
+    }
+}
+
+/* Where cmd was found when the snapshot was built, if PATH is still the same. */
+const char *rc_cached_path(const char *cmd, const char *pathenv) {
+    if (!sh || snap_paths_dropped) return NULL;
+    const char *built_for = snap_str(sh->path_env);
+    if (!built_for || strcmp(built_for, pathenv) != 0) return NULL;
+    return snap_pair_lookup(sh->path_buckets, sh->path_table, cmd);
+}
+
+void rc_forget_paths(void) { snap_paths_dropped = 1; }
+
+static int rc_path(char *out, size_t len) {
+    const char *rc = getenv("CSHELL_RC"), *home;
+    if (rc) { if (!*rc) return -1; snprintf(out, len, "%s", rc); return 0; }
+    if (!(home = getenv("HOME")) || !*home) return -1;
+    snprintf(out, len, "%s/.cshellrc", home);
+    return 0;
+}
+
+static int snap_path(char *out, size_t len) {
+    const char *p = getenv("CSHELL_RC_SNAPSHOT"), *base;
+    if (p) { if (!*p) return -1; snprintf(out, len, "%s", p); return 0; }
+    if ((base = getenv("XDG_CACHE_HOME")) && *base) snprintf(out, len, "%s/cshell/rc.snap", base);
+    else if ((base = getenv("HOME")) && *base) snprintf(out, len, "%s/.cache/cshell/rc.snap", base);
+    else return -1;
+    return 0;
+}
+
+static int snap_matches(const SnapHeader *h, const struct stat *rc) {
+    return (uint64_t)rc->st_ino == h->rc_ino && (uint64_t)rc->st_size == h->rc_size &&
+           rc->st_mtim.tv_sec == h->rc_mtime_sec && rc->st_mtim.tv_nsec == h->rc_mtime_nsec;
+}
+
+static int table_ok(uint32_t buckets, uint32_t off, size_t entry, size_t size) {
+    if (buckets & (buckets - 1)) return 0;
+    return (off % sizeof(uint32_t)) == 0 && off >= sizeof(SnapHeader) && (uint64_t)off + (uint64_t)buckets * entry <= size;
+}
+
+/* Put the snapshot's variables into the environment in one go: keep the
+ * inherited entries it doesn't override, then point at its strings. */
+static void snap_apply_vars(void) {
+    extern char **environ;
+    if (sh->var_buckets == 0) return;
+    size_t n = 0, k = 0;
+    while (environ[n]) ++n;
+    char **env = malloc((n + sh->var_buckets + 1) * sizeof(char *));
+    if (!env) return;
+    for (size_t i = 0; i < n; ++i) {
+        const char *eq = strchr(environ[i], '=');
+        if (!eq || !snap_var(environ[i], (size_t)(eq - environ[i]))) env[k++] = environ[i];
+    }
+    const uint32_t *t = snap_table(sh->var_table);
+    for (uint32_t i = 0; i < sh->var_buckets; ++i) if (snap_str(t[i])) env[k++] = (char *)snap_str(t[i]);
+    env[k] = NULL;
+    environ = env;      /* setenv() copies the array before growing it */
+}
+
+/* Map a snapshot built for rc and start using it. Returns 0 on success. */
+static int snap_load(const char *path, const struct stat *rc) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size > sizeof(SnapHeader))
+        map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+    const SnapHeader *h = map;
+    size_t size = (size_t)st.st_size;
+    if (memcmp(h->magic, SNAP_MAGIC, 8) != 0 || h->file_size != size || ((const char *)map)[size - 1] != '\0' ||
+        !snap_matches(h, rc) || !table_ok(h->alias_buckets, h->alias_table, 8, size) ||
+        !table_ok(h->var_buckets, h->var_table, 4, size) || !table_ok(h->path_buckets, h->path_table, 8, size)) {
+        munmap(map, size);
+        return -1;
+    }
+    snap = map;
+    sh = h;
+    snap_apply_vars();
+    return 0;
+}
+
+/* Snapshot builder: tables up front, strings appended behind them. */
+typedef struct SnapBuf {
+    char *data;
+    size_t len, cap;
+    int failed;
+} SnapBuf;
+
+/* Room for n more bytes, zero-filled. */
+static int buf_grow(SnapBuf *b, size_t n) {
+    if (b->len + n <= b->cap) return 0;
+    size_t ncap = b->cap * 2 > b->len + n ? b->cap * 2 : b->len + n;
+    char *tmp = realloc(b->data, ncap);
+    if (!tmp) { b->failed = 1; return -1; }
+    memset(tmp + b->cap, 0, ncap - b->cap);
+    b->data = tmp;
+    b->cap = ncap;
+    return 0;
+}
+
+static uint32_t buf_str(SnapBuf *b, const char *s, size_t len) {
+    if (buf_grow(b, len + 1) != 0) return 0;
+    uint32_t off = (uint32_t)b->len;
+    memcpy(b->data + b->len, s, len);
+    b->data[b->len + len] = '\0';
+    b->len += len + 1;
+    return off;
+}
+
+static uint32_t table_size(size_t n) {
+    uint32_t b = 16;
+    while (b < 2 * n) b <<= 1;
+    return n ? b : 0;
+}
+
+/* Insert (or replace) key in a table of (key, value) pairs. */
+static void buf_pair_put(SnapBuf *b, uint32_t buckets, uint32_t table, const char *key, const char *val) {
+    size_t klen = strlen(key);
+    for (uint32_t i = snap_hash(key, klen) & (buckets - 1);; i = (i + 1) & (buckets - 1)) {
+        uint32_t *t = (uint32_t *)(b->data + table);
+        if (t[2 * i] && strcmp(b->data + t[2 * i], key) != 0) continue;
+        uint32_t koff = t[2 * i] ? t[2 * i] : buf_str(b, key, klen);
+        uint32_t voff = buf_str(b, val, strlen(val));
+        if (b->failed) return;
+        t = (uint32_t *)(b->data + table);
+        t[2 * i] = koff;
+        t[2 * i + 1] = voff;
+        return;
+    }
+}
+
+typedef struct PathDump { SnapBuf *b; uint32_t buckets, table; } PathDump;
+
+static void dump_path(const char *name, const char *full, void *arg) {
+    PathDump *d = arg;
+    buf_pair_put(d->b, d->buckets, d->table, name, full);
+}
+
+static void snap_write(const char *path, const struct stat *rc, char **vars, int nvars) {
+    path_cache_prewarm();
+    int npaths = path_cache_each(NULL, NULL);
+    SnapHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, SNAP_MAGIC, 8);
+    h.rc_ino = (uint64_t)rc->st_ino;
+    h.rc_size = (uint64_t)rc->st_size;
+    h.rc_mtime_sec = rc->st_mtim.tv_sec;
+    h.rc_mtime_nsec = rc->st_mtim.tv_nsec;
+    h.alias_buckets = table_size((size_t)alias_count);
+    h.var_buckets = table_size((size_t)nvars);
+    h.path_buckets = table_size((size_t)npaths);
+    h.alias_table = sizeof(SnapHeader);
+    h.var_table = h.alias_table + h.alias_buckets * 8;
+    h.path_table = h.var_table + h.var_buckets * 4;
+
+    SnapBuf b = { NULL, 0, 0, 0 };
+    if (buf_grow(&b, h.path_table + h.path_buckets * 8) == 0) b.len = h.path_table + h.path_buckets * 8;
+    for (int i = 0; i < alias_count && !b.failed; ++i)
+        buf_pair_put(&b, h.alias_buckets, h.alias_table, aliases[i].name, aliases[i].command);
+    for (int i = 0; i < nvars && !b.failed; ++i) {
+        const char *val = getenv(vars[i]);
+        if (!val) continue;
+        size_t nlen = strlen(vars[i]);
+        uint32_t slot = snap_hash(vars[i], nlen) & (h.var_buckets - 1);
+        for (;; slot = (slot + 1) & (h.var_buckets - 1)) {
+            uint32_t cur = ((uint32_t *)(b.data + h.var_table))[slot];
+            if (!cur || (strncmp(b.data + cur, vars[i], nlen) == 0 && b.data[cur + nlen] == '=')) break;
+        }
+        char *entry = NULL;
+        if (asprintf(&entry, "%s=%s", vars[i], val) < 0) { b.failed = 1; break; }
+        uint32_t off = buf_str(&b, entry, strlen(entry));
+        free(entry);
+        if (!b.failed) ((uint32_t *)(b.data + h.var_table))[slot] = off;
+    }
+    const char *pathenv = getenv("PATH");
+    if (pathenv && npaths > 0 && !b.failed) {
+        h.path_env = buf_str(&b, pathenv, strlen(pathenv));
+        PathDump d = { &b, h.path_buckets, h.path_table };
+        path_cache_each(dump_path, &d);
+    }
+    if (b.failed || b.len > UINT32_MAX) { free(b.data); return; }
+    h.file_size = b.len;
+    memcpy(b.data, &h, sizeof(h));
+
+    /* Write next to the old one and rename over it: shells that have the old
+     * snapshot mapped keep their copy. */
+    char dir[PATH_BUF], tmp[PATH_BUF + 16];
+    snprintf(dir, sizeof(dir), "%s", path);
+    for (char *p = dir + 1; (p = strchr(p, '/')); ++p) { *p = '\0'; mkdir(dir, 0755); *p = '/'; }
+    snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path);
+    int fd = mkostemp(tmp, O_CLOEXEC);
+    if (fd >= 0) {
+        size_t off = 0;
+        while (off < b.len) {
+            ssize_t w = write(fd, b.data + off, b.len - off);
+            if (w < 0 && errno == EINTR) continue;
+            if (w <= 0) break;
+            off += (size_t)w;
+        }
+        if (close(fd) != 0 || off != b.len || rename(tmp, path) != 0) unlink(tmp);
+    }
+    free(b.data);
+}
+
+/* Whether anything outside single quotes in line is expanded: its result
+ * depends on the environment, cwd or commands, none of which the key covers. */
+static int line_expands(const char *s) {
+    for (int quoted = 0; *s; ++s) {
+        if (*s == '\'') quoted = !quoted;
+        else if (!quoted && strchr("$`*?[", *s)) return 1;
+    }
+    return 0;
+}
+
+/* Whether a line's effects are captured by a snapshot. "set" lines also
+ * record the variable they name. */
+static int snap_line(const char *line, char ***vars, int *nvars) {
+    const char *w = line + strspn(line, " \t");
+    size_t len = strcspn(w, " \t");
+    if (line_expands(w)) return 0;
+    if (len == 5 && strncmp(w, "alias", 5) == 0) return 1;
+    if (len != 3 || strncmp(w, "set", 3) != 0) return 0;
+    w += len;
+    w += strspn(w, " \t");
+    size_t nlen = strcspn(w, "= \t");
+    if (nlen == 0 || w[nlen] != '=') return 1;
+    char **tmp = realloc(*vars, (*nvars + 1) * sizeof(char *));
+    if (!tmp) return 0;
+    *vars = tmp;
+    if (!((*vars)[*nvars] = strndup(w, nlen))) return 0;
+    ++*nvars;
+    return 1;
+}
+
+/* Run the rc file, or load its snapshot when that is up to date. */
+void rc_load(void) {
+    char rc[PATH_BUF], snapfile[PATH_BUF];
+    struct stat st;
+    if (rc_path(rc, sizeof(rc)) != 0 || stat(rc, &st) != 0) return;
+    int use_snap = snap_path(snapfile, sizeof(snapfile)) == 0;
+    if (use_snap && snap_load(snapfile, &st) == 0) return;
+
+    FILE *f = fopen(rc, "re");
+    if (!f) { fprintf(stderr, "cshell: %s: %s\n", rc, strerror(errno)); return; }
+    char *line = NULL, **vars = NULL;
+    size_t cap = 0;
+    int nvars = 0, replayable = 1;
+    while (getline(&line, &cap, f) > 0) {
+        line[strcspn(line, "\r\n")] = '\0';
+        const char *s = line + strspn(line, " \t");
+        if (*s == '\0' || *s == '#') continue;
+        if (replayable && !snap_line(s, &vars, &nvars)) replayable = 0;
+        execute_line(line);
+    }
+    free(line);
+    fclose(f);
+    if (use_snap && replayable) snap_write(snapfile, &st, vars, nvars);
+    else if (use_snap) unlink(snapfile);
+    for (int i = 0; i < nvars; ++i) free(vars[i]);
+    free(vars);
+}
@@ -0,0 +1,165 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "shell.h"
+
+/* Redirections, opened by the shell rather than in the child so it can tune
+ * and keep hold of them:
+ *
+ *   cmd < file             a regular file gets posix_fadvise(SEQUENTIAL) and
+ *                          readahead of its first CSHELL_READAHEAD_KB (default
+ *                          2048, 0 for neither), so the first reads don't wait
+ *   prealloc SIZE cmd > f  reserve SIZE bytes for the output (fallocate, size
+ *                          kept) so a large file goes down in few extents; what
+ *                          the job didn't use is trimmed off when it ends
+ *   cmd >! file            write to an unnamed file in file's directory that
+ *                          is renamed over file only if the job succeeds, so
+ *                          readers see the old contents or the new, never part */
+
+#define READAHEAD_KB_DEFAULT 2048
+
+typedef struct Output {
+    pid_t pgid;                 /* 0 until the stage is launched */
+    int fd;
+    int dir;                    /* O_PATH of the target's directory, replace only */
+    char *base;                 /* target name in dir, replace only */
+    int trim;                   /* preallocated: cut back to what was written */
+} Output;
+
+static Output outputs[MAX_JOBS];
+static int output_count = 0;
+
+static void input_hints(int fd) {
+    const char *s = getenv("CSHELL_READAHEAD_KB");
+    long long kb = s && *s ? atoll(s) : READAHEAD_KB_DEFAULT;
+    struct stat st;
+    if (kb <= 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) return;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    readahead(fd, 0, (size_t)(kb * 1024 < st.st_size ? kb * 1024 : st.st_size));
+}
+
+/* Unnamed file beside path, with its mode when it exists; dir and base say
+ * where it goes. */
+static int open_replacement(const char *path, int *dir, char **base) {
+    const char *slash = strrchr(path, '/');
+    char *dname = slash ? strndup(path, slash == path ? 1 : (size_t)(slash - path)) : strdup(".");
+    *base = strdup(slash ? slash + 1 : path);
+    *dir = dname ? open(dname, O_PATH | O_DIRECTORY | O_CLOEXEC) : -1;
+    free(dname);
+    int fd = -1;
+    if (*dir >= 0 && *base && **base) fd = openat(*dir, ".", O_TMPFILE | O_WRONLY | O_CLOEXEC, 0666);
+    if (fd < 0) {
+        int err = errno;
+        if (*dir >= 0) close(*dir);
+        free(*base);
+        errno = err;
+        return -1;
+    }
+    struct stat st;
+    if (fstatat(*dir, *base, &st, 0) == 0) fchmod(fd, st.st_mode & 07777);
+    return fd;
+}
+
+/* Open cmd's redirections: fds[0] for "<", fds[1] for ">", ">>" or ">!"
+ * (-1 where it has none). Returns 0, or -1 with nothing left open. */
+int redir_begin(const Command *cmd, long long prealloc, int fds[2]) {
+    fds[0] = fds[1] = -1;
+    if (cmd->input_file) {
+        fds[0] = open(cmd->input_file, O_RDONLY | O_CLOEXEC);
+        if (fds[0] < 0) { perror(cmd->input_file); return -1; }
+        input_hints(fds[0]);
+    }
+    if (!cmd->output_file) return 0;
+    if (output_count == MAX_JOBS) {
+        if (cmd->replace) { printf("cshell: too many pending outputs\n"); goto fail; }
+        prealloc = 0;
+    }
+    Output o = { 0, -1, -1, NULL, 0 };
+    if (cmd->replace) fds[1] = open_replacement(cmd->output_file, &o.dir, &o.base);
+    else fds[1] = open(cmd->output_file, O_WRONLY | O_CREAT | O_CLOEXEC | (cmd->append ? O_APPEND : O_TRUNC), 0644);
+    if (fds[1] < 0) { perror(cmd->output_file); goto fail; }
+    struct stat st;
+    if (prealloc > 0 && fstat(fds[1], &st) == 0 && S_ISREG(st.st_mode))
+        o.trim = fallocate(fds[1], FALLOC_FL_KEEP_SIZE, st.st_size, prealloc) == 0;
+    o.fd = fds[1];
+    if (cmd->replace || o.trim) outputs[output_count++] = o;
+    return 0;
+fail:
+    if (fds[0] >= 0) close(fds[0]);
+    fds[0] = -1;
+    return -1;
+}
+
+/* After the launch: the shell's copies go, except outputs that wait for the
+ * job in group pgid to end (pgid <= 0: the launch failed). */
+void redir_launched(int fds[2], pid_t pgid) {
+    if (fds[0] >= 0) close(fds[0]);
+    for (int i = 0; fds[1] >= 0 && i < output_count; ++i) {
+        Output *o = &outputs[i];
+        if (o->pgid || o->fd != fds[1]) continue;
+        if (pgid > 0) { o->pgid = pgid; return; }
+        if (o->dir >= 0) close(o->dir);
+        free(o->base);
+        outputs[i] = outputs[--output_count];
+        break;
+    }
+    if (fds[1] >= 0) close(fds[1]);
+}
+
+/* Give the unnamed file a temporary name of its own, then rename that over
+ * the target. */
+static void commit(Output *o) {
+    char proc[32], tmp[64];
+    snprintf(proc, sizeof(proc), "/proc/self/fd/%d", o->fd);
+    int linked = 0;
+    for (int n = 0; n < 100 && !linked; ++n) {
+        snprintf(tmp, sizeof(tmp), ".cshell-%d-%d", (int)getpid(), n);
+        if (linkat(AT_FDCWD, proc, o->dir, tmp, AT_SYMLINK_FOLLOW) == 0) linked = 1;
+        else if (errno != EEXIST) { perror(o->base); return; }
+    }
+    if (!linked) { fprintf(stderr, "cshell: %s: no free temporary name, left as it was\n", o->base); return; }
+    if (renameat(o->dir, tmp, o->dir, o->base) != 0) {
+        perror(o->base);
+        unlinkat(o->dir, tmp, 0);
+    }
+}
+
+/* The job in group pgid ended with wait status status (-1: it didn't run to
+ * the end): put its ">!" outputs in place if it succeeded, and give back
+ * preallocated space it didn't write. */
+void redir_end(pid_t pgid, int status) {
+    int ok = status >= 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    for (int i = 0; pgid > 0 && i < output_count;) {
+        Output *o = &outputs[i];
+        if (o->pgid != pgid) { ++i; continue; }
+        struct stat st;
+        if (o->trim && fstat(o->fd, &st) == 0 && ftruncate(o->fd, st.st_size) != 0) { /* best effort */ }
+        if (o->base) {
+            if (ok) commit(o);
+            else fprintf(stderr, "cshell: %s left as it was (the job failed)\n", o->base);
+            close(o->dir);
+            free(o->base);
+        }
+        close(o->fd);
+        outputs[i] = outputs[--output_count];
+    }
+}
+
+/* Split a leading "prealloc SIZE" off cmd. Returns 1 when a prefix was taken,
+ * 0 when there is none and -1 on a usage error. */
+int prealloc_prefix(Command *cmd, JobOpts *jo) {
+    if (!cmd || !cmd->name || strcmp(cmd->name, "prealloc") != 0) return 0;
+    long long bytes = cmd->args[1] ? parse_size(cmd->args[1]) : -1;
+    if (bytes <= 0 || !cmd->args[2]) { printf("Usage: prealloc SIZE command [| command ...] > file\n"); return -1; }
+    jo->prealloc = bytes;
+    cmd->args += 2;
+    cmd->argc -= 2;
+    cmd->name = cmd->args[0];
+    return 1;
+}
@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "shell.h"
+
+#define MAX_PROCESSES 20
+typedef struct Process {
+    int pid;
+    int arrival_time;
+    int burst_time;
+    int remaining_time;
+    int completion_time;
+    int turnaround_time;
+    int waiting_time;
+} Process;
+
+/* The engines below run on any Process array. Typed-in workloads get one Gantt
+ * cell per time unit (RR) or per process (FCFS); replayed traces, which run to
+ * many thousands of milliseconds, get one cell per slice with its length. */
+
+static void finish(Process *p, int time) {
+    p->completion_time = time;
+    p->turnaround_time = time - p->arrival_time;
+    p->waiting_time = p->turnaround_time - p->burst_time;
+}
+
+static void run_fcfs(Process *p, int n, int compact) {
+    int time = 0;
+    printf("\nGantt Chart: ");
+    for (int i = 0; i < n; ++i) {
+        if (time < p[i].arrival_time) {
+            if (compact) printf("| idle %d ", p[i].arrival_time - time);
+            time = p[i].arrival_time;
+        }
+        if (compact) printf("| P%d %d ", p[i].pid, p[i].burst_time);
+        else printf("| P%d ", p[i].pid);
+        time += p[i].burst_time;
+        finish(&p[i], time);
+    }
+    printf("|\n\n");
+}
+
+static void gantt_cell(const char *who, int len, int compact) {
+    if (compact) printf("| %s %d ", who, len);
+    else for (int t = 0; t < len; ++t) printf(" %s ", who);
+}
+
+static void run_rr(Process *p, int n, int quantum, int compact) {
+    int *queue = malloc(n * sizeof(int));
+    char *queued = calloc(n, 1);
+    if (!queue || !queued) { free(queue); free(queued); printf("Out of memory\n"); return; }
+    int front = 0, count = 0, time = 0, completed = 0;
+    char who[16];
+    for (int i = 0; i < n; ++i) {
+        p[i].remaining_time = p[i].burst_time;
+        if (p[i].burst_time <= 0) { finish(&p[i], p[i].arrival_time); ++completed; }
+    }
+
+    printf("\nGantt Chart: ");
+    while (completed < n) {
+        for (int i = 0; i < n; ++i) {
+            if (!queued[i] && p[i].remaining_time > 0 && p[i].arrival_time <= time) {
+                queue[(front + count++) % n] = i;
+                queued[i] = 1;
+            }
+        }
+        if (count) {
+            int idx = queue[front];
+            front = (front + 1) % n;
+            --count;
+            queued[idx] = 0;
+            int exec = (p[idx].remaining_time > quantum) ? quantum : p[idx].remaining_time;
+            snprintf(who, sizeof(who), "P%d", p[idx].pid);
+            gantt_cell(who, exec, compact);
+            time += exec;
+            p[idx].remaining_time -= exec;
+            if (p[idx].remaining_time <= 0) {
+                finish(&p[idx], time);
+                ++completed;
+            } else {
+                queue[(front + count++) % n] = idx;
+                queued[idx] = 1;
+            }
+        } else {
+            int next = INT_MAX;
+            for (int i = 0; i < n; ++i) if (p[i].remaining_time > 0 && p[i].arrival_time < next) next = p[i].arrival_time;
+            gantt_cell("idle", next - time, compact);
+            time = next;
+        }
+    }
+    printf("|\n\n");
+    free(queue);
+    free(queued);
+}
+
+static void print_results(const Process *p, int n, const TraceJob *trace) {
+    printf("%-8s %-12s %-10s %-10s %-10s%s\n", "PID","Arrival","Burst","Turnaround","Waiting", trace ? " Command" : "");
+    float avg_tat = 0, avg_wt = 0;
+    for (int i = 0; i < n; ++i) {
+        printf("%-8d %-12d %-10d %-10d %-10d",
+               p[i].pid, p[i].arrival_time, p[i].burst_time,
+               p[i].turnaround_time, p[i].waiting_time);
+        if (trace) printf(" %s", trace[i].command);
+        printf("\n");
+        avg_tat += p[i].turnaround_time;
+        avg_wt += p[i].waiting_time;
+    }
+    printf("\nAverage Turnaround Time: %.2f\n", avg_tat / n);
+    printf("Average Waiting Time: %.2f\n\n", avg_wt / n);
+}
+
+/* Prompt for n processes' arrival and burst times. Returns n, or 0. */
+static int read_processes(Process *p) {
+    printf("Enter number of processes: ");
+    int n;
+    if (scanf("%d", &n) != 1) { while (getchar() != '\n' && getchar() != EOF); printf("Invalid\n"); return 0; }
+    if (n <= 0 || n > MAX_PROCESSES) { printf("Invalid number (1..%d)\n", MAX_PROCESSES); return 0; }
+
+    memset(p, 0, MAX_PROCESSES * sizeof(Process));
+    for (int i = 0; i < n; ++i) {
+        p[i].pid = i + 1;
+        printf("Process %d - Arrival Time: ", i+1);
+        scanf("%d", &p[i].arrival_time);
+        printf("Process %d - Burst Time: ", i+1);
+        scanf("%d", &p[i].burst_time);
+        p[i].remaining_time = p[i].burst_time;
+    }
+    while (getchar() != '\n' && !feof(stdin)) {}
+    return n;
+}
+
+static void simulate_fcfs(void) {
+    printf("\n=== FCFS Scheduling Simulation ===\n");
+    Process p[MAX_PROCESSES];
+    int n = read_processes(p);
+    if (!n) return;
+    run_fcfs(p, n, 0);
+    print_results(p, n, NULL);
+}
+
+static void simulate_rr(int quantum) {
+    if (quantum <= 0) { printf("Quantum must be > 0\n"); return; }
+    printf("\n=== Round Robin (Quantum = %d) Scheduling Simulation ===\n", quantum);
+    Process p[MAX_PROCESSES];
+    int n = read_processes(p);
+    if (!n) return;
+    run_rr(p, n, quantum, 0);
+    print_results(p, n, NULL);
+}
+
+/* schedule replay TRACE fcfs|rr QUANTUM: the jobs recorded in TRACE (see
+ * trace.c), in milliseconds, on one cpu. A job's burst is the cpu time it
+ * used, at least 1ms; arrivals are relative to the first job. */
+static void replay(const char *path, int quantum) {
+    TraceJob *t = NULL;
+    int n = trace_load(path, &t);
+    if (n < 0) { printf("schedule: %s: cannot read trace\n", path); return; }
+    if (n == 0) { printf("schedule: %s: no jobs recorded\n", path); free(t); return; }
+    Process *p = calloc(n, sizeof(Process));
+    if (!p) { free(t); printf("Out of memory\n"); return; }
+    double recorded = 0;
+    for (int i = 0; i < n; ++i) {
+        long long burst = (t[i].cpu_us + 500) / 1000;
+        p[i].pid = i + 1;
+        p[i].arrival_time = (int)((t[i].arrival_us - t[0].arrival_us) / 1000);
+        p[i].burst_time = burst > 0 ? (int)burst : 1;
+        recorded += (t[i].end_us - t[i].arrival_us) / 1000.0;
+    }
+    if (quantum > 0) printf("\n=== Round Robin (Quantum = %d ms) replay of %s ===\n", quantum, path);
+    else printf("\n=== FCFS replay of %s ===\n", path);
+    printf("%d jobs, times in ms\n", n);
+    if (quantum > 0) run_rr(p, n, quantum, 1);
+    else run_fcfs(p, n, 1);
+    print_results(p, n, t);
+    printf("Recorded Average Turnaround Time: %.2f\n\n", recorded / n);
+    free(p);
+    free(t);
+}
+
+static void usage(void) {
+    printf("Usage: schedule fcfs | schedule rr <quantum> | schedule replay <trace> fcfs|rr <quantum>\n");
+}
+
+int handle_schedule(Command *cmd) {
+    if (!cmd || !cmd->name) return 0;
+    if (strcmp(cmd->name, "schedule") != 0) return 0;
+    if (!cmd->args[1]) { usage(); return 1; }
+
+    if (strcmp(cmd->args[1], "fcfs") == 0) {
+        simulate_fcfs();
+    } else if (strcmp(cmd->args[1], "rr") == 0 && cmd->args[2]) {
+        int q = atoi(cmd->args[2]);
+        if (q <= 0) { printf("Invalid quantum\n"); return 1; }
+        simulate_rr(q);
+    } else if (strcmp(cmd->args[1], "replay") == 0 && cmd->args[2] && cmd->args[3]) {
+        if (strcmp(cmd->args[3], "fcfs") == 0) {
+            replay(cmd->args[2], 0);
+        } else if (strcmp(cmd->args[3], "rr") == 0 && cmd->args[4]) {
+            int q = atoi(cmd->args[4]);
+            if (q <= 0) { printf("Invalid quantum\n"); return 1; }
+            replay(cmd->args[2], q);
+        } else {
+            usage();
+        }
+    } else {
+        usage();
+    }
+    return 1;
+}
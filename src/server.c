@@ -0,0 +1,266 @@
+#include <stdio.h>
+#include <stdio_ext.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "shell.h"
+
+/* cshell --server SOCK [-j N]
+ *
+ * A warm shell behind a Unix socket. The master sets everything up once
+ * (environment, aliases, a prewarmed PATH cache), then forks a fixed pool of
+ * workers that inherit it copy-on-write and accept() on the shared socket, one
+ * client at a time each; further clients queue in the listen backlog. The
+ * master only respawns workers that die and removes the socket on exit.
+ *
+ * A request is one SOCK_SEQPACKET message: a header, the client's cwd and a
+ * script (one command per line), with the client's stdin/stdout/stderr
+ * attached as SCM_RIGHTS. The worker runs the script on those fds in that
+ * directory and replies with the exit status of the last command. State a
+ * request changes (aliases, variables, VFS) stays in the worker that ran it. */
+
+#define REQ_MAGIC "CSH1"
+#define REP_MAGIC "CSHR"
+#define REQ_MAX (64 * 1024)
+
+typedef struct ReqHeader {
+    char magic[4];
+    uint32_t cwd_len;
+    uint32_t script_len;
+} ReqHeader;
+
+typedef struct RepHeader {
+    char magic[4];
+    int32_t status;
+} RepHeader;
+
+static int send_reply(int conn, int status) {
+    RepHeader r;
+    memcpy(r.magic, REP_MAGIC, 4);
+    r.status = status;
+    return send(conn, &r, sizeof(r), MSG_NOSIGNAL) == (ssize_t)sizeof(r) ? 0 : -1;
+}
+
+/* Run script on the client's fds, then put the worker's own fds back. */
+static int run_request(const char *cwd, char *script, const int fds[3]) {
+    int saved[3];
+    fflush(stdout);
+    fflush(stderr);
+    for (int i = 0; i < 3; ++i) {
+        saved[i] = fcntl(i, F_DUPFD_CLOEXEC, 10);
+        dup2(fds[i], i);
+    }
+    __fpurge(stdin);
+    clearerr(stdin);
+
+    int status = 0;
+    if (chdir(cwd) != 0) { fprintf(stderr, "cshell: %s: %s\n", cwd, strerror(errno)); status = 1; }
+    char *save = NULL;
+    for (char *line = status ? NULL : strtok_r(script, "\n", &save); line; line = strtok_r(NULL, "\n", &save)) {
+        line[strcspn(line, "\r")] = '\0';
+        if (line[0] == '\0') continue;
+        status = execute_line(line);
+    }
+    reap_done_jobs();
+
+    fflush(stdout);
+    fflush(stderr);
+    __fpurge(stdin);
+    clearerr(stdin);
+    for (int i = 0; i < 3; ++i) {
+        if (saved[i] >= 0) { dup2(saved[i], i); close(saved[i]); }
+        else close(i);
+    }
+    return status;
+}
+
+static void serve_client(int conn) {
+    char *buf = malloc(REQ_MAX + 1);
+    union { char space[CMSG_SPACE(3 * sizeof(int))]; struct cmsghdr align; } ctl;
+    struct iovec iov = { buf, REQ_MAX };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctl.space;
+    msg.msg_controllen = sizeof(ctl.space);
+    if (!buf) return;
+
+    ssize_t n = recvmsg(conn, &msg, MSG_CMSG_CLOEXEC);
+    int fds[3] = { -1, -1, -1 }, nfds = 0;
+    for (struct cmsghdr *c = n > 0 ? CMSG_FIRSTHDR(&msg) : NULL; c; c = CMSG_NXTHDR(&msg, c)) {
+        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) continue;
+        int count = (int)((c->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+        for (int i = 0; i < count; ++i) {
+            int fd;
+            memcpy(&fd, CMSG_DATA(c) + i * sizeof(int), sizeof(int));
+            if (nfds < 3) fds[nfds++] = fd; else close(fd);
+        }
+    }
+
+    ReqHeader h;
+    if (n < (ssize_t)sizeof(h) || nfds != 3 || (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC))) {
+        send_reply(conn, -1);
+    } else {
+        memcpy(&h, buf, sizeof(h));
+        if (memcmp(h.magic, REQ_MAGIC, 4) != 0 || h.cwd_len == 0 || sizeof(h) + (size_t)h.cwd_len + h.script_len != (size_t)n) {
+            send_reply(conn, -1);
+        } else {
+            char *cwd = buf + sizeof(h), *script = cwd + h.cwd_len;
+            cwd[h.cwd_len - 1] = '\0';
+            buf[n] = '\0';
+            send_reply(conn, run_request(cwd, script, fds));
+        }
+    }
+    for (int i = 0; i < nfds; ++i) close(fds[i]);
+    free(buf);
+}
+
+static void worker_loop(int listen_fd) {
+    setpgid(0, 0);                      /* out of the master's terminal group */
+    for (;;) {
+        int conn = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (conn < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            perror("cshell server: accept");
+            _exit(1);
+        }
+        serve_client(conn);
+        close(conn);
+    }
+}
+
+static pid_t start_worker(int listen_fd, const sigset_t *mask) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        sigprocmask(SIG_SETMASK, mask, NULL);
+        signal(SIGTERM, SIG_DFL);
+        worker_loop(listen_fd);
+    }
+    return pid;
+}
+
+static int bind_socket(const char *path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) { fprintf(stderr, "cshell: socket path too long\n"); return -1; }
+    strcpy(addr.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0) { perror("cshell: socket"); return -1; }
+    mode_t old = umask(077);
+    int rc = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    if (rc < 0 && errno == EADDRINUSE) {
+        /* Reuse a stale socket file, but not one a live server answers on. */
+        int probe = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+        if (probe >= 0 && connect(probe, (struct sockaddr *)&addr, sizeof(addr)) < 0 && errno == ECONNREFUSED) {
+            unlink(path);
+            rc = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+        } else {
+            errno = EADDRINUSE;
+        }
+        if (probe >= 0) close(probe);
+    }
+    umask(old);
+    if (rc < 0 || listen(fd, 128) < 0) { fprintf(stderr, "cshell: %s: %s\n", path, strerror(errno)); close(fd); return -1; }
+    return fd;
+}
+
+int server_main(const char *sock_path, int workers) {
+    if (workers <= 0) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = ncpu > 1 ? 2 * (int)ncpu : 2;
+    }
+    int listen_fd = bind_socket(sock_path);
+    if (listen_fd < 0) return 1;
+    job_control = 0;
+    path_cache_prewarm();
+
+    /* The master only waits for signals; workers get the original mask back. */
+    sigset_t wait_set, old;
+    sigemptyset(&wait_set);
+    sigaddset(&wait_set, SIGCHLD);
+    sigaddset(&wait_set, SIGTERM);
+    sigaddset(&wait_set, SIGINT);
+    sigaddset(&wait_set, SIGHUP);
+    sigprocmask(SIG_BLOCK, &wait_set, &old);
+
+    pid_t *pool = calloc(workers, sizeof(pid_t));
+    if (!pool) { close(listen_fd); unlink(sock_path); return 1; }
+    for (int i = 0; i < workers; ++i) pool[i] = start_worker(listen_fd, &old);
+    fprintf(stderr, "cshell: serving on %s with %d workers\n", sock_path, workers);
+
+    for (;;) {
+        int sig = sigwaitinfo(&wait_set, NULL);
+        if (sig < 0) continue;
+        if (sig != SIGCHLD) break;
+        pid_t pid;
+        while ((pid = waitpid(-1, NULL, WNOHANG)) > 0) {
+            for (int i = 0; i < workers; ++i) if (pool[i] == pid) pool[i] = start_worker(listen_fd, &old);
+        }
+    }
+
+    for (int i = 0; i < workers; ++i) if (pool[i] > 0) kill(pool[i], SIGTERM);
+    while (waitpid(-1, NULL, 0) > 0) { }
+    free(pool);
+    close(listen_fd);
+    unlink(sock_path);
+    sigprocmask(SIG_SETMASK, &old, NULL);
+    return 0;
+}
+
+/* Client side: run script on a server with fds as its stdio. Returns the
+ * exit status, or -1 if the server could not be reached or rejected it. */
+int server_request(const char *sock_path, const char *script, const int fds[3]) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(sock_path) >= sizeof(addr.sun_path)) return -1;
+    strcpy(addr.sun_path, sock_path);
+    char cwd[PATH_BUF];
+    if (!getcwd(cwd, sizeof(cwd))) strcpy(cwd, "/");
+
+    ReqHeader h;
+    memcpy(h.magic, REQ_MAGIC, 4);
+    h.cwd_len = (uint32_t)strlen(cwd) + 1;
+    h.script_len = (uint32_t)strlen(script);
+    if (sizeof(h) + h.cwd_len + h.script_len > REQ_MAX) { fprintf(stderr, "cshell: request too large\n"); return -1; }
+
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) { close(fd); return -1; }
+
+    struct iovec iov[3] = { { &h, sizeof(h) }, { cwd, h.cwd_len }, { (void *)script, h.script_len } };
+    union { char space[CMSG_SPACE(3 * sizeof(int))]; struct cmsghdr align; } ctl;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    memset(&ctl, 0, sizeof(ctl));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 3;
+    msg.msg_control = ctl.space;
+    msg.msg_controllen = sizeof(ctl.space);
+    struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(3 * sizeof(int));
+    memcpy(CMSG_DATA(c), fds, 3 * sizeof(int));
+
+    RepHeader r;
+    int status = -1;
+    if (sendmsg(fd, &msg, MSG_NOSIGNAL) >= 0) {
+        ssize_t n;
+        while ((n = recv(fd, &r, sizeof(r), 0)) < 0 && errno == EINTR) { }
+        if (n == (ssize_t)sizeof(r) && memcmp(r.magic, REP_MAGIC, 4) == 0) status = r.status;
+    }
+    close(fd);
+    return status;
+}
@@ -0,0 +1,305 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+#include "shell.h"
+
+/* Sharded pipeline stages: "producer |4> grep pat | sort" runs grep as four
+ * replicas. One helper process, forked into the job's group in the stage's
+ * place, cuts its input at line boundaries into chunks of CSHELL_SHARD_KB
+ * (default 1024) and feeds them to the replicas, merging what they write:
+ *
+ *   |N>   in order: every chunk gets a replica of its own, at most N running,
+ *         and the outputs go out in chunk order. Only a process that sees its
+ *         whole input and then exits tells us where its output for a chunk
+ *         ends, so order costs a start per chunk.
+ *   |Nu>  unordered: N replicas for the whole run, each chunk to whichever has
+ *         taken its last one, output passed on a line at a time as it comes.
+ *
+ * Only for stages that treat each line on its own (grep, sed, tr, a stateless
+ * awk). The stage's exit status is the worst error (2 and up, or a signal)
+ * among its replicas, else the best of the rest, so a sharded grep succeeds
+ * when any chunk matched. */
+
+#define SHARD_KB_DEFAULT 1024
+#define SHARD_READ 65536
+
+typedef struct Buf {
+    char *data;
+    size_t len, off, cap;       /* off: already written out */
+} Buf;
+
+typedef struct Shard {
+    pid_t pid;                  /* 0 for a free slot, -1 once reaped */
+    int in, out;                /* our ends of its stdin and stdout, -1 when closed */
+    long long seq;              /* in order: the chunk it was given */
+    Buf ibuf, obuf;             /* input not yet written to it, output not yet passed on */
+} Shard;
+
+typedef struct Sharder {
+    Command *cmd;
+    int n, unordered, nslots;
+    size_t chunk;
+    Shard *slot;
+    Buf pending;                /* input read but not yet given to a replica */
+    int eof;
+    long long next_seq, emit_seq;
+    int status;                 /* merged exit status so far, -1 for none yet */
+} Sharder;
+
+static int buf_reserve(Buf *b, size_t need) {
+    if (b->cap >= need) return 0;
+    size_t cap = b->cap ? b->cap : SHARD_READ;
+    while (cap < need) cap *= 2;
+    char *tmp = realloc(b->data, cap);
+    if (!tmp) return -1;
+    b->data = tmp;
+    b->cap = cap;
+    return 0;
+}
+
+/* SIGPIPE is held off so a replica that stops reading early can't kill us;
+ * the stage after us doing so still should. */
+static void write_out(const char *p, size_t n) {
+    while (n) {
+        ssize_t w = write(STDOUT_FILENO, p, n);
+        if (w < 0 && errno == EINTR) continue;
+        if (w < 0 && errno == EPIPE) {
+            signal(SIGPIPE, SIG_DFL);
+            sigset_t pipe;
+            sigemptyset(&pipe);
+            sigaddset(&pipe, SIGPIPE);
+            sigprocmask(SIG_UNBLOCK, &pipe, NULL);
+            raise(SIGPIPE);
+        }
+        if (w <= 0) _exit(1);
+        p += w;
+        n -= (size_t)w;
+    }
+}
+
+static int stage_status(int st) {
+    return WIFSIGNALED(st) ? 128 + WTERMSIG(st) : WEXITSTATUS(st);
+}
+
+static void merge_status(Sharder *s, int st) {
+    int cur = s->status, err = st > 1, cur_err = cur > 1;
+    if (cur < 0 || (err && (!cur_err || st > cur)) || (!err && !cur_err && st < cur)) s->status = st;
+}
+
+static int start(Sharder *s, Shard *sh) {
+    int in[2], out[2];
+    if (pipe2(in, O_CLOEXEC) < 0) return -1;
+    if (pipe2(out, O_CLOEXEC) < 0) { close(in[0]); close(in[1]); return -1; }
+    LaunchOpts lo = { -1, NULL, -1, -1, 0 };
+    pid_t pid = launch_command(s->cmd, getpgrp(), in[0], out[1], shell_launcher, &lo);
+    close(in[0]);
+    close(out[1]);
+    if (pid <= 0) { close(in[1]); close(out[0]); return -1; }
+    fcntl(in[1], F_SETFL, O_NONBLOCK);
+    sh->pid = pid;
+    sh->in = in[1];
+    sh->out = out[0];
+    return 0;
+}
+
+static void reap(Sharder *s, Shard *sh) {
+    int st;
+    while (waitpid(sh->pid, &st, 0) < 0 && errno == EINTR) { }
+    merge_status(s, stage_status(st));
+    sh->pid = -1;
+}
+
+/* Take the next chunk off the pending input: up to its last newline once
+ * there is a chunk's worth, all of it at EOF. */
+static int cut(Sharder *s, Buf *into) {
+    Buf *p = &s->pending;
+    size_t len = p->len;
+    if (!len || (!s->eof && len < s->chunk)) return 0;
+    if (!s->eof) {
+        const char *nl = memrchr(p->data, '\n', len);
+        if (!nl) return 0;              /* a line longer than a chunk: read on */
+        len = (size_t)(nl - p->data) + 1;
+    }
+    Buf rest = *into;               /* its old buffer holds the remainder */
+    if (buf_reserve(&rest, p->len - len + SHARD_READ) != 0) return 0;
+    memcpy(rest.data, p->data + len, p->len - len);
+    rest.len = p->len - len;
+    rest.off = 0;
+    *into = *p;
+    into->len = len;
+    into->off = 0;
+    *p = rest;
+    return 1;
+}
+
+/* Hand out whatever chunks there are replicas for. */
+static void dispatch(Sharder *s) {
+    for (;;) {
+        Shard *to = NULL;
+        if (s->unordered) {
+            for (int i = 0; i < s->n && !to; ++i) if (s->slot[i].in >= 0 && s->slot[i].ibuf.off == s->slot[i].ibuf.len) to = &s->slot[i];
+        } else {
+            int running = 0;
+            for (int i = 0; i < s->nslots; ++i) running += s->slot[i].pid > 0;
+            for (int i = 0; i < s->nslots && !to && running < s->n; ++i) if (!s->slot[i].pid) to = &s->slot[i];
+        }
+        if (!to || !cut(s, &to->ibuf)) break;
+        if (!s->unordered) {
+            if (start(s, to) < 0) _exit(127);
+            to->seq = s->next_seq++;
+        }
+    }
+    if (s->unordered && s->eof && !s->pending.len) {
+        for (int i = 0; i < s->n; ++i) {
+            Shard *sh = &s->slot[i];
+            if (sh->in >= 0 && sh->ibuf.off == sh->ibuf.len) { close(sh->in); sh->in = -1; }
+        }
+    }
+}
+
+static void feed(Shard *sh) {
+    Buf *b = &sh->ibuf;
+    ssize_t w = write(sh->in, b->data + b->off, b->len - b->off);
+    if (w > 0) b->off += (size_t)w;
+    else if (w < 0 && errno != EAGAIN && errno != EINTR) b->off = b->len;    /* it quit reading */
+    if (b->off == b->len) b->off = b->len = 0;
+}
+
+/* In order: pass on the head chunk's output, and retire finished chunks. */
+static void emit_ordered(Sharder *s) {
+    for (;;) {
+        Shard *head = NULL;
+        for (int i = 0; i < s->nslots && !head; ++i) if (s->slot[i].pid && s->slot[i].seq == s->emit_seq) head = &s->slot[i];
+        if (!head) return;
+        Buf *o = &head->obuf;
+        write_out(o->data, o->len);
+        o->len = 0;
+        if (head->out >= 0 || head->pid > 0) return;
+        head->pid = 0;
+        ++s->emit_seq;
+    }
+}
+
+static void drain(Sharder *s, Shard *sh) {
+    Buf *o = &sh->obuf;
+    if (buf_reserve(o, o->len + SHARD_READ) != 0) _exit(1);
+    ssize_t n = read(sh->out, o->data + o->len, SHARD_READ);
+    if (n < 0 && (errno == EINTR || errno == EAGAIN)) return;
+    if (n > 0) o->len += (size_t)n;
+    if (n <= 0) {
+        close(sh->out);
+        sh->out = -1;
+        if (sh->in >= 0) { close(sh->in); sh->in = -1; }
+        reap(s, sh);
+    }
+    if (!s->unordered) return;
+    /* Whole lines only, so replicas' lines don't interleave; the rest at EOF. */
+    if (!o->len) return;
+    const char *nl = sh->out >= 0 ? memrchr(o->data, '\n', o->len) : o->data + o->len - 1;
+    if (!nl) return;
+    size_t len = (size_t)(nl - o->data) + 1;
+    write_out(o->data, len);
+    memmove(o->data, o->data + len, o->len - len);
+    o->len -= len;
+}
+
+static int run(Sharder *s) {
+    struct pollfd *pfd = malloc(sizeof(struct pollfd) * (2 * s->nslots + 1));
+    Shard **who = malloc(sizeof(Shard *) * (2 * s->nslots + 1));
+    if (!pfd || !who) return 1;
+    if (s->unordered) {
+        for (int i = 0; i < s->n; ++i) if (start(s, &s->slot[i]) < 0) return 127;
+    }
+    for (;;) {
+        dispatch(s);
+        if (!s->unordered) emit_ordered(s);
+        int n = 0;
+        const Buf *p = &s->pending;
+        if (!s->eof && (p->len < s->chunk || !memrchr(p->data, '\n', p->len))) {
+            pfd[n] = (struct pollfd){ STDIN_FILENO, POLLIN, 0 };
+            who[n++] = NULL;
+        }
+        for (int i = 0; i < s->nslots; ++i) {
+            Shard *sh = &s->slot[i];
+            if (sh->in >= 0 && sh->ibuf.off < sh->ibuf.len) { pfd[n] = (struct pollfd){ sh->in, POLLOUT, 0 }; who[n++] = sh; }
+            if (sh->out >= 0) { pfd[n] = (struct pollfd){ sh->out, POLLIN, 0 }; who[n++] = sh; }
+        }
+        if (!n) break;
+        if (poll(pfd, n, -1) < 0) {
+            if (errno == EINTR) continue;
+            return 1;
+        }
+        for (int k = 0; k < n; ++k) {
+            if (!pfd[k].revents) continue;
+            Shard *sh = who[k];
+            if (!sh) {
+                Buf *p = &s->pending;
+                if (buf_reserve(p, p->len + SHARD_READ) != 0) return 1;
+                ssize_t r = read(STDIN_FILENO, p->data + p->len, SHARD_READ);
+                if (r > 0) p->len += (size_t)r;
+                else if (r == 0 || (errno != EINTR && errno != EAGAIN)) s->eof = 1;
+            } else if (pfd[k].fd == sh->in) {
+                feed(sh);
+                if (!s->unordered && sh->ibuf.len == 0) { close(sh->in); sh->in = -1; }
+            } else if (pfd[k].fd == sh->out) {
+                drain(s, sh);
+            }
+        }
+    }
+    return s->status < 0 ? 0 : s->status;
+}
+
+/* Run cmd as cmd->shards replicas behind a splitting and merging helper
+ * that stands in for the stage: reading in_fd, writing out_fd, in group pgid.
+ * Returns the helper's pid, or -1. */
+pid_t shard_launch(Command *cmd, pid_t pgid, int in_fd, int out_fd, const LaunchOpts *opts) {
+    int rfd[2];         /* the stage's own redirections are the helper's, not each replica's */
+    if (redir_begin(cmd, opts ? opts->prealloc : 0, rfd) < 0) return -1;
+    if (rfd[0] >= 0) in_fd = rfd[0];
+    if (rfd[1] >= 0) out_fd = rfd[1];
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid != 0) {
+        if (pid < 0) perror("fork");
+        redir_launched(rfd, pid > 0 ? (pgid ? pgid : pid) : -1);
+        return pid;
+    }
+    static const int sigs[] = { SIGINT, SIGQUIT, SIGTSTP, SIGTTIN, SIGTTOU, SIGCHLD, SIGPIPE };
+    for (size_t i = 0; i < sizeof(sigs) / sizeof(sigs[0]); ++i) signal(sigs[i], SIG_DFL);
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGPIPE);
+    sigprocmask(SIG_SETMASK, &mask, NULL);
+    setpgid(0, pgid);
+    /* Joined here, before any replica is started, so they all inherit it. */
+    if (opts && opts->cgroup_procs_fd >= 0 && write(opts->cgroup_procs_fd, "0", 1) < 0)
+        fprintf(stderr, "cgroup: shards of %s left outside the job cgroup: %s\n", cmd->name, strerror(errno));
+    if (in_fd != -1) dup2(in_fd, STDIN_FILENO);
+    if (out_fd != -1) dup2(out_fd, STDOUT_FILENO);
+    cmd->input_file = cmd->output_file = NULL;
+    if (opts && opts->err_fd >= 0) dup2(opts->err_fd, STDERR_FILENO);
+    close_range(3, ~0U, 0);         /* no stray pipe ends to hold off EOF or SIGPIPE */
+    job_control = 0;
+
+    Sharder s;
+    memset(&s, 0, sizeof(s));
+    s.cmd = cmd;
+    s.n = cmd->shards;
+    s.unordered = cmd->shard_unordered;
+    s.nslots = s.unordered ? s.n : 2 * s.n;     /* in order, finished chunks wait their turn */
+    const char *kb = getenv("CSHELL_SHARD_KB");
+    s.chunk = (size_t)(kb && atoi(kb) > 0 ? atoi(kb) : SHARD_KB_DEFAULT) * 1024;
+    s.status = -1;
+    s.slot = calloc(s.nslots, sizeof(Shard));
+    if (!s.slot) _exit(1);
+    for (int i = 0; i < s.nslots; ++i) { s.slot[i].in = s.slot[i].out = -1; s.slot[i].seq = -1; }
+    _exit(run(&s));
+}
@@ -0,0 +1,307 @@
+#ifndef CSHELL_SHELL_H
+#define CSHELL_SHELL_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/types.h>
+
+#define MAX_LINE 2048
+#define HISTORY_SIZE 200
+#define MAX_JOBS 200
+#define PATH_BUF 1024
+#define SHARD_MAX 64
+
+/* Each Command is one allocation: the struct, then the NULL-terminated argv,
+ * then the strings argv and the redirection targets point at. */
+typedef struct Command {
+    char *name;             /* args[0], NULL for an empty stage */
+    char **args;
+    int argc;
+    int append;
+    int replace;            /* ">!": output replaces the file once the job succeeds */
+    int shards;             /* run as this many replicas ("|N>"), 0 for one process */
+    int shard_unordered;    /* "|Nu>": merge their output as it comes */
+    char *input_file;
+    char *output_file;
+    struct Command *next;
+} Command;
+
+typedef enum { RUNNING, STOPPED, DONE, PENDING } JobState;
+typedef struct Job {
+    int job_id;
+    pid_t pid;              /* last stage; its exit ends the job (0 while PENDING) */
+    pid_t pgid;
+    const char *command;    /* interned in the string pool */
+    JobState state;
+    int cgroup_id;          /* 0 when the job has no cgroup */
+    int status;             /* wait status once DONE */
+    long long start_us;     /* launched (wall clock), 0 while PENDING */
+    long long end_us;       /* finished */
+    long long cpu_us;       /* user+system time of its reaped processes */
+    int killed;             /* last signal a deadline sent it, 0 if none */
+    const char *killed_by;  /* "wall" or "cpu": the deadline that passed */
+} Job;
+
+/* tokenize.c */
+char **tokenize_line(const char *line, int *tok_count_out);
+void free_tokens(char **tokens);
+int token_quoted(const char *tok);
+int token_quote_char(const char *tok);
+size_t subst_close(const char *s, size_t len, size_t i);
+
+/* glob.c */
+int has_glob_chars(const char *word);
+char **expand_word(const char *word, int *count);
+
+/* subst.c */
+int has_subst(const char *word);
+char **subst_word(const char *word, int quoted, int *count);
+char *subst_string(const char *s);
+
+/* parse.c */
+Command *parse_input(const char *rawline);
+void free_command(Command *cmd);
+
+/* alias.c */
+typedef struct Alias { char *name; char *command; } Alias;
+extern Alias *aliases;
+extern int alias_count;
+void add_alias(const char *name, const char *command);
+const char *check_alias(const char *name);
+
+/* rc.c */
+void rc_load(void);
+const char *rc_alias(const char *name);
+void rc_list_aliases(void);
+const char *rc_cached_path(const char *cmd, const char *pathenv);
+void rc_forget_paths(void);
+
+/* history.c */
+extern char *history[HISTORY_SIZE];
+extern int history_count;
+void add_history(const char *line);
+void history_load(void);
+void print_history(void);
+void clear_history(void);
+
+/* strpool.c */
+const char *strpool_intern(const char *s);
+void strpool_release(const char *s);
+
+/* path.c */
+char *find_command_in_path(const char *cmd);
+void path_cache_clear(void);
+void path_cache_prewarm(void);
+void path_cache_add(const char *cmd, const char *full);
+int path_cache_each(void (*fn)(const char *name, const char *full, void *arg), void *arg);
+int handle_hash(Command *cmd);
+
+/* jobs.c */
+extern Job jobs[MAX_JOBS];
+extern int job_count;
+extern int next_job_id;
+void block_sigchld(sigset_t *old);
+void restore_sigmask(const sigset_t *old);
+Job *add_job(pid_t pid, const char *command, JobState state);
+void remove_job(pid_t pid);
+void reap_done_jobs(void);
+Job *find_job(int job_id);
+Job *lookup_job(int job_id);
+void list_jobs(void);
+void list_jobs_long(void);
+void list_jobs_verbose(void);
+int pgrp_members(pid_t pgid, pid_t **out);
+void sigchld_handler(int sig);
+
+/* trace.c */
+struct rusage;
+typedef struct TraceJob {
+    long long arrival_us, cpu_us, end_us;
+    int status;
+    char command[64];
+} TraceJob;
+long long trace_now_us(void);
+long long rusage_cpu_us(const struct rusage *ru);
+void trace_job(long long arrival_us, long long cpu_us, long long end_us, int status, const char *command);
+int trace_load(const char *path, TraceJob **out);
+
+/* exec.c */
+typedef enum { LAUNCH_FORK, LAUNCH_VFORK, LAUNCH_SPAWN } Launcher;
+extern Launcher shell_launcher;
+extern int job_control;
+extern int last_status;
+int parse_launcher(const char *name, Launcher *out);
+const char *launcher_name(Launcher l);
+typedef struct LaunchOpts {
+    int cgroup_procs_fd;    /* job cgroup to join before exec, or -1 */
+    const cpu_set_t *cpus;  /* affinity to run with, or NULL to inherit */
+    int mem_node;           /* NUMA node to bind memory to, or -1 */
+    int err_fd;             /* stderr, or -1 to inherit */
+    long long prealloc;     /* bytes to reserve for a '>' file, 0 for none */
+} LaunchOpts;
+/* Per-job options set by command prefixes such as "pin". */
+typedef struct JobOpts {
+    int place;              /* put stages on distinct cores */
+    int bind_mem;           /* and bind each stage's memory to its node */
+    int have_cpus;          /* cpus restricts placement; else the shell's affinity */
+    cpu_set_t cpus;
+    int meter;              /* sample the pipes between stages (CSHELL_PIPE_METER=1) */
+    long long timeout_us;   /* wall-clock deadline ("timeout"), 0 for none */
+    long long kill_after_us;    /* SIGTERM to SIGKILL grace, -1 for the default */
+    long long prealloc;     /* "prealloc": bytes to reserve for '>' files */
+    int job_id;             /* pending job to start, 0 for a new job */
+    int out_fd;             /* stdout of the last stage (closed once used), or -1 */
+    int err_fd;             /* stderr of every stage (closed once used), or -1 */
+    int output_fd;          /* read end of a background job's captured output, or -1 */
+    int capture_fd;         /* non-blocking; read into capture() while the job runs in the foreground, or -1 */
+    void (*capture)(const char *buf, size_t len, void *arg);
+    void *capture_arg;
+    int status;             /* wait status of a foreground job */
+} JobOpts;
+pid_t launch_command(Command *cmd, pid_t pgid, int in_fd, int out_fd, Launcher how, const LaunchOpts *opts);
+void job_opts_init(JobOpts *jo, const Command *cmd_list);
+void drain_capture(JobOpts *jo, int reads);
+int execute_pipeline(Command *cmd_list, int background, const char *full_line, JobOpts *jo);
+int execute_job(Command *cmd_list, int background, const char *full_line, JobOpts *jo);
+int execute_command(Command *cmd_list, int background, const char *full_line);
+int execute_pending(Command *cmd_list, const char *line, int job_id);
+int execute_line(char *line);
+
+/* builtins.c */
+int handle_builtin(Command *cmd);
+
+/* vfs.c */
+void vfs_create(const char *filename);
+void vfs_mkdir(const char *path);
+void vfs_write(const char *filename, const char *data);
+void vfs_cat(const char *filename);
+void vfs_ls(const char *path);
+void vfs_rm(const char *filename);
+void vfs_mv(const char *from, const char *to);
+void vfs_cd(const char *path);
+void vfs_pwd(void);
+int vfs_read(const char *path, char *buf, size_t size);
+void vfs_snapshot(const char *name);
+void vfs_snapshot_drop(const char *name);
+void vfs_snapshot_list(void);
+void vfs_restore(const char *name);
+#define VFS_LOOKUP_NOCACHE 1    /* walk without the dentry cache */
+int vfs_lookup(const char *path, int flags);
+#define VFS_GREP_COUNT 1    /* matching lines per file */
+#define VFS_GREP_LIST 2     /* names of matching files */
+#define VFS_GREP_SCAN 4     /* bypass the trigram index */
+int vfs_grep(const char *pattern, int flags);
+int handle_vfs(Command *cmd);
+
+/* vfs_index.c */
+void vfs_index_add(uint32_t id, const char *data, size_t len);
+void vfs_index_remove(uint32_t id, const char *data, size_t len);
+int vfs_index_candidates(const char *pat, size_t len, uint32_t limit, uint32_t **out);
+const char *vfs_find(const char *hay, size_t hlen, const char *needle, size_t nlen);
+
+/* cgroup.c */
+typedef struct CgroupUsage {
+    long long cpu_usec;     /* -1 when unavailable */
+    long long mem_bytes;
+    double cpu_psi, mem_psi, io_psi;    /* "some" avg10, -1 when unavailable */
+} CgroupUsage;
+int cgroup_available(void);
+int cgroup_jobs_enabled(void);
+int cgroup_create_job(void);
+int cgroup_procs_fd(int id);
+int cgroup_attach_fd(int procs_fd, pid_t pid);
+void cgroup_release(int id);
+int cgroup_usage(int id, CgroupUsage *u);
+int handle_limit(Command *cmd);
+long long parse_size(const char *s);
+
+/* affinity.c */
+int parse_cpulist(const char *s, cpu_set_t *set);
+int affinity_plan(int n, const cpu_set_t *allowed, cpu_set_t *stage_sets, int *stage_nodes);
+int pin_prefix(Command *cmd, JobOpts *jo);
+int handle_pin(Command *cmd);
+
+/* loop.c */
+void loop_init(void);
+void loop_wake(void);
+char *loop_read_line(void);
+int loop_wait_child(void);
+pid_t loop_wait_fg(pid_t pgid, int *status, struct rusage *ru, JobOpts *jo);
+
+/* capture.c */
+#define CAPTURE_MAX 32
+#define CAPTURE_READS 16            /* per wakeup, so a chatty job can't hog the loop */
+struct pollfd;
+int capture_enabled(void);
+int capture_begin(JobOpts *jo);
+int capture_attach(int job_id, int fd);
+int capture_open(void);
+int capture_pollfds(struct pollfd *pfd);
+void capture_events(const struct pollfd *pfd, int n);
+int capture_show(Command *cmd);
+
+/* deadline.c */
+long long parse_duration(const char *s);
+int deadline_fd(void);
+void deadline_fire(void);
+void deadline_set(pid_t pgid, long long wall_us, long long grace_us);
+void deadline_reaped(pid_t pgid, long long cpu_us);
+int deadline_end(pid_t pgid);
+int deadline_key(const char *key, const char *val);
+int deadline_limit(Job *job, const char *key, const char *val);
+int timeout_prefix(Command *cmd, JobOpts *jo);
+
+/* meter.c */
+typedef struct Meter Meter;
+int meter_enabled(void);
+Meter *meter_begin(int nstages);
+void meter_pipe(Meter *m, int i, int fd);
+void meter_stage(Meter *m, int i, pid_t pid, pid_t pgid, const char *name);
+void meter_cancel(Meter *m);
+void meter_end(pid_t pgid);
+void meter_tick(void);
+int meter_timeout(void);
+void meter_print(pid_t pgid);
+
+/* prewarm.c */
+void prewarm_start(void);
+int prewarm_fd(void);
+void prewarm_collect(void);
+int prewarm_timeout(void);
+void prewarm_idle(void);
+void prewarm_activity(void);
+int prewarm_binary(const char *path, int advice, int verbose);
+int handle_prewarm(Command *cmd);
+
+/* dag.c */
+int dag_after(const char *line);
+void dag_schedule(void);
+void dag_note_exit(int job_id, int status);
+int handle_dag(Command *cmd);
+
+/* memo.c */
+int memo_run(Command *cmd_list, int background, const char *full_line, JobOpts *jo);
+
+/* server.c */
+int server_main(const char *sock_path, int workers);
+int server_request(const char *sock_path, const char *script, const int fds[3]);
+
+/* sched.c */
+int handle_schedule(Command *cmd);
+
+/* redir.c */
+int redir_begin(const Command *cmd, long long prealloc, int fds[2]);
+void redir_launched(int fds[2], pid_t pgid);
+void redir_end(pid_t pgid, int status);
+int prealloc_prefix(Command *cmd, JobOpts *jo);
+
+/* shard.c */
+pid_t shard_launch(Command *cmd, pid_t pgid, int in_fd, int out_fd, const LaunchOpts *opts);
+
+/* coproc.c */
+int handle_coproc(Command *cmd);
+
+#endif
@@ -0,0 +1,78 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "shell.h"
+
+/* Reference-counted string interning. Identical strings share one copy, so the
+ * job table holds a pointer per job instead of a fixed line-sized buffer. */
+
+typedef struct PoolEntry {
+    struct PoolEntry *next;
+    uint32_t hash;
+    int refs;
+    char str[];
+} PoolEntry;
+
+static PoolEntry **pool_buckets = NULL;
+static size_t pool_nbuckets = 0;
+static size_t pool_count = 0;
+
+static uint32_t pool_hash(const char *s) {
+    uint32_t h = 2166136261u;                       /* FNV-1a */
+    for (; *s; ++s) { h ^= (unsigned char)*s; h *= 16777619u; }
+    return h;
+}
+
+static int pool_grow(void) {
+    size_t n = pool_nbuckets ? pool_nbuckets * 2 : 64;
+    PoolEntry **nb = calloc(n, sizeof(*nb));
+    if (!nb) return -1;
+    for (size_t i = 0; i < pool_nbuckets; ++i) {
+        PoolEntry *e = pool_buckets[i];
+        while (e) {
+            PoolEntry *next = e->next;
+            e->next = nb[e->hash & (n - 1)];
+            nb[e->hash & (n - 1)] = e;
+            e = next;
+        }
+    }
+    free(pool_buckets);
+    pool_buckets = nb;
+    pool_nbuckets = n;
+    return 0;
+}
+
+const char *strpool_intern(const char *s) {
+    if (!s) s = "";
+    uint32_t h = pool_hash(s);
+    if (pool_nbuckets) {
+        for (PoolEntry *e = pool_buckets[h & (pool_nbuckets - 1)]; e; e = e->next) {
+            if (e->hash == h && strcmp(e->str, s) == 0) { ++e->refs; return e->str; }
+        }
+    }
+    if (pool_count >= pool_nbuckets && pool_grow() != 0 && !pool_nbuckets) return NULL;
+    size_t len = strlen(s);
+    PoolEntry *e = malloc(sizeof(PoolEntry) + len + 1);
+    if (!e) return NULL;
+    memcpy(e->str, s, len + 1);
+    e->hash = h;
+    e->refs = 1;
+    PoolEntry **b = &pool_buckets[h & (pool_nbuckets - 1)];
+    e->next = *b;
+    *b = e;
+    ++pool_count;
+    return e->str;
+}
+
+void strpool_release(const char *s) {
+    if (!s) return;
+    PoolEntry *e = (PoolEntry *)(s - offsetof(PoolEntry, str));
+    if (--e->refs > 0) return;
+    PoolEntry **pp = &pool_buckets[e->hash & (pool_nbuckets - 1)];
+    while (*pp && *pp != e) pp = &(*pp)->next;
+    if (*pp) *pp = e->next;
+    --pool_count;
+    free(e);
+}
@@ -0,0 +1,187 @@
+#include <stdio.h>
+#include <stdio_ext.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/wait.h>
+
+#include "shell.h"
+
+/* Command substitution: $(cmd) and `cmd`.
+ *
+ * Builtins that only report (pwd, history, jobs, vfs cat/ls/pwd/grep, alias
+ * and hash without arguments) run in the shell itself with stdout pointed at a
+ * memory stream: no fork, no pipe. Anything else runs in a forked subshell,
+ * like POSIX says, whose output is read from a pipe; so "cd" or "exit" inside
+ * a substitution don't touch the shell. Trailing newlines are dropped, and an
+ * unquoted result is split into words at blanks and newlines. */
+
+typedef struct SubstBuf {
+    char *data;
+    size_t len, cap;
+} SubstBuf;
+
+static int buf_add(SubstBuf *b, const char *s, size_t n) {
+    if (b->len + n + 1 > b->cap) {
+        size_t ncap = b->cap ? b->cap * 2 : 256;
+        while (ncap < b->len + n + 1) ncap *= 2;
+        char *tmp = realloc(b->data, ncap);
+        if (!tmp) return -1;
+        b->data = tmp;
+        b->cap = ncap;
+    }
+    memcpy(b->data + b->len, s, n);
+    b->len += n;
+    b->data[b->len] = '\0';
+    return 0;
+}
+
+/* Builtins whose only effect is what they print, and coproc replies, which
+ * only the shell holding the coproc can read. */
+static int report_only(const Command *cmd) {
+    const char *n = cmd->name, *a = cmd->args[1];
+    if (cmd->next || cmd->input_file || cmd->output_file || !n) return 0;
+    if (strcmp(n, "pwd") == 0 || strcmp(n, "history") == 0 || strcmp(n, "jobs") == 0) return 1;
+    if (strcmp(n, "alias") == 0 || strcmp(n, "hash") == 0) return a == NULL;
+    if (strcmp(n, "coproc") == 0) return a && (strcmp(a, "call") == 0 || strcmp(a, "read") == 0);
+    if (strcmp(n, "vfs") == 0) return a && (strcmp(a, "cat") == 0 || strcmp(a, "ls") == 0 || strcmp(a, "pwd") == 0 || strcmp(a, "grep") == 0);
+    return 0;
+}
+
+static void run_in_process(Command *cmd, SubstBuf *out) {
+    char *data = NULL;
+    size_t len = 0;
+    fflush(stdout);
+    FILE *mem = open_memstream(&data, &len), *saved = stdout;
+    if (!mem) return;
+    stdout = mem;
+    last_status = 0;
+    handle_builtin(cmd);
+    stdout = saved;
+    fclose(mem);
+    buf_add(out, data, len);
+    free(data);
+}
+
+static void run_subshell(Command *cmd, const char *text, SubstBuf *out) {
+    int p[2];
+    if (pipe2(p, O_CLOEXEC) < 0) { perror("pipe"); return; }
+    fflush(stdout);
+    fflush(stderr);
+    sigset_t old;
+    block_sigchld(&old);
+    pid_t pid = fork();
+    if (pid == 0) {
+        restore_sigmask(&old);
+        __fpurge(stdin);            /* exit() must not seek the shared input back */
+        dup2(p[1], STDOUT_FILENO);
+        job_control = 0;            /* the terminal stays with the shell */
+        execute_command(cmd, 0, text);
+        fflush(stdout);
+        _exit(last_status);
+    }
+    close(p[1]);
+    char chunk[4096];
+    ssize_t n;
+    while (pid > 0 && ((n = read(p[0], chunk, sizeof(chunk))) > 0 || (n < 0 && errno == EINTR))) {
+        if (n > 0 && buf_add(out, chunk, (size_t)n) != 0) break;
+    }
+    close(p[0]);
+    int status = 0;
+    if (pid < 0) { perror("fork"); status = 1 << 8; }
+    else while (waitpid(pid, &status, 0) < 0 && errno == EINTR) { }
+    restore_sigmask(&old);
+    last_status = WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+}
+
+/* Append the output of the command text[0..len) to out, without its trailing
+ * newlines. */
+static void subst_run(const char *text, size_t len, SubstBuf *out) {
+    char *line = strndup(text, len);
+    Command *cmd = line ? parse_input(line) : NULL;
+    size_t start = out->len;
+    if (cmd && report_only(cmd)) run_in_process(cmd, out);
+    else if (cmd) run_subshell(cmd, line, out);
+    while (out->len > start && out->data[out->len - 1] == '\n') out->data[--out->len] = '\0';
+    free_command(cmd);
+    free(line);
+}
+
+/* word with every substitution in it replaced by its output. */
+static int subst_expand(const char *word, SubstBuf *b) {
+    size_t len = strlen(word);
+    for (size_t i = 0; i < len;) {
+        size_t lit = strcspn(word + i, "$`");
+        if (lit && buf_add(b, word + i, lit) != 0) return -1;
+        i += lit;
+        if (i >= len) break;
+        size_t body = 0, close = len;
+        if (i > 0 && word[i - 1] == '\\') {
+            /* \$( and \` stay literal, backslash included, as everywhere else */
+        } else if (word[i] == '`') {
+            const char *q = memchr(word + i + 1, '`', len - i - 1);
+            body = i + 1;
+            if (q) close = (size_t)(q - word);
+        } else if (word[i + 1] == '(' && word[i + 2] != '(') {      /* not $(( arithmetic )) */
+            body = i + 2;
+            close = subst_close(word, len, body);
+        }
+        if (!body) {
+            if (buf_add(b, word + i, 1) != 0) return -1;
+            ++i;
+            continue;
+        }
+        if (close >= len) { fprintf(stderr, "syntax error: unterminated command substitution\n"); return buf_add(b, word + i, len - i); }
+        subst_run(word + body, close - body, b);
+        i = close + 1;
+    }
+    return b->data || buf_add(b, "", 0) == 0 ? 0 : -1;
+}
+
+int has_subst(const char *word) {
+    return strchr(word, '`') || strstr(word, "$(");
+}
+
+/* Expand the substitutions in word. Unless quoted, the result is split into
+ * fields at blanks and newlines. Returns a NULL-terminated array in one
+ * allocation (release with free_tokens()), and its length in *count. */
+char **subst_word(const char *word, int quoted, int *count) {
+    SubstBuf b = { NULL, 0, 0 };
+    *count = 0;
+    if (subst_expand(word, &b) != 0) { free(b.data); return NULL; }
+    int n = 0;
+    const char *ifs = " \t\n";
+    if (!quoted) {
+        for (const char *s = b.data + strspn(b.data, ifs); *s; s += strspn(s, ifs)) { ++n; s += strcspn(s, ifs); }
+    } else {
+        n = 1;
+    }
+    char **out = malloc((n + 1) * sizeof(char *) + b.len + 1);
+    if (!out) { free(b.data); return NULL; }
+    char *dst = (char *)(out + n + 1);
+    if (quoted) {
+        out[0] = memcpy(dst, b.data, b.len + 1);
+    } else {
+        int k = 0;
+        for (const char *s = b.data + strspn(b.data, ifs); *s; s += strspn(s, ifs)) {
+            size_t w = strcspn(s, ifs);
+            out[k++] = memcpy(dst, s, w);
+            dst[w] = '\0';
+            dst += w + 1;
+            s += w;
+        }
+    }
+    out[n] = NULL;
+    *count = n;
+    free(b.data);
+    return out;
+}
+
+/* The prompt, or any other string, with its substitutions expanded. */
+char *subst_string(const char *s) {
+    SubstBuf b = { NULL, 0, 0 };
+    if (subst_expand(s, &b) != 0) { free(b.data); return NULL; }
+    return b.data;
+}
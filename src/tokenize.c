@@ -0,0 +1,245 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "shell.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TOKENIZE_X86 1
+#endif
+
+/* Byte classes. Whitespace matches isspace() in the C locale; "special" is
+ * anything that ends a bare word: whitespace and the operators. Quotes only
+ * open a quoted token at the start of a word. */
+#define CLS_WS 1
+#define CLS_SP 2
+
+static uint8_t cls_table[256];
+static int cls_ready = 0;
+
+static void cls_init(void) {
+    if (cls_ready) return;
+    const char *ws = " \t\n\v\f\r";
+    const char *sp = "<>|";
+    for (const char *c = ws; *c; ++c) cls_table[(unsigned char)*c] = CLS_WS | CLS_SP;
+    for (const char *c = sp; *c; ++c) cls_table[(unsigned char)*c] = CLS_SP;
+    cls_ready = 1;
+}
+
+/* Classify n (< 64) bytes at p into bit i of *ws / *sp. */
+static void classify_scalar(const char *p, size_t n, uint64_t *ws, uint64_t *sp) {
+    uint64_t w = 0, s = 0;
+    for (size_t i = 0; i < n; ++i) {
+        uint8_t c = cls_table[(unsigned char)p[i]];
+        w |= (uint64_t)(c & CLS_WS) << i;
+        s |= (uint64_t)((c & CLS_SP) >> 1) << i;
+    }
+    *ws = w; *sp = s;
+}
+
+#ifdef TOKENIZE_X86
+static void classify64_sse2(const char *p, uint64_t *ws, uint64_t *sp) {
+    const __m128i nine = _mm_set1_epi8(9), four = _mm_set1_epi8(4);
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i lt = _mm_set1_epi8('<'), gt = _mm_set1_epi8('>'), bar = _mm_set1_epi8('|');
+    uint64_t w = 0, s = 0;
+    for (int k = 0; k < 4; ++k) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + 16 * k));
+        __m128i ctl = _mm_sub_epi8(v, nine);                    /* \t..\r -> 0..4 */
+        __m128i isws = _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(ctl, four), ctl), _mm_cmpeq_epi8(v, space));
+        __m128i issp = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, lt), _mm_cmpeq_epi8(v, gt)),
+                                    _mm_cmpeq_epi8(v, bar));
+        w |= (uint64_t)(uint16_t)_mm_movemask_epi8(isws) << (16 * k);
+        s |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_or_si128(isws, issp)) << (16 * k);
+    }
+    *ws = w; *sp = s;
+}
+
+__attribute__((target("avx2")))
+static void classify64_avx2(const char *p, uint64_t *ws, uint64_t *sp) {
+    const __m256i nine = _mm256_set1_epi8(9), four = _mm256_set1_epi8(4);
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i lt = _mm256_set1_epi8('<'), gt = _mm256_set1_epi8('>'), bar = _mm256_set1_epi8('|');
+    uint64_t w = 0, s = 0;
+    for (int k = 0; k < 2; ++k) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(p + 32 * k));
+        __m256i ctl = _mm256_sub_epi8(v, nine);
+        __m256i isws = _mm256_or_si256(_mm256_cmpeq_epi8(_mm256_min_epu8(ctl, four), ctl), _mm256_cmpeq_epi8(v, space));
+        __m256i issp = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, lt), _mm256_cmpeq_epi8(v, gt)),
+                                       _mm256_cmpeq_epi8(v, bar));
+        w |= (uint64_t)(uint32_t)_mm256_movemask_epi8(isws) << (32 * k);
+        s |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_or_si256(isws, issp)) << (32 * k);
+    }
+    *ws = w; *sp = s;
+}
+#endif
+
+typedef void (*classify64_fn)(const char *, uint64_t *, uint64_t *);
+
+#ifndef TOKENIZE_X86
+static void classify64_scalar(const char *p, uint64_t *ws, uint64_t *sp) { classify_scalar(p, 64, ws, sp); }
+#endif
+
+static classify64_fn pick_classifier(void) {
+#ifdef TOKENIZE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return classify64_avx2;
+    return classify64_sse2;
+#else
+    return classify64_scalar;
+#endif
+}
+
+/* Fill whitespace/special bitmaps for the whole line, 64 bytes per word. */
+static void classify_line(const char *line, size_t len, uint64_t *ws, uint64_t *sp) {
+    static classify64_fn classify64 = NULL;
+    if (!classify64) classify64 = pick_classifier();
+    size_t w = 0, off = 0;
+    for (; off + 64 <= len; off += 64, ++w) classify64(line + off, &ws[w], &sp[w]);
+    if (off < len) classify_scalar(line + off, len - off, &ws[w], &sp[w]);
+}
+
+/* First position >= pos whose bit equals want, or len if there is none. */
+static size_t scan_bits(const uint64_t *bits, size_t len, size_t pos, int want) {
+    size_t nwords = (len + 63) / 64;
+    size_t w = pos / 64;
+    if (w >= nwords) return len;
+    uint64_t word = (want ? bits[w] : ~bits[w]) & (~0ULL << (pos % 64));
+    while (!word) {
+        if (++w >= nwords) return len;
+        word = want ? bits[w] : ~bits[w];
+    }
+    size_t at = w * 64 + (size_t)__builtin_ctzll(word);
+    return at < len ? at : len;
+}
+
+typedef struct { size_t off, len; int quoted; } Span;
+
+void free_tokens(char **tokens) {
+    free(tokens);
+}
+
+/* Whether a token returned by tokenize_line() came from quotes, and so must not
+ * be treated as an operator or expanded. */
+int token_quoted(const char *tok) {
+    return tok[-1] != 0;
+}
+
+/* The quote character a token came from, or 0 for a bare word. */
+int token_quote_char(const char *tok) {
+    return tok[-1];
+}
+
+/* Index of the ')' closing a "$(" whose body starts at s[i], or len. Quoted
+ * text inside the body is skipped. */
+size_t subst_close(const char *s, size_t len, size_t i) {
+    int depth = 1;
+    for (; i < len; ++i) {
+        char c = s[i];
+        if (c == '\'' || c == '"') {
+            const char *q = memchr(s + i + 1, c, len - i - 1);
+            if (!q) return len;
+            i = (size_t)(q - s);
+        } else if (c == '(') {
+            ++depth;
+        } else if (c == ')' && --depth == 0) {
+            return i;
+        }
+    }
+    return len;
+}
+
+/* A bare word [p, end) that contains $(...) or `...` runs on to the end of the
+ * substitution, blanks and operators inside it included. */
+static size_t subst_word_end(const char *line, size_t len, size_t p, size_t end, const uint64_t *sp) {
+    for (size_t i = p; i < end; ++i) {
+        if (line[i] == '`') {
+            const char *close = memchr(line + i + 1, '`', len - i - 1);
+            i = close ? (size_t)(close - line) : len;
+        } else if (line[i] == '$' && i + 1 < len && line[i+1] == '(') {
+            i = subst_close(line, len, i + 2);
+        } else {
+            continue;
+        }
+        if (i >= len) return len;
+        if (i >= end) end = scan_bits(sp, len, i + 1, 1);
+    }
+    return end;
+}
+
+/* Split line into words, quoted strings and the operators < > >> >! | |N> |Nu>.
+ * Token boundaries come from a bulk SIMD classification of the line; the result is a
+ * single allocation holding the NULL-terminated pointer array followed by the
+ * token text, released with free_tokens(). Each token is preceded by a flag
+ * byte read back by token_quoted(): the quote character, or 0. */
+char **tokenize_line(const char *line, int *tok_count_out) {
+    if (!line) { if (tok_count_out) *tok_count_out = 0; return NULL; }
+    cls_init();
+    size_t len = strlen(line);
+    size_t nwords = (len + 63) / 64;
+
+    uint64_t stack_bits[2 * 64];
+    Span stack_spans[64];
+    uint64_t *bits = nwords <= 64 ? stack_bits : malloc(2 * nwords * sizeof(uint64_t));
+    Span *spans = stack_spans;
+    size_t cap = 64, n = 0, text = 0;
+    char **tokens = NULL;
+    if (!bits) return NULL;
+    uint64_t *ws = bits, *sp = bits + nwords;
+    classify_line(line, len, ws, sp);
+    int subst = memchr(line, '`', len) || memchr(line, '(', len);     /* cheap superset of "$(" */
+
+    size_t p = 0;
+    while ((p = scan_bits(ws, len, p, 0)) < len) {
+        if (n == cap) {
+            Span *tmp = malloc(2 * cap * sizeof(Span));
+            if (!tmp) goto out;
+            memcpy(tmp, spans, n * sizeof(Span));
+            if (spans != stack_spans) free(spans);
+            spans = tmp;
+            cap *= 2;
+        }
+        char c = line[p];
+        if (c == '"' || c == '\'') {
+            const char *close = memchr(line + p + 1, c, len - p - 1);
+            size_t end = close ? (size_t)(close - line) : len;
+            spans[n++] = (Span){ p + 1, end - p - 1, c };
+            p = close ? end + 1 : len;
+        } else if (c == '>' || c == '<' || c == '|') {
+            size_t l = (c == '>' && (line[p+1] == '>' || line[p+1] == '!')) ? 2 : 1;
+            if (c == '|') {                 /* "|N>" and "|Nu>" shard the next stage */
+                size_t d = p + 1;
+                while (d < len && line[d] >= '0' && line[d] <= '9') ++d;
+                if (d > p + 1 && d < len && line[d] == 'u') ++d;
+                if (d > p + 1 && d < len && line[d] == '>') l = d + 1 - p;
+            }
+            spans[n++] = (Span){ p, l, 0 };
+            p += l;
+        } else {
+            size_t end = scan_bits(sp, len, p, 1);
+            if (subst) end = subst_word_end(line, len, p, end, sp);
+            spans[n++] = (Span){ p, end - p, 0 };
+            p = end;
+        }
+        text += spans[n-1].len + 2;
+    }
+
+    tokens = malloc((n + 1) * sizeof(char *) + text);
+    if (tokens) {
+        char *dst = (char *)(tokens + n + 1);
+        for (size_t i = 0; i < n; ++i) {
+            *dst++ = (char)spans[i].quoted;
+            tokens[i] = dst;
+            memcpy(dst, line + spans[i].off, spans[i].len);
+            dst[spans[i].len] = '\0';
+            dst += spans[i].len + 1;
+        }
+        tokens[n] = NULL;
+        if (tok_count_out) *tok_count_out = (int)n;
+    }
+out:
+    if (spans != stack_spans) free(spans);
+    if (bits != stack_bits) free(bits);
+    return tokens;
+}
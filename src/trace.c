@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "shell.h"
+
+/* Job trace. With CSHELL_TRACE=FILE, every job that finishes appends a line
+ *
+ *   arrival_us  cpu_us  completion_us  status  command
+ *
+ * (wall-clock microseconds, user+system cpu of all its processes from the
+ * rusage wait4() returns, and the raw wait status). "schedule replay" feeds
+ * such a file back through the scheduling simulators. One write() per line
+ * with O_APPEND, so several shells can share a trace. */
+
+#define TRACE_HEADER "# cshell job trace: arrival_us cpu_us completion_us status command\n"
+
+static int trace_fd = -1;
+static char *trace_path = NULL;     /* what trace_fd is open on */
+
+long long trace_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+long long rusage_cpu_us(const struct rusage *ru) {
+    return (long long)(ru->ru_utime.tv_sec + ru->ru_stime.tv_sec) * 1000000 + ru->ru_utime.tv_usec + ru->ru_stime.tv_usec;
+}
+
+static int trace_open(void) {
+    const char *path = getenv("CSHELL_TRACE");
+    if (!path || !*path) return -1;
+    if (trace_path && strcmp(trace_path, path) == 0) return trace_fd;
+    if (trace_fd >= 0) close(trace_fd);
+    free(trace_path);
+    trace_path = strdup(path);
+    trace_fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (trace_fd < 0) { fprintf(stderr, "cshell: trace %s: %m\n", path); return -1; }
+    if (lseek(trace_fd, 0, SEEK_END) == 0 && write(trace_fd, TRACE_HEADER, sizeof(TRACE_HEADER) - 1) < 0) { }
+    return trace_fd;
+}
+
+void trace_job(long long arrival_us, long long cpu_us, long long end_us, int status, const char *command) {
+    if (arrival_us <= 0) return;                /* never started */
+    int fd = trace_open();
+    if (fd < 0) return;
+    char line[MAX_LINE + 96];
+    int n = snprintf(line, sizeof(line), "%lld\t%lld\t%lld\t%d\t", arrival_us, cpu_us, end_us, status);
+    for (const char *c = command ? command : ""; *c && n < (int)sizeof(line) - 2; ++c)
+        line[n++] = (*c == '\n' || *c == '\t') ? ' ' : *c;
+    line[n++] = '\n';
+    if (write(fd, line, (size_t)n) < 0) { }
+}
+
+static int by_arrival(const void *a, const void *b) {
+    const TraceJob *x = a, *y = b;
+    return (x->arrival_us > y->arrival_us) - (x->arrival_us < y->arrival_us);
+}
+
+/* Read a trace into a malloc'd array, oldest arrival first. Returns the count
+ * or -1 if the file can't be read. */
+int trace_load(const char *path, TraceJob **out) {
+    FILE *f = fopen(path, "re");
+    if (!f) return -1;
+    TraceJob *v = NULL;
+    int n = 0, cap = 0;
+    char *line = NULL;
+    size_t len = 0;
+    while (getline(&line, &len, f) > 0) {
+        TraceJob t;
+        int off = 0;
+        if (line[0] == '#' || sscanf(line, "%lld %lld %lld %d %n", &t.arrival_us, &t.cpu_us, &t.end_us, &t.status, &off) != 4) continue;
+        line[strcspn(line, "\n")] = '\0';
+        if (n == cap) {
+            cap = cap ? cap * 2 : 64;
+            TraceJob *tmp = realloc(v, cap * sizeof(TraceJob));
+            if (!tmp) break;
+            v = tmp;
+        }
+        snprintf(t.command, sizeof(t.command), "%s", line + off);
+        v[n++] = t;
+    }
+    free(line);
+    fclose(f);
+    if (n > 1) qsort(v, n, sizeof(TraceJob), by_arrival);
+    *out = v;
+    return n;
+}
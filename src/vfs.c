@@ -0,0 +1,681 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "shell.h"
+
+#define VFS_MAX_FILES 65536
+#define VFS_MAX_SNAPSHOTS 16
+#define VFS_BLOCK_SIZE 128
+#define VFS_NAME_LEN 32     /* per path component */
+#define VFS_ROOT 0          /* inode of "/" */
+#define VFS_DIR 1
+#define VFS_LOCK_STRIPES 64
+#define DCACHE_STRIPES 16
+
+typedef struct VFS_File {
+    char name[VFS_NAME_LEN];
+    int inode;
+    int parent;             /* inode of the containing directory */
+    int mode;               /* VFS_DIR or 0 */
+    int size;               /* bytes; entries for a directory */
+    int refs;               /* tables holding this record */
+    time_t created;
+    time_t modified;
+    char data[VFS_BLOCK_SIZE * 4];
+} VFS_File;
+
+/* The tree is a table of pointers to file records, sorted by inode (never
+ * reused, so creation order); the root is files[0]. Directories are records
+ * like any other, and a file's place in the tree is just its parent's inode,
+ * so a rename or move touches one record however much hangs below it. The
+ * trigram index refers to files by inode.
+ *
+ * Snapshots share structure with the live tree. Taking one only adds a
+ * reference to the table. The first change after that copies the pointer
+ * table (not the records), and a record that is still shared is copied just
+ * before it is modified. */
+typedef struct VfsTable {
+    int refs;               /* the live tree and the snapshots using it */
+    int count, cap;
+    VFS_File **files;
+} VfsTable;
+
+typedef struct VfsSnapshot {
+    char name[VFS_NAME_LEN];
+    VfsTable *table;
+} VfsSnapshot;
+
+/* Locking: vfs_lock guards the shape of the tree. Lookups, reads and data
+ * writes hold it shared; create, mkdir, rm, mv, cd, snapshot and restore hold
+ * it exclusively. A file's data is guarded by one of VFS_LOCK_STRIPES rwlocks
+ * picked by inode, so readers and writers of different files don't contend.
+ * A data write to a record that a snapshot still shares needs the exclusive
+ * lock, since copying it changes the table. */
+static pthread_rwlock_t vfs_lock = PTHREAD_RWLOCK_INITIALIZER;
+static pthread_rwlock_t file_locks[VFS_LOCK_STRIPES] = { [0 ... VFS_LOCK_STRIPES - 1] = PTHREAD_RWLOCK_INITIALIZER };
+static pthread_once_t vfs_once = PTHREAD_ONCE_INIT;
+
+static VfsTable *vfs_live = NULL;
+static VfsSnapshot vfs_snaps[VFS_MAX_SNAPSHOTS];
+static int vfs_snap_count = 0;
+static int vfs_next_inode = 1;
+static int vfs_cwd = VFS_ROOT;
+
+static void vfs_setup(void) {
+    vfs_live = calloc(1, sizeof(VfsTable));
+    VFS_File *root = calloc(1, sizeof(VFS_File));
+    VFS_File **files = malloc(32 * sizeof(VFS_File *));
+    if (!vfs_live || !root || !files) { fprintf(stderr, "vfs: out of memory\n"); exit(1); }
+    root->inode = root->parent = VFS_ROOT;
+    root->mode = VFS_DIR;
+    root->refs = 1;
+    root->created = root->modified = time(NULL);
+    files[0] = root;
+    vfs_live->refs = 1;
+    vfs_live->count = 1;
+    vfs_live->cap = 32;
+    vfs_live->files = files;
+}
+
+static void rdlock(void) { pthread_once(&vfs_once, vfs_setup); pthread_rwlock_rdlock(&vfs_lock); }
+static void wrlock(void) { pthread_once(&vfs_once, vfs_setup); pthread_rwlock_wrlock(&vfs_lock); }
+static void unlock(void) { pthread_rwlock_unlock(&vfs_lock); }
+static pthread_rwlock_t *file_lock(const VFS_File *f) { return &file_locks[(unsigned)f->inode % VFS_LOCK_STRIPES]; }
+
+static VFS_File **slot_of(const VfsTable *t, int inode) {
+    int lo = 0, hi = t->count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (t->files[mid]->inode < inode) lo = mid + 1; else hi = mid;
+    }
+    return lo < t->count && t->files[lo]->inode == inode ? &t->files[lo] : NULL;
+}
+
+static VFS_File *vfs_by_inode(int inode) {
+    VFS_File **s = slot_of(vfs_live, inode);
+    return s ? *s : NULL;
+}
+
+static void table_release(VfsTable *t) {
+    if (--t->refs > 0) return;
+    for (int i = 0; i < t->count; ++i) if (--t->files[i]->refs == 0) free(t->files[i]);
+    free(t->files);
+    free(t);
+}
+
+/* Give the live tree a table of its own, if a snapshot shares it. */
+static int table_unshare(void) {
+    VfsTable *t = vfs_live;
+    if (t->refs == 1) return 0;
+    VfsTable *c = malloc(sizeof(VfsTable));
+    VFS_File **files = c ? malloc(t->cap * sizeof(VFS_File *)) : NULL;
+    if (!files) { free(c); return -1; }
+    memcpy(files, t->files, t->count * sizeof(VFS_File *));
+    for (int i = 0; i < t->count; ++i) ++files[i]->refs;
+    c->refs = 1;
+    c->count = t->count;
+    c->cap = t->cap;
+    c->files = files;
+    --t->refs;
+    vfs_live = c;
+    return 0;
+}
+
+/* The live record for inode, copied first if a snapshot still has it.
+ * Exclusive lock only; earlier pointers to the record may go stale. */
+static VFS_File *writable(int inode) {
+    if (table_unshare() != 0) return NULL;
+    VFS_File **s = slot_of(vfs_live, inode);
+    if (!s) return NULL;
+    if ((*s)->refs > 1) {
+        VFS_File *c = malloc(sizeof(VFS_File));
+        if (!c) return NULL;
+        memcpy(c, *s, sizeof(VFS_File));
+        c->refs = 1;
+        --(*s)->refs;
+        *s = c;
+    }
+    return *s;
+}
+
+/* Dentry cache: (directory inode, name) -> inode and mode, including negative
+ * entries (inode -1) for names looked up and not found. It is direct-mapped,
+ * so a key can only ever sit in its own slot; every create, rm and mv rewrites
+ * that slot, which keeps whatever is cached exact. A miss scans the file
+ * table. Entries are keyed by the parent's inode, not its path, so moving a
+ * directory leaves everything cached beneath it valid. Lookups under the
+ * shared lock fill slots concurrently, so slots are locked in stripes. */
+typedef struct Dentry {
+    int parent;
+    int inode;              /* -1: known not to exist */
+    int mode;
+    unsigned gen;           /* valid while it equals dcache_gen; 0 when empty */
+    char name[VFS_NAME_LEN];
+} Dentry;
+
+static Dentry *dcache = NULL;
+static uint32_t dcache_mask = 0;
+static unsigned dcache_gen = 1;     /* bumped to forget every entry at once */
+static pthread_mutex_t dcache_locks[DCACHE_STRIPES] = { [0 ... DCACHE_STRIPES - 1] = PTHREAD_MUTEX_INITIALIZER };
+
+/* Keep the cache at twice the file count or more; a resize starts empty.
+ * Exclusive lock only. */
+static void d_reserve(void) {
+    uint32_t want = dcache ? dcache_mask + 1 : 256;
+    while (want < 2 * (uint32_t)vfs_live->count) want *= 2;
+    if (dcache && want == dcache_mask + 1) return;
+    Dentry *nd = calloc(want, sizeof(Dentry));
+    if (!nd) return;
+    free(dcache);
+    dcache = nd;
+    dcache_mask = want - 1;
+}
+
+static Dentry *d_slot(int parent, const char *name) {
+    if (!dcache) return NULL;
+    uint32_t h = 2166136261u ^ (uint32_t)parent;
+    for (const char *c = name; *c; ++c) h = (h ^ (unsigned char)*c) * 16777619u;
+    return &dcache[h & dcache_mask];
+}
+
+static void d_fill(Dentry *d, int parent, const char *name, int inode, int mode) {
+    d->parent = parent;
+    d->inode = inode;
+    d->mode = mode;
+    d->gen = dcache_gen;
+    snprintf(d->name, sizeof(d->name), "%s", name);
+}
+
+/* Exclusive lock only. */
+static void d_set(int parent, const char *name, int inode, int mode) {
+    Dentry *d = d_slot(parent, name);
+    if (d) d_fill(d, parent, name, inode, mode);
+}
+
+/* Inode of name in directory dir, or -1; its mode goes to *mode. */
+static int child_of(int dir, const char *name, int *mode, int flags) {
+    if (strlen(name) >= VFS_NAME_LEN) return -1;
+    Dentry *d = (flags & VFS_LOOKUP_NOCACHE) ? NULL : d_slot(dir, name);
+    pthread_mutex_t *lk = d ? &dcache_locks[(d - dcache) % DCACHE_STRIPES] : NULL;
+    if (d) {
+        pthread_mutex_lock(lk);
+        if (d->gen == dcache_gen && d->parent == dir && strcmp(d->name, name) == 0) {
+            int inode = d->inode;
+            *mode = d->mode;
+            pthread_mutex_unlock(lk);
+            return inode;
+        }
+        pthread_mutex_unlock(lk);
+    }
+    int inode = -1;
+    *mode = 0;
+    for (int i = 1; i < vfs_live->count; ++i) {
+        const VFS_File *f = vfs_live->files[i];
+        if (f->parent == dir && strcmp(f->name, name) == 0) { inode = f->inode; *mode = f->mode; break; }
+    }
+    if (d) {
+        pthread_mutex_lock(lk);
+        d_fill(d, dir, name, inode, *mode);
+        pthread_mutex_unlock(lk);
+    }
+    return inode;
+}
+
+/* Walk path from the root or the current directory. Returns the inode it
+ * names, or -1. With leaf, the last component isn't looked up: it is copied
+ * into leaf and the directory that would hold it is returned. */
+static int walk(const char *path, char *leaf, int flags) {
+    if (!path || !*path) return -1;
+    int dir = path[0] == '/' ? VFS_ROOT : vfs_cwd, mode = VFS_DIR;
+    size_t end = strlen(path);
+    while (end > 1 && path[end - 1] == '/') --end;
+    for (size_t i = 0; i < end;) {
+        i += strspn(path + i, "/");
+        if (i >= end) break;
+        size_t n = strcspn(path + i, "/");
+        if (i + n > end) n = end - i;
+        char name[VFS_NAME_LEN];
+        if (n >= VFS_NAME_LEN || mode != VFS_DIR) return -1;
+        memcpy(name, path + i, n);
+        name[n] = '\0';
+        i += n;
+        if (leaf && i >= end) {
+            if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) return -1;
+            strcpy(leaf, name);
+            return dir;
+        }
+        if (strcmp(name, ".") == 0) continue;
+        if (strcmp(name, "..") == 0) { dir = vfs_by_inode(dir)->parent; continue; }
+        if ((dir = child_of(dir, name, &mode, flags)) < 0) return -1;
+    }
+    return leaf ? -1 : dir;
+}
+
+int vfs_lookup(const char *path, int flags) {
+    rdlock();
+    int inode = walk(path, NULL, flags);
+    unlock();
+    return inode;
+}
+
+/* "a/b/c" for inode c, from the root; "" for the root itself. */
+static void vfs_path(int inode, char *buf, size_t size) {
+    const VFS_File *f = vfs_by_inode(inode);
+    if (!f || inode == VFS_ROOT) { buf[0] = '\0'; return; }
+    vfs_path(f->parent, buf, size);
+    size_t len = strlen(buf);
+    snprintf(buf + len, size - len, "%s%s", len ? "/" : "", f->name);
+}
+
+static int is_below(int inode, int dir) {
+    for (const VFS_File *f = vfs_by_inode(inode); f && f->inode != VFS_ROOT; f = vfs_by_inode(f->parent))
+        if (f->inode == dir) return 1;
+    return 0;
+}
+
+/* Adjust a directory's entry count. */
+static void add_entries(int dir, int n) {
+    VFS_File *d = writable(dir);
+    if (d) d->size += n;
+}
+
+/* Drop the live table's slot for f (exclusive lock, table unshared). */
+static void drop_record(VFS_File *f) {
+    VFS_File **s = slot_of(vfs_live, f->inode);
+    vfs_index_remove((uint32_t)f->inode, f->data, (size_t)f->size);
+    memmove(s, s + 1, (size_t)(vfs_live->files + vfs_live->count - s - 1) * sizeof(VFS_File *));
+    --vfs_live->count;
+    if (--f->refs == 0) free(f);
+}
+
+static int add_entry(const char *path, int mode) {
+    char leaf[VFS_NAME_LEN];
+    int m;
+    if (!path) { printf("vfs: no filename\n"); return -1; }
+    if (vfs_live->count > VFS_MAX_FILES) { printf("vfs: filesystem full\n"); return -1; }
+    int dir = walk(path, leaf, 0);
+    if (dir < 0) { printf("vfs: cannot create '%s': no such directory or bad name\n", path); return -1; }
+    if (child_of(dir, leaf, &m, 0) >= 0) { printf("vfs: '%s' already exists\n", path); return -1; }
+    VFS_File *f = calloc(1, sizeof(VFS_File));
+    if (!f || table_unshare() != 0) { free(f); printf("vfs: out of memory\n"); return -1; }
+    if (vfs_live->count == vfs_live->cap) {
+        int ncap = vfs_live->cap * 2;
+        VFS_File **tmp = realloc(vfs_live->files, ncap * sizeof(VFS_File *));
+        if (!tmp) { free(f); printf("vfs: out of memory\n"); return -1; }
+        vfs_live->files = tmp;
+        vfs_live->cap = ncap;
+    }
+    strcpy(f->name, leaf);
+    f->inode = vfs_next_inode++;
+    f->parent = dir;
+    f->mode = mode;
+    f->refs = 1;
+    f->created = f->modified = time(NULL);
+    vfs_live->files[vfs_live->count++] = f;
+    add_entries(dir, 1);
+    d_reserve();
+    d_set(dir, leaf, f->inode, mode);
+    return 0;
+}
+
+void vfs_create(const char *filename) {
+    wrlock();
+    if (add_entry(filename, 0) == 0) printf("vfs: created file '%s'\n", filename);
+    unlock();
+}
+
+void vfs_mkdir(const char *path) {
+    wrlock();
+    if (add_entry(path, VFS_DIR) == 0) printf("vfs: created directory '%s'\n", path);
+    unlock();
+}
+
+/* The regular file at path, or NULL after saying why not. */
+static VFS_File *regular(const char *path) {
+    if (!path) { printf("vfs: no filename\n"); return NULL; }
+    int inode = walk(path, NULL, 0);
+    VFS_File *f = inode < 0 ? NULL : vfs_by_inode(inode);
+    if (!f) { printf("vfs: no such file '%s'\n", path); return NULL; }
+    if (f->mode == VFS_DIR) { printf("vfs: '%s' is a directory\n", path); return NULL; }
+    return f;
+}
+
+/* Returns the new size, read while the caller still holds the file. */
+static int put_data(VFS_File *f, const char *data) {
+    vfs_index_remove((uint32_t)f->inode, f->data, (size_t)f->size);
+    snprintf(f->data, sizeof(f->data), "%s", data);
+    f->size = (int)strlen(f->data);
+    f->modified = time(NULL);
+    vfs_index_add((uint32_t)f->inode, f->data, (size_t)f->size);
+    return f->size;
+}
+
+void vfs_write(const char *filename, const char *data) {
+    if (!data) data = "";
+    rdlock();
+    VFS_File *f = regular(filename);
+    int size = 0;
+    if (f && f->refs == 1 && vfs_live->refs == 1) {
+        pthread_rwlock_wrlock(file_lock(f));
+        size = put_data(f, data);
+        pthread_rwlock_unlock(file_lock(f));
+    } else if (f) {
+        /* Shared with a snapshot: copying the record changes the table. */
+        unlock();
+        wrlock();
+        if ((f = regular(filename)) && !(f = writable(f->inode))) printf("vfs: out of memory\n");
+        if (f) size = put_data(f, data);
+    }
+    if (f) printf("vfs: wrote to '%s' (%d bytes)\n", filename, size);
+    unlock();
+}
+
+/* Copy the file at path into buf, NUL-terminated. Returns its size, or -1 if
+ * path is not a regular file. */
+int vfs_read(const char *path, char *buf, size_t size) {
+    rdlock();
+    int inode = path ? walk(path, NULL, 0) : -1, n = -1;
+    const VFS_File *f = inode < 0 ? NULL : vfs_by_inode(inode);
+    if (f && f->mode != VFS_DIR) {
+        pthread_rwlock_rdlock(file_lock(f));
+        n = f->size;
+        if (size) snprintf(buf, size, "%s", f->data);
+        pthread_rwlock_unlock(file_lock(f));
+    }
+    unlock();
+    return n;
+}
+
+void vfs_cat(const char *filename) {
+    rdlock();
+    VFS_File *f = regular(filename);
+    if (f) {
+        pthread_rwlock_rdlock(file_lock(f));
+        printf("%s\n", f->data);
+        pthread_rwlock_unlock(file_lock(f));
+    }
+    unlock();
+}
+
+static void ls_line(const VFS_File *f) {
+    char mbuf[64], cbuf[64], name[VFS_NAME_LEN + 1];
+    struct tm mtm, ctm;
+    pthread_rwlock_rdlock(file_lock(f));
+    localtime_r(&f->modified, &mtm);
+    localtime_r(&f->created, &ctm);
+    int size = f->size;
+    pthread_rwlock_unlock(file_lock(f));
+    strftime(mbuf, sizeof(mbuf), "%b %d %H:%M", &mtm);
+    strftime(cbuf, sizeof(cbuf), "%b %d %H:%M", &ctm);
+    snprintf(name, sizeof(name), "%s%s", f->name, f->mode == VFS_DIR ? "/" : "");
+    printf("%-20s %-8d %-12s %s\n", name, size, mbuf, cbuf);
+}
+
+/* List a directory (the current one if path is NULL), or a single file. */
+void vfs_ls(const char *path) {
+    rdlock();
+    int inode = path ? walk(path, NULL, 0) : vfs_cwd;
+    const VFS_File *d = inode < 0 ? NULL : vfs_by_inode(inode);
+    if (!d) printf("vfs: no such file or directory '%s'\n", path);
+    else if (d->mode == VFS_DIR && d->size == 0) printf("(empty)\n");
+    else {
+        printf("%-20s %-8s %-12s %s\n", "Name", "Size", "Modified", "Created");
+        if (d->mode != VFS_DIR) ls_line(d);
+        else for (int i = 1; i < vfs_live->count; ++i) if (vfs_live->files[i]->parent == inode) ls_line(vfs_live->files[i]);
+    }
+    unlock();
+}
+
+void vfs_rm(const char *filename) {
+    if (!filename) { printf("vfs: no filename\n"); return; }
+    wrlock();
+    int inode = walk(filename, NULL, 0);
+    VFS_File *f = inode < 0 ? NULL : vfs_by_inode(inode);
+    if (!f) printf("vfs: no such file '%s'\n", filename);
+    else if (inode == VFS_ROOT) printf("vfs: cannot remove '/'\n");
+    else if (f->mode == VFS_DIR && f->size) printf("vfs: directory '%s' not empty\n", filename);
+    else if (table_unshare() != 0) printf("vfs: out of memory\n");
+    else {
+        if (is_below(vfs_cwd, inode)) vfs_cwd = f->parent;
+        add_entries(f->parent, -1);
+        d_set(f->parent, f->name, -1, 0);
+        drop_record(f);
+        printf("vfs: removed '%s'\n", filename);
+    }
+    unlock();
+}
+
+/* vfs mv FROM TO: rename, or move into TO if that is a directory. A regular
+ * file already at the destination is replaced. */
+static void mv_locked(const char *from, const char *to) {
+    char leaf[VFS_NAME_LEN];
+    int inode = walk(from, NULL, 0);
+    if (inode < 0) { printf("vfs: no such file or directory '%s'\n", from); return; }
+    if (inode == VFS_ROOT) { printf("vfs: cannot move '/'\n"); return; }
+    int dir = walk(to, NULL, 0);
+    if (dir >= 0 && vfs_by_inode(dir)->mode == VFS_DIR) {
+        strcpy(leaf, vfs_by_inode(inode)->name);
+    } else if ((dir = walk(to, leaf, 0)) < 0) {
+        printf("vfs: cannot move to '%s': no such directory or bad name\n", to);
+        return;
+    }
+    if (dir == inode || is_below(dir, inode)) { printf("vfs: cannot move '%s' into itself\n", from); return; }
+    int m, old = child_of(dir, leaf, &m, 0);
+    if (old == inode) return;
+    if (old >= 0 && (m == VFS_DIR || vfs_by_inode(inode)->mode == VFS_DIR)) { printf("vfs: '%s' already exists\n", to); return; }
+    if (table_unshare() != 0) { printf("vfs: out of memory\n"); return; }
+    if (old >= 0) {
+        add_entries(dir, -1);
+        drop_record(vfs_by_inode(old));
+    }
+    VFS_File *f = writable(inode);
+    if (!f) { printf("vfs: out of memory\n"); return; }
+    int from_dir = f->parent;
+    d_set(from_dir, f->name, -1, 0);
+    strcpy(f->name, leaf);
+    f->parent = dir;
+    f->modified = time(NULL);
+    d_set(dir, leaf, inode, f->mode);
+    add_entries(from_dir, -1);
+    add_entries(dir, 1);
+    printf("vfs: moved '%s' to '%s'\n", from, to);
+}
+
+void vfs_mv(const char *from, const char *to) {
+    wrlock();
+    mv_locked(from, to);
+    unlock();
+}
+
+void vfs_cd(const char *path) {
+    wrlock();
+    int inode = path ? walk(path, NULL, 0) : VFS_ROOT;
+    const VFS_File *d = inode < 0 ? NULL : vfs_by_inode(inode);
+    if (!d) printf("vfs: no such directory '%s'\n", path);
+    else if (d->mode != VFS_DIR) printf("vfs: '%s' is not a directory\n", path);
+    else vfs_cwd = inode;
+    unlock();
+}
+
+void vfs_pwd(void) {
+    char buf[PATH_BUF];
+    rdlock();
+    vfs_path(vfs_cwd, buf, sizeof(buf));
+    unlock();
+    printf("/%s\n", buf);
+}
+
+static VfsSnapshot *find_snapshot(const char *name) {
+    for (int i = 0; i < vfs_snap_count; ++i) if (strcmp(vfs_snaps[i].name, name) == 0) return &vfs_snaps[i];
+    return NULL;
+}
+
+/* vfs snapshot NAME: remember the tree as it is now, replacing any older
+ * snapshot of that name. O(1); the cost is paid by later changes, as above. */
+void vfs_snapshot(const char *name) {
+    if (!name || !*name || strlen(name) >= VFS_NAME_LEN) { printf("vfs: bad snapshot name\n"); return; }
+    wrlock();
+    VfsSnapshot *s = find_snapshot(name);
+    if (!s && vfs_snap_count == VFS_MAX_SNAPSHOTS) {
+        printf("vfs: too many snapshots (%d)\n", VFS_MAX_SNAPSHOTS);
+    } else {
+        if (s) table_release(s->table);
+        else strcpy((s = &vfs_snaps[vfs_snap_count++])->name, name);
+        s->table = vfs_live;
+        ++vfs_live->refs;
+        printf("vfs: snapshot '%s' (%d files)\n", name, vfs_live->count - 1);
+    }
+    unlock();
+}
+
+void vfs_snapshot_drop(const char *name) {
+    wrlock();
+    VfsSnapshot *s = name ? find_snapshot(name) : NULL;
+    if (!s) printf("vfs: no such snapshot '%s'\n", name ? name : "");
+    else {
+        table_release(s->table);
+        *s = vfs_snaps[--vfs_snap_count];
+        printf("vfs: dropped snapshot '%s'\n", name);
+    }
+    unlock();
+}
+
+void vfs_snapshot_list(void) {
+    rdlock();
+    if (vfs_snap_count == 0) printf("(no snapshots)\n");
+    for (int i = 0; i < vfs_snap_count; ++i) {
+        const VfsTable *t = vfs_snaps[i].table;
+        printf("%-20s %d files%s\n", vfs_snaps[i].name, t->count - 1, t == vfs_live ? " (current)" : "");
+    }
+    unlock();
+}
+
+/* vfs restore NAME: make a snapshot the live tree again. The snapshot is
+ * kept. Records both trees share are identical, so only the others need
+ * reindexing. */
+void vfs_restore(const char *name) {
+    wrlock();
+    VfsSnapshot *s = name ? find_snapshot(name) : NULL;
+    if (!s) { printf("vfs: no such snapshot '%s'\n", name ? name : ""); unlock(); return; }
+    VfsTable *old = vfs_live, *t = s->table;
+    int i = 0, j = 0;
+    while (i < old->count || j < t->count) {
+        const VFS_File *a = i < old->count ? old->files[i] : NULL, *b = j < t->count ? t->files[j] : NULL;
+        if (a && b && a == b) { ++i; ++j; continue; }
+        if (a && (!b || a->inode <= b->inode)) { vfs_index_remove((uint32_t)a->inode, a->data, (size_t)a->size); ++i; }
+        if (b && (!a || b->inode <= a->inode)) { vfs_index_add((uint32_t)b->inode, b->data, (size_t)b->size); ++j; }
+    }
+    ++t->refs;
+    vfs_live = t;
+    table_release(old);
+    ++dcache_gen;
+    d_reserve();
+    const VFS_File *cwd = vfs_by_inode(vfs_cwd);
+    if (!cwd || cwd->mode != VFS_DIR) vfs_cwd = VFS_ROOT;
+    printf("vfs: restored snapshot '%s' (%d files)\n", name, t->count - 1);
+    unlock();
+}
+
+/* Print the lines of f that contain pat (or just count them); returns the count. */
+static int grep_file(const VFS_File *f, const char *pat, size_t plen, int flags) {
+    pthread_rwlock_rdlock(file_lock(f));
+    const char *data = f->data, *end = data + f->size, *hit;
+    char path[PATH_BUF] = "";
+    int count = 0;
+    while (data < end && (hit = vfs_find(data, (size_t)(end - data), pat, plen))) {
+        const char *bol = hit, *eol = memchr(hit, '\n', (size_t)(end - hit));
+        while (bol > f->data && bol[-1] != '\n') --bol;
+        if (!eol) eol = end;
+        if (!count++) vfs_path(f->inode, path, sizeof(path));
+        if (flags & VFS_GREP_LIST) break;
+        if (!(flags & VFS_GREP_COUNT)) printf("%s:%.*s\n", path, (int)(eol - bol), bol);
+        data = eol + 1;
+    }
+    pthread_rwlock_unlock(file_lock(f));
+    if (count && (flags & VFS_GREP_LIST)) printf("%s\n", path);
+    else if (count && (flags & VFS_GREP_COUNT)) printf("%s:%d\n", path, count);
+    return count;
+}
+
+/* vfs grep [-c|-l] PATTERN: fixed-string search over every file, which is
+ * named by its path from the root. Patterns of 3+ bytes only look at the files
+ * the trigram index allows, unless that is over a quarter of them anyway
+ * (VFS_GREP_SCAN always checks every file). Returns the number of files that
+ * matched. */
+int vfs_grep(const char *pat, int flags) {
+    size_t plen = strlen(pat);
+    int files = 0;
+    uint32_t *ids = NULL;
+    rdlock();
+    int n = (flags & VFS_GREP_SCAN) ? -1 : vfs_index_candidates(pat, plen, (uint32_t)vfs_live->count / 4, &ids);
+    if (n < 0) {
+        for (int i = 1; i < vfs_live->count; ++i) files += grep_file(vfs_live->files[i], pat, plen, flags) > 0;
+    } else {
+        for (int i = 0; i < n; ++i) {
+            const VFS_File *f = vfs_by_inode((int)ids[i]);
+            if (f) files += grep_file(f, pat, plen, flags) > 0;
+        }
+    }
+    unlock();
+    free(ids);
+    return files;
+}
+
+int handle_vfs(Command *cmd) {
+    if (!cmd || !cmd->name) return 0;
+    if (strcmp(cmd->name, "vfs") != 0) return 0;
+    if (!cmd->args[1]) { printf("vfs: missing subcommand (create/mkdir/write/ls/cat/rm/mv/cd/pwd/grep/snapshot/restore)\n"); return 1; }
+
+    if (strcmp(cmd->args[1], "create") == 0 && cmd->args[2]) {
+        vfs_create(cmd->args[2]);
+    } else if (strcmp(cmd->args[1], "write") == 0 && cmd->args[2]) {
+        char combined[2048] = {0};
+        for (int i = 3; cmd->args[i]; ++i) {
+            if (strlen(combined) + strlen(cmd->args[i]) + 2 < sizeof(combined)) {
+                if (combined[0]) strcat(combined, " ");
+                strcat(combined, cmd->args[i]);
+            }
+        }
+        vfs_write(cmd->args[2], combined);
+    } else if (strcmp(cmd->args[1], "mkdir") == 0 && cmd->args[2]) {
+        vfs_mkdir(cmd->args[2]);
+    } else if (strcmp(cmd->args[1], "ls") == 0) {
+        vfs_ls(cmd->args[2]);
+    } else if (strcmp(cmd->args[1], "cat") == 0 && cmd->args[2]) {
+        vfs_cat(cmd->args[2]);
+    } else if (strcmp(cmd->args[1], "rm") == 0 && cmd->args[2]) {
+        vfs_rm(cmd->args[2]);
+    } else if (strcmp(cmd->args[1], "mv") == 0 && cmd->args[2] && cmd->args[3]) {
+        vfs_mv(cmd->args[2], cmd->args[3]);
+    } else if (strcmp(cmd->args[1], "cd") == 0) {
+        vfs_cd(cmd->args[2]);
+    } else if (strcmp(cmd->args[1], "pwd") == 0) {
+        vfs_pwd();
+    } else if (strcmp(cmd->args[1], "snapshot") == 0) {
+        if (!cmd->args[2]) vfs_snapshot_list();
+        else if (strcmp(cmd->args[2], "-d") == 0) vfs_snapshot_drop(cmd->args[3]);
+        else vfs_snapshot(cmd->args[2]);
+    } else if (strcmp(cmd->args[1], "restore") == 0 && cmd->args[2]) {
+        vfs_restore(cmd->args[2]);
+    } else if (strcmp(cmd->args[1], "grep") == 0) {
+        int flags = 0, a = 2;
+        for (; cmd->args[a] && (strcmp(cmd->args[a], "-c") == 0 || strcmp(cmd->args[a], "-l") == 0); ++a)
+            flags |= cmd->args[a][1] == 'c' ? VFS_GREP_COUNT : VFS_GREP_LIST;
+        if (!cmd->args[a]) { printf("vfs: usage: vfs grep [-c|-l] pattern\n"); last_status = 2; return 1; }
+        char pattern[2048] = {0};
+        for (int i = a; cmd->args[i]; ++i) {
+            if (strlen(pattern) + strlen(cmd->args[i]) + 2 < sizeof(pattern)) {
+                if (pattern[0]) strcat(pattern, " ");
+                strcat(pattern, cmd->args[i]);
+            }
+        }
+        last_status = vfs_grep(pattern, flags) ? 0 : 1;
+    } else {
+        printf("vfs: unknown command. Use: create/mkdir/write/ls/cat/rm/mv/cd/pwd/grep/snapshot/restore\n");
+    }
+    return 1;
+}
@@ -0,0 +1,182 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "shell.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define VFS_SEARCH_X86 1
+#endif
+
+/* Trigram index over VFS file contents. Every 3-byte sequence in a file maps to
+ * a posting list: the sorted inode numbers of the files containing it. A
+ * substring query of 3+ bytes can only match files present in the postings of
+ * all of its trigrams, so vfs grep verifies just that intersection. vfs_write
+ * removes a file's old trigrams and adds the new ones; nothing is rebuilt.
+ * Writes to different files may update it at once, so it has its own lock. */
+
+typedef struct Posting {
+    uint32_t key;           /* trigram + 1; 0 marks an empty slot */
+    uint32_t n, cap;
+    uint32_t *ids;
+} Posting;
+
+static Posting *table = NULL;
+static uint32_t table_cap = 0, table_used = 0;
+static pthread_rwlock_t index_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static uint32_t trigram(const char *p) {
+    return (uint32_t)(unsigned char)p[0] << 16 | (uint32_t)(unsigned char)p[1] << 8 | (unsigned char)p[2];
+}
+
+static uint32_t slot_of(const Posting *t, uint32_t cap, uint32_t key) {
+    uint32_t i = (key * 2654435761u) & (cap - 1);
+    while (t[i].key && t[i].key != key) i = (i + 1) & (cap - 1);
+    return i;
+}
+
+static int table_grow(void) {
+    uint32_t ncap = table_cap ? table_cap * 2 : 4096;
+    Posting *nt = calloc(ncap, sizeof(Posting));
+    if (!nt) return -1;
+    for (uint32_t i = 0; i < table_cap; ++i) if (table[i].key) nt[slot_of(nt, ncap, table[i].key)] = table[i];
+    free(table);
+    table = nt;
+    table_cap = ncap;
+    return 0;
+}
+
+static Posting *lookup(uint32_t tri, int create) {
+    uint32_t key = tri + 1;
+    if (!table_cap) { if (!create || table_grow() != 0) return NULL; }
+    uint32_t i = slot_of(table, table_cap, key);
+    if (table[i].key) return &table[i];
+    if (!create) return NULL;
+    if (2 * (table_used + 1) > table_cap) {
+        if (table_grow() != 0) return NULL;
+        i = slot_of(table, table_cap, key);
+    }
+    table[i].key = key;
+    ++table_used;
+    return &table[i];
+}
+
+/* Position of id in the sorted list, or where it would go. */
+static uint32_t lower_bound(const uint32_t *ids, uint32_t n, uint32_t id) {
+    uint32_t lo = 0, hi = n;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (ids[mid] < id) lo = mid + 1; else hi = mid;
+    }
+    return lo;
+}
+
+void vfs_index_add(uint32_t id, const char *data, size_t len) {
+    pthread_rwlock_wrlock(&index_lock);
+    for (size_t i = 0; i + 3 <= len; ++i) {
+        Posting *p = lookup(trigram(data + i), 1);
+        if (!p) break;
+        uint32_t at = p->n && p->ids[p->n - 1] < id ? p->n : lower_bound(p->ids, p->n, id);
+        if (at < p->n && p->ids[at] == id) continue;
+        if (p->n == p->cap) {
+            uint32_t ncap = p->cap ? p->cap * 2 : 4;
+            uint32_t *tmp = realloc(p->ids, ncap * sizeof(uint32_t));
+            if (!tmp) break;
+            p->ids = tmp;
+            p->cap = ncap;
+        }
+        memmove(p->ids + at + 1, p->ids + at, (p->n - at) * sizeof(uint32_t));
+        p->ids[at] = id;
+        ++p->n;
+    }
+    pthread_rwlock_unlock(&index_lock);
+}
+
+void vfs_index_remove(uint32_t id, const char *data, size_t len) {
+    pthread_rwlock_wrlock(&index_lock);
+    for (size_t i = 0; i + 3 <= len; ++i) {
+        Posting *p = lookup(trigram(data + i), 0);
+        if (!p) continue;
+        uint32_t at = lower_bound(p->ids, p->n, id);
+        if (at == p->n || p->ids[at] != id) continue;
+        memmove(p->ids + at, p->ids + at + 1, (p->n - at - 1) * sizeof(uint32_t));
+        --p->n;
+    }
+    pthread_rwlock_unlock(&index_lock);
+}
+
+static int by_size(const void *a, const void *b) {
+    const Posting *x = *(const Posting *const *)a, *y = *(const Posting *const *)b;
+    return (x->n > y->n) - (x->n < y->n);
+}
+
+/* Inodes of the files that may contain pat, ascending, in a malloc'd array.
+ * Returns the count, or -1 when the index can't narrow the search below limit
+ * files (pat too short, or even its rarest trigram is that common) and a plain
+ * scan is cheaper. */
+static int candidates(const char *pat, size_t len, uint32_t limit, uint32_t **out) {
+    *out = NULL;
+    if (len < 3) return -1;
+    size_t ntri = len - 2;
+    const Posting **lists = malloc(ntri * sizeof(Posting *));
+    if (!lists) return -1;
+    for (size_t i = 0; i < ntri; ++i) {
+        const Posting *p = lookup(trigram(pat + i), 0);
+        if (!p || p->n == 0) { free(lists); return 0; }
+        lists[i] = p;
+    }
+    /* Intersect, smallest list first, so the working set only shrinks. */
+    qsort(lists, ntri, sizeof(Posting *), by_size);
+    if (lists[0]->n > limit) { free(lists); return -1; }
+    uint32_t *ids = malloc(lists[0]->n * sizeof(uint32_t));
+    if (!ids) { free(lists); return -1; }
+    memcpy(ids, lists[0]->ids, lists[0]->n * sizeof(uint32_t));
+    uint32_t n = lists[0]->n;
+    for (size_t l = 1; l < ntri && n; ++l) {
+        if (lists[l] == lists[l - 1]) continue;         /* repeated trigram */
+        uint32_t k = 0, from = 0;
+        for (uint32_t i = 0; i < n; ++i) {
+            from += lower_bound(lists[l]->ids + from, lists[l]->n - from, ids[i]);
+            if (from < lists[l]->n && lists[l]->ids[from] == ids[i]) ids[k++] = ids[i];
+        }
+        n = k;
+    }
+    free(lists);
+    *out = ids;
+    return (int)n;
+}
+
+int vfs_index_candidates(const char *pat, size_t len, uint32_t limit, uint32_t **out) {
+    pthread_rwlock_rdlock(&index_lock);
+    int n = candidates(pat, len, limit, out);
+    pthread_rwlock_unlock(&index_lock);
+    return n;
+}
+
+/* First occurrence of needle in hay. On x86 16 positions are tested at once:
+ * a match needs both the needle's first and last byte in place, and only those
+ * candidates are compared in full. */
+const char *vfs_find(const char *hay, size_t hlen, const char *needle, size_t nlen) {
+    if (nlen == 0) return hay;
+    if (nlen > hlen) return NULL;
+    if (nlen == 1) return memchr(hay, needle[0], hlen);
+#ifdef VFS_SEARCH_X86
+    const __m128i first = _mm_set1_epi8(needle[0]), last = _mm_set1_epi8(needle[nlen - 1]);
+    size_t i = 0;
+    for (; i + nlen - 1 + 16 <= hlen; i += 16) {
+        __m128i f = _mm_cmpeq_epi8(first, _mm_loadu_si128((const __m128i *)(hay + i)));
+        __m128i l = _mm_cmpeq_epi8(last, _mm_loadu_si128((const __m128i *)(hay + i + nlen - 1)));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(f, l));
+        while (mask) {
+            unsigned bit = (unsigned)__builtin_ctz(mask);
+            if (memcmp(hay + i + bit + 1, needle + 1, nlen - 2) == 0) return hay + i + bit;
+            mask &= mask - 1;
+        }
+    }
+    return memmem(hay + i, hlen - i, needle, nlen);
+#else
+    return memmem(hay, hlen, needle, nlen);
+#endif
+}